@@ -0,0 +1,108 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "auxpowcache.h"
+
+#include "core_memusage.h"
+#include "memusage.h"
+
+CAuxPowCache auxpowCache;
+
+CAuxPowCache::CAuxPowCache(size_t nMaxUsageIn)
+    : nMaxUsage(nMaxUsageIn)
+    , nUsage(0)
+{
+}
+
+size_t CAuxPowCache::EntryUsage(const CAuxPow& auxpow)
+{
+    // the object and its shared_ptr control block, the list node and the map node
+    return memusage::MallocUsage(sizeof(CAuxPow)) + RecursiveDynamicUsage(auxpow) +
+           memusage::MallocUsage(4 * sizeof(void*)) +
+           memusage::MallocUsage(sizeof(EntryList::value_type) + 2 * sizeof(void*)) +
+           memusage::MallocUsage(sizeof(memusage::stl_tree_node<std::pair<const uint256, EntryList::iterator> >));
+}
+
+void CAuxPowCache::Trim()
+{
+    while (nUsage > nMaxUsage && !listEntries.empty())
+    {
+        nUsage -= EntryUsage(*listEntries.back().second);
+        mapEntries.erase(listEntries.back().first);
+        listEntries.pop_back();
+    }
+}
+
+void CAuxPowCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    nMaxUsage = nMaxUsageIn;
+    Trim();
+}
+
+void CAuxPowCache::Insert(const uint256& hash, const boost::shared_ptr<CAuxPow>& auxpow)
+{
+    if (!auxpow)
+        return;
+
+    LOCK(cs);
+    if (nMaxUsage == 0)
+        return;
+
+    std::map<uint256, EntryList::iterator>::iterator it = mapEntries.find(hash);
+    if (it != mapEntries.end())
+    {
+        // the auxpow of a block never changes, only refresh its position
+        listEntries.splice(listEntries.begin(), listEntries, it->second);
+        return;
+    }
+
+    listEntries.push_front(std::make_pair(hash, auxpow));
+    mapEntries.insert(std::make_pair(hash, listEntries.begin()));
+    nUsage += EntryUsage(*auxpow);
+    Trim();
+}
+
+boost::shared_ptr<CAuxPow> CAuxPowCache::Get(const uint256& hash) const
+{
+    LOCK(cs);
+    std::map<uint256, EntryList::iterator>::const_iterator it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return boost::shared_ptr<CAuxPow>();
+
+    listEntries.splice(listEntries.begin(), listEntries, it->second);
+    return it->second->second;
+}
+
+bool CAuxPowCache::Contains(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapEntries.count(hash) != 0;
+}
+
+bool CAuxPowCache::IsFull() const
+{
+    LOCK(cs);
+    return nUsage >= nMaxUsage;
+}
+
+size_t CAuxPowCache::size() const
+{
+    LOCK(cs);
+    return mapEntries.size();
+}
+
+size_t CAuxPowCache::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return nUsage;
+}
+
+void CAuxPowCache::Clear()
+{
+    LOCK(cs);
+    listEntries.clear();
+    mapEntries.clear();
+    nUsage = 0;
+}
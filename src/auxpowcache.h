@@ -0,0 +1,64 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWN_AUXPOWCACHE_H
+#define CROWN_AUXPOWCACHE_H
+
+#include "auxpow.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <utility>
+
+#include <boost/shared_ptr.hpp>
+
+//! -auxpowcache default (MiB)
+static const int64_t DEFAULT_AUXPOW_CACHE = 32;
+//! -auxpowindex default
+static const bool DEFAULT_AUXPOWINDEX = true;
+
+/**
+ * Auxpow of merge-mined blocks keyed by block hash. CBlockIndex does not keep
+ * the auxpow, so without this every header served to a peer would be read back
+ * from the block files. The least recently used entries are dropped once the
+ * memory used by the cache grows over the limit.
+ */
+class CAuxPowCache
+{
+private:
+    typedef std::list<std::pair<uint256, boost::shared_ptr<CAuxPow> > > EntryList;
+
+    mutable CCriticalSection cs;
+    //! most recently used entries first
+    mutable EntryList listEntries;
+    std::map<uint256, EntryList::iterator> mapEntries;
+    size_t nMaxUsage;
+    size_t nUsage;
+
+    static size_t EntryUsage(const CAuxPow& auxpow);
+    void Trim();
+
+public:
+    CAuxPowCache(size_t nMaxUsageIn = DEFAULT_AUXPOW_CACHE << 20);
+
+    void SetMaxUsage(size_t nMaxUsageIn);
+
+    /** Store the auxpow of a block, the cache keeps a reference to the object */
+    void Insert(const uint256& hash, const boost::shared_ptr<CAuxPow>& auxpow);
+
+    /** Return the cached auxpow of a block or an empty pointer */
+    boost::shared_ptr<CAuxPow> Get(const uint256& hash) const;
+
+    bool Contains(const uint256& hash) const;
+    bool IsFull() const;
+    size_t size() const;
+    size_t DynamicMemoryUsage() const;
+    void Clear();
+};
+
+extern CAuxPowCache auxpowCache;
+
+#endif // CROWN_AUXPOWCACHE_H
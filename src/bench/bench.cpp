@@ -0,0 +1,69 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include <iomanip>
+#include <iostream>
+#include <sys/time.h>
+
+using namespace benchmark;
+
+BenchRunner::BenchmarkMap &BenchRunner::benchmarks() {
+    static std::map<std::string, BenchFunction> benchmarks_map;
+    return benchmarks_map;
+}
+
+static double gettimedouble(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_usec * 0.000001 + tv.tv_sec;
+}
+
+BenchRunner::BenchRunner(std::string name, BenchFunction func)
+{
+    benchmarks().insert(std::make_pair(name, func));
+}
+
+void
+BenchRunner::RunAll(const std::string& strFilter, double elapsedTimeForOne)
+{
+    std::cout << "#Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
+
+    for (BenchmarkMap::iterator it = benchmarks().begin(); it != benchmarks().end(); ++it) {
+        if (!strFilter.empty() && it->first.find(strFilter) == std::string::npos)
+            continue;
+
+        State state(it->first, elapsedTimeForOne);
+        BenchFunction& func = it->second;
+        func(state);
+    }
+}
+
+bool State::KeepRunning()
+{
+    double now;
+    if (count == 0) {
+        beginTime = now = gettimedouble();
+    }
+    else {
+        now = gettimedouble();
+        double elapsed = now - lastTime;
+        if (elapsed > maxTime) maxTime = elapsed;
+        if (elapsed < minTime) minTime = elapsed;
+    }
+    lastTime = now;
+    ++count;
+
+    if (now - beginTime < maxElapsed) return true; // Keep going
+
+    --count;
+
+    // Output results
+    double average = (now - beginTime) / count;
+    std::cout << std::fixed << std::setprecision(9) << name << "," << count << "," << minTime << "," << maxTime << "," << average << "\n";
+
+    return false;
+}
@@ -0,0 +1,27 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "crypto/sha256.h"
+#include "key.h"
+#include "main.h"
+#include "util.h"
+
+int
+main(int argc, char** argv)
+{
+    SHA256AutoDetect();
+    ECC_Start();
+    SetupEnvironment();
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+    SelectParams(CBaseChainParams::MAIN);
+
+    // optional argument selects benchmarks whose name contains it
+    benchmark::BenchRunner::RunAll(argc > 1 ? argv[1] : "");
+
+    ECC_Stop();
+}
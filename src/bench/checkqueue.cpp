@@ -0,0 +1,113 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "checkqueue.h"
+#include "coins.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "pubkey.h"
+#include "script/sign.h"
+#include "script/standard.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+    // Script checks of a full block of pay-to-pubkey-hash spends, verified
+    // the way ConnectBlock does it with -par set to the number of threads.
+    struct BlockChecks
+    {
+        CMutableTransaction txFund;
+        std::vector<CTransaction> vtx;
+
+        BlockChecks(int nInputs)
+        {
+            CBasicKeyStore keystore;
+            std::vector<CScript> vScripts;
+            for (int i = 0; i < 16; i++) {
+                CKey key;
+                key.MakeNewKey(i % 2 == 0);
+                keystore.AddKey(key);
+                vScripts.push_back(GetScriptForDestination(key.GetPubKey().GetID()));
+            }
+
+            txFund.vin.resize(1);
+            txFund.vout.resize(nInputs);
+            for (int i = 0; i < nInputs; i++) {
+                txFund.vout[i].nValue = COIN;
+                txFund.vout[i].scriptPubKey = vScripts[i % vScripts.size()];
+            }
+
+            vtx.reserve(nInputs);
+            for (int i = 0; i < nInputs; i++) {
+                CMutableTransaction tx;
+                tx.vin.resize(1);
+                tx.vin[0].prevout = COutPoint(txFund.GetHash(), i);
+                tx.vout.resize(1);
+                tx.vout[0].nValue = COIN;
+                tx.vout[0].scriptPubKey = vScripts[(i + 1) % vScripts.size()];
+                SignSignature(keystore, CTransaction(txFund), tx, 0);
+                vtx.push_back(tx);
+            }
+        }
+    };
+
+    void VerifyBlock(benchmark::State& state, int nThreads)
+    {
+        ECCVerifyHandle verifyHandle;
+        static BlockChecks checks(4000);
+
+        CCheckQueue<CScriptCheck> queue(128);
+        boost::thread_group threadGroup;
+        for (int i = 0; i < nThreads - 1; i++)
+            threadGroup.create_thread(boost::bind(&CCheckQueue<CScriptCheck>::Thread, &queue));
+
+        while (state.KeepRunning()) {
+            CCheckQueueControl<CScriptCheck> control(&queue);
+            std::vector<CScriptCheck> vChecks;
+            for (unsigned int i = 0; i < checks.vtx.size(); i++) {
+                vChecks.push_back(CScriptCheck(checks.txFund.vout[i], checks.vtx[i], 0, STANDARD_SCRIPT_VERIFY_FLAGS, false));
+                if (vChecks.size() >= 32) {
+                    control.Add(vChecks);
+                    vChecks.clear();
+                }
+            }
+            control.Add(vChecks);
+            bool fOk = control.Wait();
+            assert(fOk);
+        }
+
+        queue.Quit();
+        threadGroup.join_all();
+    }
+}
+
+static void VerifyScriptBlock_par1(benchmark::State& state)
+{
+    VerifyBlock(state, 1);
+}
+
+static void VerifyScriptBlock_par2(benchmark::State& state)
+{
+    VerifyBlock(state, 2);
+}
+
+static void VerifyScriptBlock_par4(benchmark::State& state)
+{
+    VerifyBlock(state, 4);
+}
+
+static void VerifyScriptBlock_par8(benchmark::State& state)
+{
+    VerifyBlock(state, 8);
+}
+
+BENCHMARK(VerifyScriptBlock_par1);
+BENCHMARK(VerifyScriptBlock_par2);
+BENCHMARK(VerifyScriptBlock_par4);
+BENCHMARK(VerifyScriptBlock_par8);
@@ -0,0 +1,94 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "main.h"
+#include "undo.h"
+
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    // Coins of a few hundred payout transactions with many outputs each, the
+    // shape masternode and budget payments give the UTXO set.
+    struct PayoutCoins
+    {
+        CCoinsView viewDummy;
+        CCoinsViewCache base;
+        std::vector<CTransaction> vFunding;
+
+        PayoutCoins(int nTransactions, int nOutputs) : base(&viewDummy)
+        {
+            for (int i = 0; i < nTransactions; i++) {
+                CMutableTransaction tx;
+                tx.vin.resize(1);
+                tx.vin[0].prevout = COutPoint(uint256(), i);
+                tx.vout.resize(nOutputs);
+                for (int n = 0; n < nOutputs; n++) {
+                    tx.vout[n].nValue = COIN + n;
+                    tx.vout[n].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG;
+                }
+                vFunding.push_back(tx);
+                AddCoins(base, vFunding.back(), 1);
+            }
+        }
+    };
+}
+
+// The coins part of ConnectBlock: a block spending one output of every payout
+// transaction, applied to a fresh cache on top of the chain tip.
+static void CoinsConnectBlock(benchmark::State& state)
+{
+    static PayoutCoins coins(400, 50);
+
+    std::vector<CTransaction> vtx;
+    for (unsigned int i = 0; i < coins.vFunding.size(); i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(coins.vFunding[i].GetHash(), i % 50);
+        tx.vout.resize(2);
+        tx.vout[0].nValue = COIN / 2;
+        tx.vout[0].scriptPubKey = coins.vFunding[i].vout[0].scriptPubKey;
+        tx.vout[1].nValue = COIN / 2;
+        tx.vout[1].scriptPubKey = coins.vFunding[i].vout[1].scriptPubKey;
+        vtx.push_back(tx);
+    }
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&coins.base);
+        CValidationState stateDummy;
+        for (unsigned int i = 0; i < vtx.size(); i++) {
+            CTxUndo undo;
+            UpdateCoins(vtx[i], stateDummy, view, undo, 2);
+        }
+    }
+}
+
+// Filling a cache with the outputs of payout transactions. The memory the
+// cache needs per unspent output is written to stderr once.
+static void CoinsCacheMemory(benchmark::State& state)
+{
+    static PayoutCoins coins(100, 50);
+
+    size_t nUsage = 0;
+    size_t nCoins = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&coins.viewDummy);
+        for (unsigned int i = 0; i < coins.vFunding.size(); i++)
+            AddCoins(view, coins.vFunding[i], 1);
+        nUsage = view.DynamicMemoryUsage();
+        nCoins = view.GetCacheSize();
+    }
+    static bool fReported = false;
+    if (!fReported && nCoins) {
+        std::cerr << "CoinsCacheMemory: " << nUsage / nCoins << " bytes per cached output\n";
+        fReported = true;
+    }
+}
+
+BENCHMARK(CoinsConnectBlock);
+BENCHMARK(CoinsCacheMemory);
@@ -0,0 +1,101 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "arith_uint256.h"
+#include "main.h"
+#include "miner.h"
+#include "random.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+namespace
+{
+    // A chain with just the genesis block and a mempool spending coins that
+    // are put straight into the coins view. Every fifth transaction spends
+    // the transaction before it, so block assembly has to order dependencies.
+    struct MempoolSetup
+    {
+        boost::filesystem::path pathTemp;
+        CCoinsViewDB* pcoinsdbview;
+
+        MempoolSetup(int nTransactions)
+        {
+            pathTemp = GetTempPath() / strprintf("bench_crown_%lu_%i", (unsigned long)GetTime(), (int)(GetRand(100000)));
+            boost::filesystem::create_directories(pathTemp);
+            mapArgs["-datadir"] = pathTemp.string();
+            pblocktree = new CBlockTreeDB(1 << 20, true);
+            pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+            pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+            InitBlockIndex();
+
+            LOCK2(cs_main, mempool.cs);
+            uint256 hashPrev;
+            for (int i = 0; i < nTransactions; ++i)
+            {
+                CMutableTransaction tx;
+                tx.vin.resize(1);
+                tx.vout.resize(1);
+                tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+                // fee rates from 1000 to about 6000 satoshis per transaction
+                CAmount nFee = 1000 + (i * 37) % 5000;
+
+                if (i % 5 == 0) {
+                    uint256 hashCoins = ArithToUint256(i + 1);
+                    tx.vin[0].prevout = COutPoint(hashCoins, 0);
+                    pcoinsTip->AddCoin(tx.vin[0].prevout, Coin(CTxOut(COIN, CScript() << OP_TRUE), 0, false), false);
+                    tx.vout[0].nValue = COIN - nFee;
+                } else {
+                    CTransaction txPrev;
+                    mempool.lookup(hashPrev, txPrev);
+                    tx.vin[0].prevout = COutPoint(hashPrev, 0);
+                    tx.vout[0].nValue = txPrev.vout[0].nValue - nFee;
+                }
+
+                hashPrev = tx.GetHash();
+                mempool.addUnchecked(hashPrev, CTxMemPoolEntry(tx, nFee, GetTime(), 0.0, 0));
+            }
+        }
+
+        ~MempoolSetup()
+        {
+            mempool.clear();
+            UnloadBlockIndex();
+            delete pcoinsTip;
+            delete pcoinsdbview;
+            delete pblocktree;
+            pcoinsTip = NULL;
+            pblocktree = NULL;
+            boost::filesystem::remove_all(pathTemp);
+        }
+    };
+
+    void CreateBlocks(benchmark::State& state, int nTransactions)
+    {
+        MempoolSetup setup(nTransactions);
+        CScript scriptPubKey = CScript() << OP_TRUE;
+
+        while (state.KeepRunning()) {
+            CBlockTemplate* pblocktemplate = CreateNewBlock(scriptPubKey);
+            delete pblocktemplate;
+        }
+    }
+}
+
+static void CreateNewBlock10k(benchmark::State& state)
+{
+    CreateBlocks(state, 10000);
+}
+
+static void CreateNewBlock50k(benchmark::State& state)
+{
+    CreateBlocks(state, 50000);
+}
+
+BENCHMARK(CreateNewBlock10k);
+BENCHMARK(CreateNewBlock50k);
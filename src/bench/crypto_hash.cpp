@@ -0,0 +1,53 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sha256.h"
+#include "primitives/block.h"
+
+#include <vector>
+
+static void SHA256(benchmark::State& state)
+{
+    uint8_t hash[CSHA256::OUTPUT_SIZE];
+    std::vector<uint8_t> in(1000 * 1000, 0);
+    while (state.KeepRunning())
+        CSHA256().Write(&in[0], in.size()).Finalize(hash);
+}
+
+static void SHA256_32b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(32, 0);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 10000; i++)
+            CSHA256().Write(&in[0], in.size()).Finalize(&in[0]);
+    }
+}
+
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning())
+        SHA256D64(&in[0], &in[0], 1024);
+}
+
+// merkle root of a block with the transactions of a full block
+static void MerkleRoot(benchmark::State& state)
+{
+    CBlock block;
+    block.vtx.resize(4000);
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        CMutableTransaction tx;
+        tx.nLockTime = i;
+        block.vtx[i] = MakeTransactionRef(tx);
+    }
+    while (state.KeepRunning())
+        block.BuildMerkleTree();
+}
+
+BENCHMARK(SHA256);
+BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_1024);
+BENCHMARK(MerkleRoot);
@@ -0,0 +1,83 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "cuckoocache.h"
+#include "hash.h"
+#include "utilstrencodings.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+    static const int LOOKUPS = 400000;
+
+    // A signature cache of default size holding the entries of a busy mempool
+    struct SigCache
+    {
+        CCuckooCache cache;
+        std::vector<uint256> vEntries;
+
+        SigCache(int nEntries)
+            : cache(40 << 20)
+        {
+            for (int i = 0; i < nEntries; i++) {
+                vEntries.push_back(Hash(BEGIN(i), END(i)));
+                // every other entry is not in the cache
+                if (i % 2 == 0)
+                    cache.Insert(vEntries.back());
+            }
+        }
+    };
+
+    void Lookup(const SigCache* sigcache, int nStart, int nCount)
+    {
+        int nHits = 0;
+        for (int i = nStart; i < nStart + nCount; i++)
+            if (sigcache->cache.Contains(sigcache->vEntries[i % sigcache->vEntries.size()], false))
+                nHits++;
+        assert(nHits >= nCount / 2 - 1);
+    }
+
+    // Lookups of the script check threads while a block is connected, the
+    // same total split over the threads
+    void LookupConcurrent(benchmark::State& state, int nThreads)
+    {
+        static SigCache sigcache(200000);
+
+        while (state.KeepRunning()) {
+            boost::thread_group threadGroup;
+            for (int i = 0; i < nThreads; i++)
+                threadGroup.create_thread(boost::bind(&Lookup, &sigcache, i * (LOOKUPS / nThreads), LOOKUPS / nThreads));
+            threadGroup.join_all();
+        }
+    }
+}
+
+static void SigCacheLookup_1(benchmark::State& state)
+{
+    LookupConcurrent(state, 1);
+}
+
+static void SigCacheLookup_4(benchmark::State& state)
+{
+    LookupConcurrent(state, 4);
+}
+
+static void SigCacheLookup_8(benchmark::State& state)
+{
+    LookupConcurrent(state, 8);
+}
+
+static void SigCacheLookup_16(benchmark::State& state)
+{
+    LookupConcurrent(state, 16);
+}
+
+BENCHMARK(SigCacheLookup_1);
+BENCHMARK(SigCacheLookup_4);
+BENCHMARK(SigCacheLookup_8);
+BENCHMARK(SigCacheLookup_16);
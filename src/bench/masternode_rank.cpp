@@ -0,0 +1,93 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "arith_uint256.h"
+#include "main.h"
+#include "masternodeman.h"
+
+#include <vector>
+
+namespace
+{
+    const int nChainLength = 1000;
+    const int nMasternodes = 3000;
+
+    // Masternode list and chain used by the rank benchmarks, the list is
+    // registered in mnodeman and chainActive for the lifetime of the object
+    struct MasternodeRankSetup
+    {
+        std::vector<uint256> hashes;
+        std::vector<CBlockIndex> blocks;
+        CCoinsView coinsDummy;
+        CCoinsViewCache coins;
+        CCoinsViewCache* pcoinsTipOld;
+
+        MasternodeRankSetup()
+            : hashes(nChainLength)
+            , blocks(nChainLength)
+            , coins(&coinsDummy)
+        {
+            for (int i = 0; i < nChainLength; ++i)
+            {
+                hashes[i] = ArithToUint256(i);
+                blocks[i].nHeight = i;
+                blocks[i].pprev = i ? &blocks[i - 1] : NULL;
+                blocks[i].phashBlock = &hashes[i];
+                blocks[i].BuildSkip();
+            }
+            chainActive.SetTip(&blocks.back());
+
+            // collateral lookups go through the coins view
+            pcoinsTipOld = pcoinsTip;
+            pcoinsTip = &coins;
+
+            for (int i = 0; i < nMasternodes; ++i)
+            {
+                CMasternode mn;
+                mn.vin = CTxIn(COutPoint(ArithToUint256(i + 1), 0));
+                mn.unitTest = true;
+                mn.lastPing.vin = mn.vin;
+                mn.lastPing.sigTime = GetAdjustedTime();
+                mnodeman.Add(mn);
+            }
+        }
+
+        ~MasternodeRankSetup()
+        {
+            mnodeman.Clear();
+            pcoinsTip = pcoinsTipOld;
+            chainActive = CChain();
+            mapCacheBlockHashes.clear();
+        }
+    };
+}
+
+// Rank lookups for the same block, as done by InstantSend and payment winner checks
+static void MasternodeRankCached(benchmark::State& state)
+{
+    MasternodeRankSetup setup;
+    CTxIn vin(COutPoint(ArithToUint256(nMasternodes / 2), 0));
+
+    while (state.KeepRunning()) {
+        mnodeman.GetMasternodeRank(vin, nChainLength - 10, 0);
+    }
+}
+
+// Same lookups with the scores recalculated every time, which is what every
+// lookup used to cost before the scores were cached
+static void MasternodeRankUncached(benchmark::State& state)
+{
+    MasternodeRankSetup setup;
+    CTxIn vin(COutPoint(ArithToUint256(nMasternodes / 2), 0));
+
+    while (state.KeepRunning()) {
+        mnodeman.ClearScoresCache();
+        mnodeman.GetMasternodeRank(vin, nChainLength - 10, 0);
+    }
+}
+
+BENCHMARK(MasternodeRankCached);
+BENCHMARK(MasternodeRankUncached);
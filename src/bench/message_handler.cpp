@@ -0,0 +1,128 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "hash.h"
+#include "main.h"
+#include "net.h"
+
+#include <vector>
+
+#include <boost/thread.hpp>
+
+namespace
+{
+    const int nPeers = 16;
+    const int nMessagesPerPeer = 60;
+    const size_t nPayloadSize = 200;
+
+    // Commands in the order they are sent by every peer, a mix of messages that
+    // are processed concurrently and messages that need the exclusive lock
+    const char* vCommands[] = {"mnp", "mnw", "txlvote", "addr", "mvote", "snp", "snw", "pong", "fbvote", "mnp"};
+
+    CSerializeData CreateMessage(const char* pszCommand)
+    {
+        // an empty vector (for addr) or a zero nonce (for pong) followed by padding,
+        // the masternode handlers ignore the payload until the node is synced
+        std::vector<char> vPayload(nPayloadSize, 0);
+
+        CMessageHeader hdr(Params().MessageStart(), pszCommand, vPayload.size());
+        uint256 hash = Hash(vPayload.begin(), vPayload.end());
+        memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << hdr;
+        ss.write(&vPayload[0], vPayload.size());
+
+        CSerializeData data;
+        ss.GetAndClear(data);
+        return data;
+    }
+
+    // Peers with the same trace of received messages, processed the same way
+    // ThreadMessageHandler does it: peers are split over the threads by id and
+    // every thread processes one message per peer in turn
+    struct MessageTrace
+    {
+        std::vector<CNode*> vPeers;
+        std::vector<CSerializeData> vTrace;
+
+        MessageTrace()
+        {
+            RegisterNodeSignals(GetNodeSignals());
+
+            for (int i = 0; i < nMessagesPerPeer; ++i)
+                vTrace.push_back(CreateMessage(vCommands[i % (sizeof(vCommands) / sizeof(vCommands[0]))]));
+
+            for (int i = 0; i < nPeers; ++i)
+            {
+                CNode* pnode = new CNode(INVALID_SOCKET, CAddress(CService("10.0.0.1", 9340 + i)), "", true);
+                pnode->nVersion = PROTOCOL_VERSION;
+                pnode->fSuccessfullyConnected = true;
+                vPeers.push_back(pnode);
+            }
+        }
+
+        ~MessageTrace()
+        {
+            for (size_t i = 0; i < vPeers.size(); ++i)
+                delete vPeers[i];
+            UnregisterNodeSignals(GetNodeSignals());
+        }
+
+        void Receive()
+        {
+            for (size_t i = 0; i < vPeers.size(); ++i)
+            {
+                LOCK(vPeers[i]->cs_vRecvMsg);
+                for (size_t j = 0; j < vTrace.size(); ++j)
+                    vPeers[i]->ReceiveMsgBytes(&vTrace[j][0], vTrace[j].size());
+            }
+        }
+
+        void Process(int nThread, int nThreads)
+        {
+            bool fMore = true;
+            while (fMore)
+            {
+                fMore = false;
+                for (size_t i = nThread; i < vPeers.size(); i += nThreads)
+                {
+                    LOCK(vPeers[i]->cs_vRecvMsg);
+                    ProcessMessages(vPeers[i]);
+                    fMore |= !vPeers[i]->vRecvMsg.empty();
+                }
+            }
+        }
+    };
+
+    void ReplayTrace(benchmark::State& state, int nThreads)
+    {
+        MessageTrace trace;
+
+        while (state.KeepRunning()) {
+            trace.Receive();
+
+            boost::thread_group threads;
+            for (int i = 0; i < nThreads; ++i)
+                threads.create_thread(boost::bind(&MessageTrace::Process, &trace, i, nThreads));
+            threads.join_all();
+        }
+    }
+}
+
+static void MessageHandlerOneThread(benchmark::State& state)
+{
+    ReplayTrace(state, 1);
+}
+
+static void MessageHandlerFourThreads(benchmark::State& state)
+{
+    ReplayTrace(state, 4);
+}
+
+BENCHMARK(MessageHandlerOneThread);
+BENCHMARK(MessageHandlerFourThreads);
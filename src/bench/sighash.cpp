@@ -0,0 +1,62 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "arith_uint256.h"
+#include "script/interpreter.h"
+#include "script/script.h"
+
+namespace
+{
+    // Signature hashes of all inputs of a sweep of pay-to-pubkey-hash coins,
+    // the way a block with such a transaction has them computed
+    struct Sweep
+    {
+        CTransaction tx;
+        CScript scriptCode;
+
+        Sweep(int nInputs)
+        {
+            scriptCode = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+            CMutableTransaction txSweep;
+            txSweep.vin.resize(nInputs);
+            for (int i = 0; i < nInputs; i++) {
+                txSweep.vin[i].prevout = COutPoint(ArithToUint256(i + 1), i % 4);
+                txSweep.vin[i].scriptSig = CScript() << std::vector<unsigned char>(72, 2) << std::vector<unsigned char>(33, 3);
+            }
+            txSweep.vout.resize(2);
+            txSweep.vout[0].scriptPubKey = scriptCode;
+            txSweep.vout[1].scriptPubKey = scriptCode;
+            tx = txSweep;
+        }
+    };
+
+    void HashInputs(benchmark::State& state, bool fPrecompute)
+    {
+        static Sweep sweep(1000);
+
+        while (state.KeepRunning()) {
+            PrecomputedTransactionData txdata;
+            if (fPrecompute)
+                txdata.Init(sweep.tx);
+            for (unsigned int i = 0; i < sweep.tx.vin.size(); i++)
+                SignatureHash(sweep.scriptCode, sweep.tx, i, SIGHASH_ALL, &txdata);
+        }
+    }
+}
+
+static void SignatureHash1000Inputs(benchmark::State& state)
+{
+    HashInputs(state, false);
+}
+
+static void SignatureHash1000InputsPrecomputed(benchmark::State& state)
+{
+    HashInputs(state, true);
+}
+
+BENCHMARK(SignatureHash1000Inputs);
+BENCHMARK(SignatureHash1000InputsPrecomputed);
@@ -0,0 +1,272 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "version.h"
+
+#include <algorithm>
+#include <ios>
+#include <limits>
+
+#include <boost/foreach.hpp>
+
+namespace
+{
+    /** Writes bit strings most significant bit first */
+    class CBitWriter
+    {
+    private:
+        std::vector<unsigned char>& vch;
+        unsigned char nBuffer;
+        int nBits;
+
+    public:
+        CBitWriter(std::vector<unsigned char>& vchIn) : vch(vchIn), nBuffer(0), nBits(0) {}
+
+        void Write(uint64_t nData, int nCount)
+        {
+            while (nCount > 0) {
+                int n = std::min(8 - nBits, nCount);
+                nBuffer |= ((nData >> (nCount - n)) & ((1U << n) - 1)) << (8 - nBits - n);
+                nBits += n;
+                nCount -= n;
+                if (nBits == 8)
+                    Flush();
+            }
+        }
+
+        void Flush()
+        {
+            if (nBits == 0)
+                return;
+            vch.push_back(nBuffer);
+            nBuffer = 0;
+            nBits = 0;
+        }
+    };
+
+    class CBitReader
+    {
+    private:
+        const unsigned char* pcur;
+        const unsigned char* pend;
+        unsigned char nBuffer;
+        int nBits;
+
+    public:
+        CBitReader(const unsigned char* pbegin, const unsigned char* pendIn) : pcur(pbegin), pend(pendIn), nBuffer(0), nBits(0) {}
+
+        uint64_t Read(int nCount)
+        {
+            uint64_t nData = 0;
+            while (nCount > 0) {
+                if (nBits == 0) {
+                    if (pcur == pend)
+                        throw std::ios_base::failure("CBitReader::Read() : end of data");
+                    nBuffer = *pcur++;
+                    nBits = 8;
+                }
+                int n = std::min(nBits, nCount);
+                nData = (nData << n) | ((nBuffer >> (nBits - n)) & ((1U << n) - 1));
+                nBits -= n;
+                nCount -= n;
+            }
+            return nData;
+        }
+    };
+
+    void GolombRiceEncode(CBitWriter& writer, int nP, uint64_t x)
+    {
+        // quotient in unary, terminated by a zero bit
+        uint64_t q = x >> nP;
+        while (q > 0) {
+            int n = (int)std::min(q, (uint64_t)64);
+            writer.Write(~(uint64_t)0, n);
+            q -= n;
+        }
+        writer.Write(0, 1);
+        writer.Write(x, nP);
+    }
+
+    uint64_t GolombRiceDecode(CBitReader& reader, int nP)
+    {
+        uint64_t q = 0;
+        while (reader.Read(1) == 1)
+            ++q;
+        return (q << nP) + reader.Read(nP);
+    }
+
+    /** (x * n) >> 64, maps a uniform 64-bit hash into [0, n) without a division */
+    uint64_t MapIntoRange(uint64_t x, uint64_t n)
+    {
+        uint64_t x_hi = x >> 32;
+        uint64_t x_lo = x & 0xFFFFFFFF;
+        uint64_t n_hi = n >> 32;
+        uint64_t n_lo = n & 0xFFFFFFFF;
+
+        uint64_t ac = x_hi * n_hi;
+        uint64_t ad = x_hi * n_lo;
+        uint64_t bc = x_lo * n_hi;
+        uint64_t bd = x_lo * n_lo;
+
+        uint64_t mid34 = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+        return ac + (bc >> 32) + (ad >> 32) + (mid34 >> 32);
+    }
+}
+
+CGolombCodedSet::CGolombCodedSet(uint64_t nSipHashK0In, uint64_t nSipHashK1In)
+    : nSipHashK0(nSipHashK0In)
+    , nSipHashK1(nSipHashK1In)
+    , nElements(0)
+{
+    vchEncoded.push_back(0);
+}
+
+CGolombCodedSet::CGolombCodedSet(uint64_t nSipHashK0In, uint64_t nSipHashK1In, const ElementSet& elements)
+    : nSipHashK0(nSipHashK0In)
+    , nSipHashK1(nSipHashK1In)
+    , nElements(elements.size())
+{
+    std::vector<uint64_t> vHashes;
+    vHashes.reserve(elements.size());
+    BOOST_FOREACH(const Element& element, elements)
+        vHashes.push_back(HashToRange(element));
+    std::sort(vHashes.begin(), vHashes.end());
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ss, nElements);
+    vchEncoded.assign(ss.begin(), ss.end());
+
+    CBitWriter writer(vchEncoded);
+    uint64_t nLast = 0;
+    BOOST_FOREACH(uint64_t nHash, vHashes) {
+        GolombRiceEncode(writer, P, nHash - nLast);
+        nLast = nHash;
+    }
+    writer.Flush();
+}
+
+CGolombCodedSet::CGolombCodedSet(uint64_t nSipHashK0In, uint64_t nSipHashK1In, const std::vector<unsigned char>& vchEncodedIn)
+    : nSipHashK0(nSipHashK0In)
+    , nSipHashK1(nSipHashK1In)
+    , vchEncoded(vchEncodedIn)
+{
+    CDataStream ss(vchEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    uint64_t n = ReadCompactSize(ss);
+    if (n > std::numeric_limits<uint32_t>::max())
+        throw std::ios_base::failure("CGolombCodedSet() : too many elements");
+    nElements = n;
+
+    // every element takes at least P + 1 bits
+    if ((ss.size() * 8) / (P + 1) < nElements)
+        throw std::ios_base::failure("CGolombCodedSet() : encoding too short");
+}
+
+uint64_t CGolombCodedSet::HashToRange(const Element& element) const
+{
+    uint64_t nHash = CSipHasher(nSipHashK0, nSipHashK1).Write(element.empty() ? NULL : &element[0], element.size()).Finalize();
+    return MapIntoRange(nHash, (uint64_t)nElements * M);
+}
+
+bool CGolombCodedSet::MatchSorted(const std::vector<uint64_t>& vQuery) const
+{
+    if (nElements == 0 || vQuery.empty())
+        return false;
+
+    size_t nHeader = GetSizeOfCompactSize(nElements);
+    CBitReader reader(&vchEncoded[0] + nHeader, &vchEncoded[0] + vchEncoded.size());
+
+    // walk both sorted lists at once
+    std::vector<uint64_t>::const_iterator it = vQuery.begin();
+    uint64_t nValue = 0;
+    for (uint32_t i = 0; i < nElements; i++) {
+        nValue += GolombRiceDecode(reader, P);
+        while (*it < nValue) {
+            if (++it == vQuery.end())
+                return false;
+        }
+        if (*it == nValue)
+            return true;
+    }
+    return false;
+}
+
+bool CGolombCodedSet::Match(const Element& element) const
+{
+    if (nElements == 0)
+        return false;
+    return MatchSorted(std::vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool CGolombCodedSet::MatchAny(const ElementSet& elements) const
+{
+    if (nElements == 0)
+        return false;
+
+    std::vector<uint64_t> vQuery;
+    vQuery.reserve(elements.size());
+    BOOST_FOREACH(const Element& element, elements)
+        vQuery.push_back(HashToRange(element));
+    std::sort(vQuery.begin(), vQuery.end());
+    return MatchSorted(vQuery);
+}
+
+uint64_t CBlockFilter::SipHashK0(const uint256& hash)
+{
+    return ReadLE64(hash.begin());
+}
+
+uint64_t CBlockFilter::SipHashK1(const uint256& hash)
+{
+    return ReadLE64(hash.begin() + 8);
+}
+
+CBlockFilter::CBlockFilter(const CBlock& block)
+    : hashBlock(block.GetHash())
+{
+    CGolombCodedSet::ElementSet elements;
+    BOOST_FOREACH(const CTransactionRef& ptx, block.vtx)
+    {
+        const CTransaction& tx = *ptx;
+        BOOST_FOREACH(const CTxOut& txout, tx.vout)
+        {
+            const CScript& script = txout.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN)
+                continue;
+            elements.insert(ScriptElement(script));
+        }
+
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            elements.insert(OutPointElement(txin.prevout));
+    }
+
+    filter = CGolombCodedSet(SipHashK0(hashBlock), SipHashK1(hashBlock), elements);
+}
+
+CBlockFilter::CBlockFilter(const uint256& hashBlockIn, const std::vector<unsigned char>& vchEncoded)
+    : hashBlock(hashBlockIn)
+    , filter(SipHashK0(hashBlockIn), SipHashK1(hashBlockIn), vchEncoded)
+{
+}
+
+CGolombCodedSet::Element CBlockFilter::ScriptElement(const CScript& script)
+{
+    return CGolombCodedSet::Element(script.begin(), script.end());
+}
+
+CGolombCodedSet::Element CBlockFilter::OutPointElement(const COutPoint& outpoint)
+{
+    CGolombCodedSet::Element element(outpoint.hash.begin(), outpoint.hash.end());
+    element.resize(element.size() + 4);
+    WriteLE32(&element[element.size() - 4], outpoint.n);
+    return element;
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWN_BLOCKFILTER_H
+#define CROWN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+class COutPoint;
+class CScript;
+
+//! -blockfilterindex default
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+
+/**
+ * Golomb-coded set, a compact probabilistic set of hashed elements (BIP 158).
+ * Every element is hashed with SipHash into the range [0, N * M), the sorted
+ * hashes are stored as Golomb-Rice coded differences. A query for an element
+ * that was not added matches with a probability of about 1/M. Queries throw
+ * std::ios_base::failure when the encoding turns out to be truncated.
+ */
+class CGolombCodedSet
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    //! Golomb-Rice parameter, bits of each difference written in binary
+    static const int P = 19;
+    //! Inverse false positive rate
+    static const uint64_t M = 784931;
+
+private:
+    uint64_t nSipHashK0;
+    uint64_t nSipHashK1;
+    uint32_t nElements;
+    //! number of elements followed by the coded differences
+    std::vector<unsigned char> vchEncoded;
+
+    uint64_t HashToRange(const Element& element) const;
+    bool MatchSorted(const std::vector<uint64_t>& vQuery) const;
+
+public:
+    CGolombCodedSet(uint64_t nSipHashK0In = 0, uint64_t nSipHashK1In = 0);
+    CGolombCodedSet(uint64_t nSipHashK0In, uint64_t nSipHashK1In, const ElementSet& elements);
+    /** Decode a set from its encoding, throws std::ios_base::failure if it is malformed */
+    CGolombCodedSet(uint64_t nSipHashK0In, uint64_t nSipHashK1In, const std::vector<unsigned char>& vchEncodedIn);
+
+    uint32_t GetN() const { return nElements; }
+    const std::vector<unsigned char>& GetEncoded() const { return vchEncoded; }
+
+    /** Whether the element may be in the set, never false for an element that was added */
+    bool Match(const Element& element) const;
+    /** Whether any of the elements may be in the set, cheaper than testing them one by one */
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+/**
+ * Compact filter of a block, the set of its output scripts and of the
+ * outpoints its transactions spend. Keyed by the block hash, so the filter of
+ * a block is the same on every chain it is part of.
+ */
+class CBlockFilter
+{
+private:
+    uint256 hashBlock;
+    CGolombCodedSet filter;
+
+    static uint64_t SipHashK0(const uint256& hash);
+    static uint64_t SipHashK1(const uint256& hash);
+
+public:
+    CBlockFilter() {}
+    explicit CBlockFilter(const CBlock& block);
+    /** Decode the filter of a block, throws std::ios_base::failure if it is malformed */
+    CBlockFilter(const uint256& hashBlockIn, const std::vector<unsigned char>& vchEncoded);
+
+    const uint256& GetBlockHash() const { return hashBlock; }
+    const CGolombCodedSet& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncoded() const { return filter.GetEncoded(); }
+
+    bool Match(const CGolombCodedSet::Element& element) const { return filter.Match(element); }
+    bool MatchAny(const CGolombCodedSet::ElementSet& elements) const { return filter.MatchAny(elements); }
+
+    /** Filter elements of an output script and of a spent outpoint */
+    static CGolombCodedSet::Element ScriptElement(const CScript& script);
+    static CGolombCodedSet::Element OutPointElement(const COutPoint& outpoint);
+};
+
+#endif // CROWN_BLOCKFILTER_H
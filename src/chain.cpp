@@ -15,15 +15,6 @@ CBlockHeader CBlockIndex::GetBlockHeader() const
 {
     CBlockHeader block;
 
-    /* The CBlockIndex object's block header is missing the auxpow.
-       So if this is an auxpow block, read it from disk instead.  We only
-       have to read the actual *header*, not the full block.  */
-    if (nVersion.IsAuxpow())
-    {
-        ReadBlockHeaderFromDisk(block, this);
-        return block;
-    }
-
     block.nVersion       = nVersion;
     if (pprev)
         block.hashPrevBlock = pprev->GetBlockHash();
@@ -31,6 +22,13 @@ CBlockHeader CBlockIndex::GetBlockHeader() const
     block.nTime          = nTime;
     block.nBits          = nBits;
     block.nNonce         = nNonce;
+
+    /* The CBlockIndex object's block header is missing the auxpow.
+       So if this is an auxpow block, take it from the auxpow cache, which
+       only goes to disk for headers it doesn't hold.  */
+    if (nVersion.IsAuxpow())
+        block.auxpow = GetBlockAuxPow(this);
+
     return block;
 }
 
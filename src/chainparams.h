@@ -77,6 +77,8 @@ public:
     const std::vector<unsigned char>& Base58Prefix(Base58Type type) const { return base58Prefixes[type]; }
     const std::vector<CAddress>& FixedSeeds() const { return vFixedSeeds; }
     virtual const Checkpoints::CCheckpointData& Checkpoints() const = 0;
+    /** Block whose ancestors are assumed to have valid scripts, -assumevalid default */
+    const uint256& DefaultAssumeValid() const { return defaultAssumeValid; }
     int PoolMaxTransactions() const { return nPoolMaxTransactions; }
     std::string SporkKey() const { return strSporkKey; }
     std::string LegacySignerDummyAddress() const { return strLegacySignerDummyAddress; }
@@ -127,6 +129,7 @@ protected:
     std::string strLegacySignerDummyAddress;
     std::string strDevfundAddress;
     int64_t nStartMasternodePayments;
+    uint256 defaultAssumeValid;
 };
 
 /** 
@@ -142,19 +142,29 @@ public:
         return Loop(true);
     }
 
-    //! Add a batch of checks to the queue
+    //! Add a batch of checks to the queue, the checks are swapped out of vChecks
     void Add(std::vector<T>& vChecks)
     {
         boost::unique_lock<boost::mutex> lock(mutex);
+        queue.reserve(queue.size() + vChecks.size());
         BOOST_FOREACH (T& check, vChecks) {
             queue.push_back(T());
             check.swap(queue.back());
         }
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
+        // Only wake as many idle workers as there are new checks, waking all
+        // of them for every transaction makes most go back to sleep at once.
+        unsigned int nWake = std::min((unsigned int)vChecks.size(), (unsigned int)nIdle);
+        for (unsigned int i = 0; i < nWake; i++)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+    }
+
+    //! Make the worker threads return once all queued checks are done
+    void Quit()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fQuit = true;
+        condWorker.notify_all();
     }
 
     ~CCheckQueue()
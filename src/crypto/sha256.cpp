@@ -8,6 +8,36 @@
 
 #include <string.h>
 
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#if (defined(ENABLE_SSE41) || defined(ENABLE_AVX2) || defined(ENABLE_SHANI)) && !defined(BUILD_BITCOIN_INTERNAL)
+// the SIMD code lives in separate libraries built with the matching compiler
+// flags, libbitcoinconsensus sticks to the portable code
+#define USE_SHA256_DISPATCH 1
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(USE_SHA256_DISPATCH) && defined(ENABLE_SSE41)
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#if defined(USE_SHA256_DISPATCH) && defined(ENABLE_AVX2)
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#if defined(USE_SHA256_DISPATCH) && defined(ENABLE_SHANI)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+#endif
+
 // Internal implementation code.
 namespace
 {
@@ -127,9 +157,133 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--) {
+        Transform(s, chunk);
+        chunk += 64;
+    }
+}
+
 } // namespace sha256
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+/** Double SHA-256 of one 64-byte input with the given transformation. */
+void TransformD64Using(TransformType tr, unsigned char* out, const unsigned char* in)
+{
+    // padding of a 64-byte message
+    static const unsigned char padding1[64] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0};
+    // the first hash, followed by the padding of a 32-byte message
+    unsigned char buffer2[64] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0};
+
+    uint32_t s[8];
+    sha256::Initialize(s);
+    tr(s, in, 1);
+    tr(s, padding1, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buffer2 + 4 * i, s[i]);
+
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
+void TransformD64Standard(unsigned char* out, const unsigned char* in)
+{
+    TransformD64Using(sha256::Transform, out, in);
+}
+
+#if defined(USE_SHA256_DISPATCH) && defined(ENABLE_SHANI)
+void TransformD64SHANI(unsigned char* out, const unsigned char* in)
+{
+    TransformD64Using(sha256_shani::Transform, out, in);
+}
+#endif
+
+// Implementations in use, set by SHA256AutoDetect()
+TransformType Transform = sha256::Transform;
+TransformD64Type TransformD64 = TransformD64Standard;
+TransformD64Type TransformD64_4way = NULL;
+TransformD64Type TransformD64_8way = NULL;
+
+#if defined(USE_SHA256_DISPATCH)
+/** Whether the OS saves the AVX registers on context switches. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
 } // namespace
 
+std::string SHA256AutoDetect(int nUse)
+{
+    std::string strRet = "standard";
+    Transform = sha256::Transform;
+    TransformD64 = TransformD64Standard;
+    TransformD64_4way = NULL;
+    TransformD64_8way = NULL;
+
+#if defined(USE_SHA256_DISPATCH)
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t nMaxLeaf = __get_cpuid_max(0, NULL);
+    if (nMaxLeaf < 1)
+        return strRet;
+    __cpuid_count(1, 0, eax, ebx, ecx, edx);
+    bool fHaveSSE41 = (ecx >> 19) & 1;
+    // xsave and avx, and the OS has to keep the registers
+    bool fHaveAVX = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    bool fHaveAVX2 = false;
+    bool fHaveSHANI = false;
+    if (nMaxLeaf >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        fHaveAVX2 = fHaveAVX && ((ebx >> 5) & 1);
+        fHaveSHANI = fHaveSSE41 && ((ebx >> 29) & 1);
+    }
+
+    // The SHA extensions hash a single stream faster than the 4-way SSE4.1
+    // code hashes four, they replace it. AVX2 still keeps up with them.
+    bool fUseSHANI = false;
+#if defined(ENABLE_SHANI)
+    if (fHaveSHANI && (nUse & SHA256_USE_SHANI)) {
+        Transform = sha256_shani::Transform;
+        TransformD64 = TransformD64SHANI;
+        strRet = "shani(1way)";
+        fUseSHANI = true;
+    }
+#endif
+#if defined(ENABLE_SSE41)
+    if (fHaveSSE41 && !fUseSHANI && (nUse & SHA256_USE_SSE41)) {
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        strRet += ",sse41(4way)";
+    }
+#endif
+#if defined(ENABLE_AVX2)
+    if (fHaveAVX2 && (nUse & SHA256_USE_AVX2)) {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        strRet += ",avx2(8way)";
+    }
+#endif
+#else
+    (void)nUse;
+#endif
+
+    return strRet;
+}
+
 
 ////// SHA-256
 
@@ -147,14 +301,15 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        Transform(s, buf, 1);
         bufsize = 0;
     }
-    while (end >= data + 64) {
+    if (end - data >= 64) {
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
-        bytes += 64;
-        data += 64;
+        size_t blocks = (end - data) / 64;
+        Transform(s, data, blocks);
+        data += 64 * blocks;
+        bytes += 64 * blocks;
     }
     if (end > data) {
         // Fill the buffer with what remains.
@@ -187,3 +342,29 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,26 @@ public:
     CSHA256& Reset();
 };
 
+/** Implementations SHA256AutoDetect() may choose from when the CPU supports them */
+enum SHA256Implementation
+{
+    SHA256_STANDARD = 0,
+    SHA256_USE_SSE41 = (1 << 0),
+    SHA256_USE_AVX2 = (1 << 1),
+    SHA256_USE_SHANI = (1 << 2),
+    SHA256_USE_ALL = SHA256_USE_SSE41 | SHA256_USE_AVX2 | SHA256_USE_SHANI
+};
+
+/**
+ * Pick the fastest SHA-256 implementation the CPU supports and return its
+ * name. Not thread safe, call it before any hashing starts.
+ */
+std::string SHA256AutoDetect(int nUse = SHA256_USE_ALL);
+
+/**
+ * Double SHA-256 of blocks 64-byte inputs at once, writing blocks 32-byte
+ * hashes. Several inputs are hashed in parallel when SIMD is available.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,202 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+
+#include "crypto/common.h"
+
+#include <algorithm>
+#include <new>
+#include <string.h>
+
+CCuckooCache::CCuckooCache(size_t nBytes)
+    : pBuckets(NULL)
+    , nBuckets(0)
+    , nGenerationSize(0)
+    , nGenerationCheck(0)
+    , nDepthLimit(0)
+{
+    Setup(nBytes);
+}
+
+uint32_t CCuckooCache::Setup(size_t nBytes)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+
+    uint64_t nCount = nBytes / sizeof(Bucket);
+    nBuckets = (uint32_t)std::min(nCount, (uint64_t)(0xFFFFFFFF / SLOTS_PER_BUCKET));
+    pMemory.reset(nBuckets ? new unsigned char[nBuckets * sizeof(Bucket) + CACHE_LINE_SIZE - 1] : NULL);
+    pBuckets = NULL;
+    if (nBuckets) {
+        size_t nOffset = (CACHE_LINE_SIZE - ((size_t)pMemory.get() % CACHE_LINE_SIZE)) % CACHE_LINE_SIZE;
+        pBuckets = reinterpret_cast<Bucket*>(pMemory.get() + nOffset);
+    }
+    for (uint32_t i = 0; i < nBuckets; i++) {
+        new (&pBuckets[i]) Bucket();
+        for (unsigned int j = 0; j < SLOTS_PER_BUCKET; j++)
+            for (unsigned int k = 0; k < 4; k++)
+                pBuckets[i].vWords[j][k].store(0, boost::memory_order_relaxed);
+    }
+
+    // all slots start out empty, that is collectible
+    uint32_t nSlots = GetSlotCount();
+    pCollectible.reset(nSlots ? new boost::atomic<uint8_t>[(nSlots + 7) / 8] : NULL);
+    for (uint32_t i = 0; i < (nSlots + 7) / 8; i++)
+        pCollectible[i].store(0xFF, boost::memory_order_relaxed);
+
+    vfGeneration.assign(nSlots, false);
+    nGenerationSize = std::max((uint32_t)1, (uint32_t)(45 * (uint64_t)nSlots / 100));
+    nGenerationCheck = nGenerationSize;
+    nDepthLimit = 1;
+    while (nDepthLimit < 32 && ((uint64_t)1 << nDepthLimit) <= nSlots)
+        nDepthLimit++;
+    return nSlots;
+}
+
+void CCuckooCache::GetSlots(const uint256& entry, uint32_t vSlots[SLOTS_PER_ENTRY]) const
+{
+    // (h * nBuckets) >> 32 maps a uniform 32-bit value into [0, nBuckets)
+    uint32_t nBucket0 = ((uint64_t)ReadLE32(entry.begin()) * nBuckets) >> 32;
+    uint32_t nBucket1 = ((uint64_t)ReadLE32(entry.begin() + 4) * nBuckets) >> 32;
+    for (unsigned int j = 0; j < SLOTS_PER_BUCKET; j++) {
+        vSlots[j] = nBucket0 * SLOTS_PER_BUCKET + j;
+        vSlots[SLOTS_PER_BUCKET + j] = nBucket1 * SLOTS_PER_BUCKET + j;
+    }
+}
+
+void CCuckooCache::Load(uint32_t nSlot, uint256& entry) const
+{
+    const boost::atomic<uint64_t>* pWords = pBuckets[nSlot / SLOTS_PER_BUCKET].vWords[nSlot % SLOTS_PER_BUCKET];
+    for (unsigned int k = 0; k < 4; k++) {
+        uint64_t nWord = pWords[k].load(boost::memory_order_relaxed);
+        memcpy(entry.begin() + 8 * k, &nWord, 8);
+    }
+}
+
+void CCuckooCache::Store(uint32_t nSlot, const uint256& entry)
+{
+    boost::atomic<uint64_t>* pWords = pBuckets[nSlot / SLOTS_PER_BUCKET].vWords[nSlot % SLOTS_PER_BUCKET];
+    for (unsigned int k = 0; k < 4; k++) {
+        uint64_t nWord;
+        memcpy(&nWord, entry.begin() + 8 * k, 8);
+        pWords[k].store(nWord, boost::memory_order_relaxed);
+    }
+}
+
+bool CCuckooCache::IsCollectible(uint32_t nSlot) const
+{
+    return (pCollectible[nSlot >> 3].load(boost::memory_order_relaxed) >> (nSlot & 7)) & 1;
+}
+
+void CCuckooCache::SetCollectible(uint32_t nSlot) const
+{
+    pCollectible[nSlot >> 3].fetch_or((uint8_t)(1 << (nSlot & 7)), boost::memory_order_relaxed);
+}
+
+void CCuckooCache::Keep(uint32_t nSlot)
+{
+    pCollectible[nSlot >> 3].fetch_and((uint8_t)~(1 << (nSlot & 7)), boost::memory_order_relaxed);
+}
+
+void CCuckooCache::CheckGeneration()
+{
+    if (nGenerationCheck != 0) {
+        nGenerationCheck--;
+        return;
+    }
+
+    // entries of the current generation that were not erased yet
+    uint32_t nSlots = GetSlotCount();
+    uint32_t nUsed = 0;
+    for (uint32_t i = 0; i < nSlots; i++)
+        if (vfGeneration[i] && !IsCollectible(i))
+            nUsed++;
+
+    if (nUsed >= nGenerationSize) {
+        // start a new generation, the previous one may be overwritten
+        for (uint32_t i = 0; i < nSlots; i++) {
+            if (vfGeneration[i])
+                vfGeneration[i] = false;
+            else
+                SetCollectible(i);
+        }
+        nGenerationCheck = nGenerationSize;
+    } else {
+        // the earliest point at which the generation can be full, but don't
+        // scan the table too often when most entries get erased
+        nGenerationCheck = std::max((uint32_t)1, std::max(nGenerationSize / 16, nGenerationSize - nUsed));
+    }
+}
+
+bool CCuckooCache::Contains(const uint256& entry, bool fErase) const
+{
+    // empty slots are zero
+    if (nBuckets == 0 || entry.IsNull())
+        return false;
+
+    uint32_t vSlots[SLOTS_PER_ENTRY];
+    GetSlots(entry, vSlots);
+    uint256 slotEntry;
+    for (unsigned int i = 0; i < SLOTS_PER_ENTRY; i++) {
+        Load(vSlots[i], slotEntry);
+        if (slotEntry == entry) {
+            if (fErase)
+                SetCollectible(vSlots[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+void CCuckooCache::Insert(const uint256& entryIn)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (nBuckets == 0 || entryIn.IsNull())
+        return;
+
+    CheckGeneration();
+
+    uint32_t vSlots[SLOTS_PER_ENTRY];
+    GetSlots(entryIn, vSlots);
+    uint256 slotEntry;
+    for (unsigned int i = 0; i < SLOTS_PER_ENTRY; i++) {
+        Load(vSlots[i], slotEntry);
+        if (slotEntry == entryIn) {
+            Keep(vSlots[i]);
+            vfGeneration[vSlots[i]] = true;
+            return;
+        }
+    }
+
+    uint256 entry = entryIn;
+    bool fGeneration = true;
+    unsigned int nEvict = SLOTS_PER_ENTRY - 1;
+    for (unsigned int nDepth = 0; nDepth < nDepthLimit; nDepth++) {
+        for (unsigned int i = 0; i < SLOTS_PER_ENTRY; i++) {
+            if (!IsCollectible(vSlots[i]))
+                continue;
+            Store(vSlots[i], entry);
+            Keep(vSlots[i]);
+            vfGeneration[vSlots[i]] = fGeneration;
+            return;
+        }
+
+        // Every slot is taken, swap with one of them and move the entry that
+        // was there to one of its other slots. Going round the slots makes
+        // sure the entry just placed is not the one pushed out again.
+        nEvict = (nEvict + 1) % SLOTS_PER_ENTRY;
+        uint32_t nSlot = vSlots[nEvict];
+        Load(nSlot, slotEntry);
+        Store(nSlot, entry);
+        entry = slotEntry;
+        bool fSlotGeneration = vfGeneration[nSlot];
+        vfGeneration[nSlot] = fGeneration;
+        fGeneration = fSlotGeneration;
+        GetSlots(entry, vSlots);
+        for (unsigned int i = 0; i < SLOTS_PER_ENTRY; i++)
+            if (vSlots[i] == nSlot)
+                nEvict = i;
+    }
+    // the entry pushed out last is dropped
+}
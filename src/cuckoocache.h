@@ -0,0 +1,91 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWN_CUCKOOCACHE_H
+#define CROWN_CUCKOOCACHE_H
+
+#include "uint256.h"
+
+#include <stdint.h>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * Fixed size set of 256-bit entries for caching positive results, e.g. valid
+ * signatures. Entries must be uniformly random (salted hashes), the slots of an
+ * entry are taken from its first bytes.
+ *
+ * Every entry can live in one of two buckets, a bucket is one cache line of
+ * two slots. Lookups take no lock: slots are read word by word with atomic
+ * loads, so a lookup racing with an insert may miss an entry, but it can not
+ * match an entry that was never inserted. Inserts are serialized by a mutex
+ * and move entries between their buckets cuckoo style.
+ *
+ * Nothing is freed on erase, a lookup can only flag the slot as collectible.
+ * Entries are also aged in generations: once the entries of the current
+ * generation fill about 45% of the table a new generation starts, and the
+ * entries of the previous one become collectible. Inserts overwrite
+ * collectible slots first, so the cache keeps the newest entries without ever
+ * scanning for the oldest one.
+ */
+class CCuckooCache
+{
+public:
+    static const size_t CACHE_LINE_SIZE = 64;
+    static const unsigned int SLOTS_PER_BUCKET = 2;
+    static const unsigned int SLOTS_PER_ENTRY = 2 * SLOTS_PER_BUCKET;
+
+private:
+    struct Bucket
+    {
+        boost::atomic<uint64_t> vWords[SLOTS_PER_BUCKET][4];
+    };
+
+    boost::scoped_array<unsigned char> pMemory;
+    //! nBuckets cache line aligned buckets inside pMemory
+    Bucket* pBuckets;
+    uint32_t nBuckets;
+    //! one bit per slot, set when the slot may be overwritten
+    boost::scoped_array<boost::atomic<uint8_t> > pCollectible;
+
+    //! serializes inserts, protects everything below
+    boost::mutex cs;
+    //! whether the entry of a slot was stored in the current generation
+    std::vector<bool> vfGeneration;
+    uint32_t nGenerationSize;
+    //! inserts left until the size of the current generation is checked again
+    uint32_t nGenerationCheck;
+    //! maximum number of entries moved by one insert
+    unsigned int nDepthLimit;
+
+    uint32_t GetSlotCount() const { return nBuckets * SLOTS_PER_BUCKET; }
+    void GetSlots(const uint256& entry, uint32_t vSlots[SLOTS_PER_ENTRY]) const;
+    void Load(uint32_t nSlot, uint256& entry) const;
+    void Store(uint32_t nSlot, const uint256& entry);
+    bool IsCollectible(uint32_t nSlot) const;
+    void SetCollectible(uint32_t nSlot) const;
+    void Keep(uint32_t nSlot);
+    void CheckGeneration();
+
+public:
+    explicit CCuckooCache(size_t nBytes = 0);
+
+    /**
+     * Drop all entries and resize the table to about nBytes of memory.
+     * Returns the number of slots. Must not run concurrently with any
+     * other member function.
+     */
+    uint32_t Setup(size_t nBytes);
+
+    /** Whether the entry is cached, optionally flagging it as collectible */
+    bool Contains(const uint256& entry, bool fErase) const;
+
+    /** Add an entry, this may push out other entries */
+    void Insert(const uint256& entry);
+};
+
+#endif // CROWN_CUCKOOCACHE_H
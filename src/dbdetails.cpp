@@ -3,9 +3,36 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "dbdetails.h"
+#include "sync.h"
 
 namespace details
 {
+    namespace
+    {
+        // state hash and size of the data we last read from or wrote to each file
+        CCriticalSection cs_mapFileState;
+        std::map<std::string, std::pair<uint256, uintmax_t> > mapFileState;
+    }
+
+    void SetFileState(const std::string& filename, const uint256& hashState, uintmax_t size)
+    {
+        LOCK(cs_mapFileState);
+        mapFileState[filename] = std::make_pair(hashState, size);
+    }
+
+    bool IsFileUnchanged(const std::string& filename, const uint256& hashState)
+    {
+        LOCK(cs_mapFileState);
+        std::map<std::string, std::pair<uint256, uintmax_t> >::const_iterator it = mapFileState.find(filename);
+        if (it == mapFileState.end() || it->second.first != hashState)
+            return false;
+
+        // the file might have been removed or replaced behind our back
+        boost::system::error_code ec;
+        uintmax_t size = boost::filesystem::file_size(GetDataDir() / filename, ec);
+        return !ec && size == it->second.second;
+    }
+
     ReadResult ReadStream(CDataStream& stream, const std::string& filename)
     {
         boost::filesystem::path pathDb = GetDataDir() / filename;
@@ -49,4 +76,68 @@ namespace details
         }
         return Ok;
     }
+
+    ReadResult ReadHeader(const std::string& filename, const std::string& magicMessage)
+    {
+        boost::filesystem::path pathDb = GetDataDir() / filename;
+        FILE *file = fopen(pathDb.string().c_str(), "rb");
+        CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return FileError;
+
+        unsigned char pchMsgTmp[4];
+        std::string strMagicMessageTmp;
+        try
+        {
+            filein >> strMagicMessageTmp;
+            filein >> FLATDATA(pchMsgTmp);
+        }
+        catch (const std::exception &e)
+        {
+            error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            return HashReadError;
+        }
+
+        if (magicMessage != strMagicMessageTmp)
+        {
+            error("%s: Invalid magic message", __func__);
+            return IncorrectMagicMessage;
+        }
+
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+        {
+            error("%s: Invalid network magic number", __func__);
+            return IncorrectMagicNumber;
+        }
+        return Ok;
+    }
+
+    bool WriteStream(const CDataStream& stream, const uint256& hash, const std::string& filename)
+    {
+        // write to a temporary file first, so that a crash while writing leaves the old file intact
+        boost::filesystem::path pathDb = GetDataDir() / filename;
+        boost::filesystem::path pathTmp = GetDataDir() / (filename + ".new");
+        FILE *file = fopen(pathTmp.string().c_str(), "wb");
+        CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+        if (fileout.IsNull())
+            return error("%s: Failed to open file %s", __func__, pathTmp.string());
+
+        // Write and commit header, data
+        try
+        {
+            fileout << stream;
+            fileout << hash;
+        }
+        catch (const std::exception &e)
+        {
+            return error("%s: Serialize or I/O error - %s", __func__, e.what());
+        }
+
+        FileCommit(fileout.Get());
+        fileout.fclose();
+
+        if (!RenameOver(pathTmp, pathDb))
+            return error("%s: Rename-into-place failed", __func__);
+        return true;
+    }
 }
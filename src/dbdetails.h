@@ -27,6 +27,27 @@ namespace details
 
     ReadResult ReadStream(CDataStream& stream, const std::string& filename);
 
+    /// Check only the magic message and network magic number at the start of the file
+    ReadResult ReadHeader(const std::string& filename, const std::string& magicMessage);
+
+    /// Write data followed by its checksum to a temporary file and move it over the old one
+    bool WriteStream(const CDataStream& stream, const uint256& hash, const std::string& filename);
+
+    /// Remember the state hash and size of the data last read from or written to filename
+    void SetFileState(const std::string& filename, const uint256& hashState, uintmax_t size);
+
+    /// Whether filename still holds the data with hashState we last read or wrote
+    bool IsFileUnchanged(const std::string& filename, const uint256& hashState);
+
+    /// Hash of the state of obj that has to be saved. Caches that change all
+    /// the time are left out with SER_GETHASH, so they alone don't make a
+    /// file be rewritten. It's streamed into the hasher, nothing is buffered.
+    template <typename T>
+    uint256 GetStateHash(const T& obj)
+    {
+        return SerializeHash(obj, SER_GETHASH, CLIENT_VERSION);
+    }
+
     template <typename T>
     ReadResult DeserializeStream(CDataStream& stream, const std::string& magicMessage, T& objToLoad)
     {
@@ -64,11 +85,13 @@ namespace details
         ReadResult result = ReadStream(ssObj, filename);
         if (result != Ok)
             return result;
+        uintmax_t nFileSize = ssObj.size() + sizeof(uint256);
         try
         {
             result = DeserializeStream(ssObj, magicMessage, objToLoad);
             if (result != Ok)
                 return result;
+            SetFileState(filename, GetStateHash(objToLoad), nFileSize);
         }
         catch (const std::exception &e)
         {
@@ -95,32 +118,25 @@ namespace details
     {
         int64_t nStart = GetTimeMillis();
 
+        // only serialize the whole object when its state changed since the
+        // file was last read or written
+        uint256 hashState = GetStateHash(objToSave);
+        if (IsFileUnchanged(filename, hashState))
+        {
+            LogPrintf("%s didn't change, skipped writing  %dms\n", filename, GetTimeMillis() - nStart);
+            return true;
+        }
+
         // serialize, checksum data up to that point, then append checksum
         CDataStream ssObj(SER_DISK, CLIENT_VERSION);
         ssObj << magicMessage; // specific magic message for this type of object
         ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
         ssObj << objToSave;
         uint256 hash = Hash(ssObj.begin(), ssObj.end());
-        ssObj << hash;
-
-        // open output file, and associate with CAutoFile
-        boost::filesystem::path pathDb = GetDataDir() / filename;
-        FILE *file = fopen(pathDb.string().c_str(), "wb");
-        CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-        if (fileout.IsNull())
-            return error("%s: Failed to open file %s", __func__, pathDb.string());
-
-        // Write and commit header, data
-        try
-        {
-            fileout << ssObj;
-        }
-        catch (const std::exception &e)
-        {
-            return error("%s: Serialize or I/O error - %s", __func__, e.what());
-        }
 
-        fileout.fclose();
+        if (!WriteStream(ssObj, hash, filename))
+            return false;
+        SetFileState(filename, hashState, ssObj.size() + sizeof(uint256));
 
         LogPrintf("Written info to %s  %dms\n", filename, GetTimeMillis() - nStart);
         LogPrintf("     %s\n", objToSave.ToString());
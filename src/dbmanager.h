@@ -37,10 +37,15 @@ bool Dump(const T& objToSave, const std::string& filename, const std::string& ma
 {
     int64_t nStart = GetTimeMillis();
 
+    // the content is replaced anyway, so only make sure we don't overwrite a file of another kind
     LogPrintf("Verifying %s format...\n", filename);
-    T tmpObjToLoad;
-    if (!Load(tmpObjToLoad, filename, magicMessage, true))
+    ::details::ReadResult readResult = ::details::ReadHeader(filename, magicMessage);
+    if (readResult != ::details::Ok && readResult != ::details::FileError)
+    {
+        LogPrintf("Error reading %s: ", filename);
+        LogPrintf("%s: File format is unknown or invalid, please fix it manually\n", __func__);
         return false;
+    }
 
     LogPrintf("Writing info to %s...\n", filename);
     ::details::Write(objToSave, filename, magicMessage);
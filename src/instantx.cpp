@@ -36,8 +36,9 @@ void InstantSend::ProcessMessage(CNode* pfrom, const std::string& strCommand, CD
     {
         //LogPrintf("ProcessMessageInstantX::ix\n");
         CDataStream vMsg(vRecv);
-        CTransaction tx;
-        vRecv >> tx;
+        CTransactionRef ptx;
+        vRecv >> ptx;
+        const CTransaction& tx = *ptx;
 
         CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
@@ -50,7 +51,7 @@ void InstantSend::ProcessMessage(CNode* pfrom, const std::string& strCommand, CD
             return;
         }
 
-        int nBlockHeight = CreateNewLock(tx);
+        int nBlockHeight = CreateNewLock(ptx);
 
         bool fMissingInputs = false;
         CValidationState state;
@@ -58,7 +59,7 @@ void InstantSend::ProcessMessage(CNode* pfrom, const std::string& strCommand, CD
         bool fAccepted = false;
         {
             LOCK(cs_main);
-            fAccepted = AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs);
+            fAccepted = AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs);
         }
         if (fAccepted)
         {
@@ -66,7 +67,7 @@ void InstantSend::ProcessMessage(CNode* pfrom, const std::string& strCommand, CD
 
             DoConsensusVote(tx, nBlockHeight);
 
-            m_txLockReq.insert(make_pair(tx.GetHash(), tx));
+            m_txLockReq.insert(make_pair(tx.GetHash(), ptx));
 
             IXLogPrintf("ProcessMessageInstantX::ix - Transaction Lock Request: %s %s : accepted %s\n",
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
@@ -76,7 +77,7 @@ void InstantSend::ProcessMessage(CNode* pfrom, const std::string& strCommand, CD
             return;
 
         } else {
-            m_txLockReqRejected.insert(make_pair(tx.GetHash(), tx));
+            m_txLockReqRejected.insert(make_pair(tx.GetHash(), ptx));
 
             // can we get the conflicting transaction as proof?
 
@@ -101,7 +102,7 @@ void InstantSend::ProcessMessage(CNode* pfrom, const std::string& strCommand, CD
 
                         //reprocess the last 15 blocks
                         ReprocessBlocks(15);
-                        m_txLockReq.insert(make_pair(tx.GetHash(), tx));
+                        m_txLockReq.insert(make_pair(tx.GetHash(), ptx));
                     }
                 }
             }
@@ -206,8 +207,9 @@ bool InstantSend::IsIxTxValid(const CTransaction& txCollateral) const
     return true;
 }
 
-int64_t InstantSend::CreateNewLock(const CTransaction& tx)
+int64_t InstantSend::CreateNewLock(const CTransactionRef& ptx)
 {
+    const CTransaction& tx = *ptx;
     int64_t nTxAge = 0;
     BOOST_REVERSE_FOREACH(CTxIn i, tx.vin){
         nTxAge = GetInputAge(i);
@@ -239,7 +241,7 @@ int64_t InstantSend::CreateNewLock(const CTransaction& tx)
         LogPrint("instantx", "CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
     }
 
-    m_txLockReq.insert(make_pair(tx.GetHash(), tx));
+    m_txLockReq.insert(make_pair(tx.GetHash(), ptx));
     return nBlockHeight;
 }
 
@@ -347,7 +349,10 @@ bool InstantSend::ProcessConsensusVote(CNode* pnode, const CConsensusVote& ctx)
             IXLogPrintf("InstantX::ProcessConsensusVote - Transaction Lock Is Complete \n");
             LogPrint("instantx", "InstantX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", (*i).second.GetHash().ToString().c_str());
 
-            CTransaction& tx = m_txLockReq[ctx.txHash];
+            CTransactionRef& ptx = m_txLockReq[ctx.txHash];
+            if (!ptx)
+                ptx = MakeTransactionRef();
+            const CTransaction& tx = *ptx;
             if(!CheckForConflictingLocks(tx)){
 
 #ifdef ENABLE_WALLET
@@ -431,7 +436,7 @@ void InstantSend::CheckAndRemove()
             IXLogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
 
             if(m_txLockReq.count(it->second.txHash)){
-                CTransaction& tx = m_txLockReq[it->second.txHash];
+                const CTransaction& tx = *m_txLockReq[it->second.txHash];
 
                 BOOST_FOREACH(const CTxIn& in, tx.vin)
                     m_lockedInputs.erase(in.prevout);
@@ -490,12 +495,12 @@ boost::optional<CConsensusVote> InstantSend::GetLockVote(uint256 txHash) const
     return boost::optional<CConsensusVote>();
 }
 
-boost::optional<CTransaction> InstantSend::GetLockReq(uint256 txHash) const
+CTransactionRef InstantSend::GetLockReq(uint256 txHash) const
 {
-    std::map<uint256, CTransaction>::const_iterator it = m_txLockReq.find(txHash);
+    std::map<uint256, CTransactionRef>::const_iterator it = m_txLockReq.find(txHash);
     if (it != m_txLockReq.end())
-        return boost::optional<CTransaction>(it->second);
-    return boost::optional<CTransaction>();
+        return it->second;
+    return CTransactionRef();
 }
 
 bool InstantSend::AlreadyHave(uint256 txHash) const
@@ -41,7 +41,7 @@ public:
     void ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv);
     void CheckAndRemove();
     void Clear();
-    int64_t CreateNewLock(const CTransaction& tx);
+    int64_t CreateNewLock(const CTransactionRef& ptx);
     int GetSignaturesCount(uint256 txHash) const;
     int GetCompleteLocksCount() const;
     bool IsLockTimedOut(uint256 txHash) const;
@@ -50,7 +50,7 @@ public:
     std::string ToString() const;
     boost::optional<uint256> GetLockedTx(const COutPoint& out) const;
     boost::optional<CConsensusVote> GetLockVote(uint256 txHash) const;
-    boost::optional<CTransaction> GetLockReq(uint256 txHash) const;
+    CTransactionRef GetLockReq(uint256 txHash) const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -75,10 +75,10 @@ private:
 private:
     std::map<COutPoint, uint256> m_lockedInputs;
     std::map<uint256, CConsensusVote> m_txLockVote;
-    std::map<uint256, CTransaction> m_txLockReq;
+    std::map<uint256, CTransactionRef> m_txLockReq;
     std::map<uint256, CTransactionLock> m_txLocks;
     std::map<uint256, int64_t> m_unknownVotes; //track votes with no tx for DOS
-    std::map<uint256, CTransaction> m_txLockReqRejected;
+    std::map<uint256, CTransactionRef> m_txLockReqRejected;
     int m_completeTxLocks;
 };
 
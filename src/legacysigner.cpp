@@ -51,6 +51,14 @@ bool CLegacySigner::IsVinAssociatedWithPubkey(CTxIn& vin, CPubKey& pubkey, int v
                 if(out.scriptPubKey == payee2) return true;
             }
         }
+    } else if(fPruneMode){
+        // the block of an unspent collateral may be pruned, look at the coins instead
+        LOCK(cs_main);
+        const Coin& coin = pcoinsTip->AccessCoin(vin.prevout);
+        if(!coin.IsSpent()){
+            const CTxOut& out = coin.out;
+            if(out.nValue == value*COIN && out.scriptPubKey == payee2) return true;
+        }
     }
 
     return false;
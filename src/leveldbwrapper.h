@@ -59,6 +59,11 @@ public:
 
         batch.Delete(slKey);
     }
+
+    void Clear()
+    {
+        batch.Clear();
+    }
 };
 
 class CLevelDBWrapper
@@ -163,8 +168,19 @@ public:
         return WriteBatch(batch, true);
     }
 
+    //! Compact the keys from begin to end, to give back the space of erased records
+    template <typename K>
+    void CompactRange(const K& begin, const K& end) const
+    {
+        CDataStream ssBegin(SER_DISK, CLIENT_VERSION), ssEnd(SER_DISK, CLIENT_VERSION);
+        ssBegin << begin;
+        ssEnd << end;
+        leveldb::Slice slBegin(&ssBegin[0], ssBegin.size()), slEnd(&ssEnd[0], ssEnd.size());
+        pdb->CompactRange(&slBegin, &slEnd);
+    }
+
     // not exactly clean encapsulation, but it's easiest for now
-    leveldb::Iterator* NewIterator()
+    leveldb::Iterator* NewIterator() const
     {
         return pdb->NewIterator(iteroptions);
     }
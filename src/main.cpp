@@ -11,6 +11,7 @@
 #include "addrman.h"
 #include "alert.h"
 #include "auxpow.h"
+#include "auxpowcache.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -19,6 +20,7 @@
 #include "masternodeman.h"
 #include "masternode-payments.h"
 #include "masternode-budget.h"
+#include "masternode-sync.h"
 #include "systemnodeman.h"
 #include "systemnode-sync.h"
 #include "merkleblock.h"
@@ -58,13 +60,19 @@ CBlockIndex *pindexBestHeader = NULL;
 int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
+static CBlockIndex* pindexBestSnapshot = NULL; //!< guarded by csBestBlock
 int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fAuxPowIndex = DEFAULT_AUXPOWINDEX;
+bool fHavePruned = false;
+bool fPruneMode = false;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 size_t nCoinCacheUsage = 5000 * 300;
+uint64_t nPruneTarget = 0;
+uint256 hashAssumeValid;
 bool fAlerts = DEFAULT_ALERTS;
 
 /** Fees smaller than this (in cSats) are considered zero fee (for relaying and mining)
@@ -168,6 +176,9 @@ namespace {
 
     /** Dirty block file entries. */
     set<int> setDirtyFileInfo;
+
+    /** Global flag to indicate we should check to see if there are block/undo files that should be deleted. Set on startup or if we allocate more file space when we're in prune mode. */
+    bool fCheckForPruning = false;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -575,6 +586,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CBlockFilterDB *pblockfilterdb = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -645,6 +657,15 @@ void EraseOrphansFor(NodeId peer)
 }
 
 
+void static LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
+{
+    int expired = pool.Expire(GetTime() - age);
+    if (expired != 0)
+        LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+
+    pool.TrimToSize(limit);
+}
+
 unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
 {
     unsigned int nEvicted = 0;
@@ -878,10 +899,10 @@ int GetInputHeight(const CTxIn& vin)
         CCoinsViewMemPool viewMempool(pcoinsTip, mempool);
         view.SetBackend(viewMempool); // temporarily switch cache backend to db+mempool view
 
-        const CCoins* coins = view.AccessCoins(vin.prevout.hash);
+        const Coin& coin = view.AccessCoin(vin.prevout);
 
-        if (coins) {
-            return coins->nHeight;
+        if (!coin.IsSpent()) {
+            return coin.nHeight;
         }
         else
             return -1;
@@ -1015,6 +1036,13 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
 {
+    return AcceptToMemoryPool(pool, state, MakeTransactionRef(tx), fLimitFree, pfMissingInputs, fRejectInsaneFee, ignoreFees);
+}
+
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
+{
+    const CTransaction& tx = *ptx;
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
         *pfMissingInputs = false;
@@ -1077,14 +1105,16 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         view.SetBackend(viewMemPool);
 
         // do we already have it?
-        if (view.HaveCoins(hash))
-            return false;
+        for (unsigned int out = 0; out < tx.vout.size(); out++)
+            if (view.HaveCoin(COutPoint(hash, out)))
+                return false;
 
         // do all inputs exist?
-        // Note that this does not check for the presence of actual outputs (see the next check for that),
-        // only helps filling in pfMissingInputs (to determine missing vs spent).
+        // An input spent by a transaction we already know can not be told
+        // apart from one of a transaction we have not seen yet, both are
+        // reported through pfMissingInputs.
         BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            if (!view.HaveCoins(txin.prevout.hash)) {
+            if (!view.HaveCoin(txin.prevout)) {
                 if (pfMissingInputs)
                     *pfMissingInputs = true;
                 return false;
@@ -1126,7 +1156,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         CAmount nFees = nValueIn-nValueOut;
         double dPriority = view.GetPriority(tx, chainActive.Height());
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
+        CTxMemPoolEntry entry(ptx, nFees, GetTime(), dPriority, chainActive.Height());
         unsigned int nSize = entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
@@ -1138,6 +1168,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                                           hash.ToString(), nFees, txMinFee),
                                  REJECT_INSUFFICIENTFEE, "insufficient fee");
 
+            // The minimum fee rises above the relay fee after the pool had to evict transactions
+            CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+            if (mempoolRejectFee > 0 && nFees < mempoolRejectFee)
+                return state.DoS(0, error("AcceptToMemoryPool : mempool min fee not met %s, %d < %d",
+                                          hash.ToString(), nFees, mempoolRejectFee),
+                                 REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+
             // Require that free transactions have sufficient priority to be mined in the next block.
             if (GetBoolArg("-relaypriority", true) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
@@ -1173,6 +1210,21 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                          hash.ToString(),
                          nFees, ::minRelayTxFee.GetFee(nSize) * 10000);
 
+        // Long unconfirmed chains make every addition and removal walk all
+        // of them, so limit the in-mempool ancestors and descendants.
+        {
+            LOCK(pool.cs);
+            CTxMemPool::setEntries setAncestors;
+            size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+            size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+            size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+            size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+            std::string errString;
+            if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString))
+                return state.DoS(0, error("AcceptToMemoryPool : %s %s", hash.ToString(), errString),
+                                 REJECT_NONSTANDARD, "too-long-mempool-chain");
+        }
+
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true))
@@ -1196,6 +1248,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry);
+
+        // trim mempool and check if tx was trimmed
+        LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        if (!pool.exists(hash))
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
     }
 
     SyncWithWallets(tx, NULL);
@@ -1269,14 +1326,16 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState &state, const CTransact
             view.SetBackend(viewMemPool);
 
             // do we already have it?
-            if (view.HaveCoins(hash))
-                return false;
+            for (unsigned int out = 0; out < tx.vout.size(); out++)
+                if (view.HaveCoin(COutPoint(hash, out)))
+                    return false;
 
             // do all inputs exist?
-            // Note that this does not check for the presence of actual outputs (see the next check for that),
-            // only helps filling in pfMissingInputs (to determine missing vs spent).
+            // An input spent by a transaction we already know can not be told
+            // apart from one of a transaction we have not seen yet, both are
+            // reported through pfMissingInputs.
             BOOST_FOREACH(const CTxIn txin, tx.vin) {
-                if (!view.HaveCoins(txin.prevout.hash)) {
+                if (!view.HaveCoin(txin.prevout)) {
                     if (pfMissingInputs)
                         *pfMissingInputs = true;
                     return false;
@@ -1436,10 +1495,9 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
             int nHeight = -1;
             {
-                CCoinsViewCache &view = *pcoinsTip;
-                const CCoins* coins = view.AccessCoins(hash);
-                if (coins)
-                    nHeight = coins->nHeight;
+                const Coin& coin = AccessByTxid(*pcoinsTip, hash);
+                if (!coin.IsSpent())
+                    nHeight = coin.nHeight;
             }
             if (nHeight > 0)
                 pindexSlow = chainActive[nHeight];
@@ -1449,7 +1507,8 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
     if (pindexSlow) {
         CBlock block;
         if (ReadBlockFromDisk(block, pindexSlow)) {
-            BOOST_FOREACH(const CTransaction &tx, block.vtx) {
+            BOOST_FOREACH(const CTransactionRef& ptx, block.vtx) {
+                const CTransaction& tx = *ptx;
                 if (tx.GetHash() == hash) {
                     txOut = tx;
                     hashBlock = pindexSlow->GetBlockHash();
@@ -1595,6 +1654,30 @@ bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex)
     return ReadBlockOrHeader(block, pindex);
 }
 
+boost::shared_ptr<CAuxPow> GetBlockAuxPow(const CBlockIndex* pindex)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    boost::shared_ptr<CAuxPow> auxpow = auxpowCache.Get(hash);
+    if (auxpow)
+        return auxpow;
+
+    if (fAuxPowIndex && pblocktree) {
+        auxpow.reset(new CAuxPow());
+        if (!pblocktree->ReadAuxPow(hash, *auxpow))
+            auxpow.reset();
+    }
+
+    if (!auxpow) {
+        CBlockHeader header;
+        if (!ReadBlockHeaderFromDisk(header, pindex))
+            return auxpow;
+        auxpow = header.auxpow;
+    }
+
+    auxpowCache.Insert(hash, auxpow);
+    return auxpow;
+}
+
 double ConvertBitsToDouble(unsigned int nBits)
 {
     int nShift = (nBits >> 24) & 0xff;
@@ -1808,43 +1891,27 @@ void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCach
     if (!tx.IsCoinBase()) {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
-            unsigned nPos = txin.prevout.n;
-
-            if (nPos >= coins->vout.size() || coins->vout[nPos].IsNull())
-                assert(false);
             // mark an outpoint spent, and construct undo information
-            txundo.vprevout.push_back(CTxInUndo(coins->vout[nPos]));
-            coins->Spend(nPos);
-            if (coins->vout.size() == 0) {
-                CTxInUndo& undo = txundo.vprevout.back();
-                undo.nHeight = coins->nHeight;
-                undo.fCoinBase = coins->fCoinBase;
-                undo.nVersion = coins->nVersion;
-            }
+            Coin coin;
+            bool fSpent = inputs.SpendCoin(txin.prevout, &coin);
+            assert(fSpent);
+            txundo.vprevout.push_back(CTxInUndo(coin.out, coin.fCoinBase, coin.nHeight));
         }
-        // add outputs
-        inputs.ModifyNewCoins(tx.GetHash())->FromTx(tx, nHeight);
-    }
-    else {
-        // add outputs for coinbase tx
-        // In this case call the full ModifyCoins which will do a database
-        // lookup to be sure the coins do not already exist otherwise we do not
-        // know whether to mark them fresh or not.  We want the duplicate coinbases
-        // before BIP30 to still be properly overwritten.
-        inputs.ModifyCoins(tx.GetHash())->FromTx(tx, nHeight);
     }
+    // add outputs, those of a coinbase are looked up first as they may
+    // replace an earlier duplicate coinbase
+    AddCoins(inputs, tx, nHeight);
 }
 
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error)) {
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore, txdata), &error)) {
         return ::error("CScriptCheck(): %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
     }
     return true;
 }
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks)
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks, const PrecomputedTransactionData *txdata)
 {
     if (!tx.IsCoinBase())
     {
@@ -1865,20 +1932,20 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         for (unsigned int i = 0; i < tx.vin.size(); i++)
         {
             const COutPoint &prevout = tx.vin[i].prevout;
-            const CCoins *coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            const Coin& coin = inputs.AccessCoin(prevout);
+            assert(!coin.IsSpent());
 
             // If prev is coinbase, check that it's matured
-            if (coins->IsCoinBase()) {
-                if (nSpendHeight - coins->nHeight < COINBASE_MATURITY)
+            if (coin.IsCoinBase()) {
+                if (nSpendHeight - (int)coin.nHeight < COINBASE_MATURITY)
                     return state.Invalid(
-                        error("CheckInputs() : tried to spend coinbase at depth %d", nSpendHeight - coins->nHeight),
+                        error("CheckInputs() : tried to spend coinbase at depth %d", nSpendHeight - (int)coin.nHeight),
                         REJECT_INVALID, "bad-txns-premature-spend-of-coinbase");
             }
 
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.out.nValue;
+            if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, error("CheckInputs() : txin values out of range"),
                                  REJECT_INVALID, "bad-txns-inputvalues-outofrange");
 
@@ -1907,13 +1974,20 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // Serialize the parts of the signature hash shared by the inputs once,
+            // checks run right here can use a copy that goes away with this call
+            PrecomputedTransactionData txdataLocal;
+            if (!txdata && !pvChecks && tx.vin.size() > 1) {
+                txdataLocal.Init(tx);
+                txdata = &txdataLocal;
+            }
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                const COutPoint &prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(tx.vin[i].prevout);
+                assert(!coin.IsSpent());
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(coin.out, tx, i, flags, cacheStore, txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1925,8 +1999,8 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check(*coins, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                        CScriptCheck check(coin.out, tx, i,
+                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, txdata);
                         if (check())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1967,29 +2041,18 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
-        const CTransaction &tx = block.vtx[i];
+        const CTransaction &tx = *block.vtx[i];
         uint256 hash = tx.GetHash();
 
         // Check that all outputs are available and match the outputs in the block itself
-        // exactly. Note that transactions with only provably unspendable outputs won't
-        // have outputs available even in the block itself, so we handle that case
-        // specially with outsEmpty.
-        {
-        CCoins outsEmpty;
-        CCoinsModifier outs = view.ModifyCoins(hash);
-        outs->ClearUnspendable();
-
-        CCoins outsBlock(tx, pindex->nHeight);
-        // The CCoins serialization does not serialize negative numbers.
-        // No network rules currently depend on the version here, so an inconsistency is harmless
-        // but it must be corrected before txout nversion ever influences a network rule.
-        if (outsBlock.nVersion < 0)
-            outs->nVersion = outsBlock.nVersion;
-        if (*outs != outsBlock)
-            fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
-
-        // remove outputs
-        outs->Clear();
+        // exactly, and remove them. Provably unspendable outputs were never added.
+        for (unsigned int o = 0; o < tx.vout.size(); o++) {
+            if (tx.vout[o].scriptPubKey.IsUnspendable())
+                continue;
+            Coin coin;
+            bool fSpent = view.SpendCoin(COutPoint(hash, o), &coin);
+            if (!fSpent || tx.vout[o] != coin.out || (int)coin.nHeight != pindex->nHeight || coin.IsCoinBase() != tx.IsCoinBase())
+                fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
         }
 
         // restore inputs
@@ -2000,24 +2063,21 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
                 const CTxInUndo &undo = txundo.vprevout[j];
-                CCoinsModifier coins = view.ModifyCoins(out.hash);
-                if (undo.nHeight != 0) {
-                    // undo data contains height: this is the last output of the prevout tx being spent
-                    if (!coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data overwriting existing transaction");
-                    coins->Clear();
-                    coins->fCoinBase = undo.fCoinBase;
-                    coins->nHeight = undo.nHeight;
-                    coins->nVersion = undo.nVersion;
-                } else {
-                    if (coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data adding output to missing transaction");
+                Coin coin(undo.txout, undo.nHeight, undo.fCoinBase);
+                if (undo.nHeight == 0) {
+                    // Older undo data only has the metadata with the last output
+                    // of a transaction being spent, so another output of that
+                    // transaction is still unspent and has it.
+                    const Coin& alternate = AccessByTxid(view, out.hash);
+                    if (alternate.IsSpent())
+                        return error("DisconnectBlock() : undo data adding output to missing transaction");
+                    coin.nHeight = alternate.nHeight;
+                    coin.fCoinBase = alternate.fCoinBase;
                 }
-                if (coins->IsAvailable(out.n))
+                bool fOverwrite = view.HaveCoin(out);
+                if (fOverwrite)
                     fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
-                if (coins->vout.size() < out.n+1)
-                    coins->vout.resize(out.n+1);
-                coins->vout[out.n] = undo.txout;
+                view.AddCoin(out, coin, fOverwrite);
             }
         }
     }
@@ -2059,6 +2119,8 @@ void static FlushBlockFile(bool fFinalize = false)
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+/** Script checks of a block are handed to the queue once at least this many are collected */
+static const unsigned int SCRIPT_CHECK_QUEUE_MIN_ADD = 32;
 
 void ThreadScriptCheck() {
     RenameThread("crown-scriptch");
@@ -2090,6 +2152,27 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
+    if (fScriptChecks && !hashAssumeValid.IsNull()) {
+        // We've been configured with the hash of a block which has been externally verified to have a valid history.
+        // A suitable default value is included with the software and updated from time to time.  Because validity
+        //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
+        // This setting doesn't force the selection of any particular chain but makes validating some faster by
+        //  effectively caching the result of part of the verification.
+        BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValid);
+        if (it != mapBlockIndex.end()) {
+            if (it->second->GetAncestor(pindex->nHeight) == pindex &&
+                pindexBestHeader->GetAncestor(pindex->nHeight) == pindex) {
+                // This block is a member of the assumed verified chain and an ancestor of the best header.
+                // The equivalent time check discourages hashpower from extorting the network via DOS attack
+                //  into accepting an invalid block through telling users they must manually set assumevalid.
+                //  Requiring a software change or burying the invalid block, regardless of the setting, makes
+                //  it hard to hide the implication of the demand.  This also avoids having release candidates
+                //  that are hardly doing any signature verification at all in testing without having to
+                //  artificially set the default assumed verified block further back.
+                fScriptChecks = (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader) <= 60 * 60 * 24 * 7 * 2);
+            }
+        }
+    }
 
     unsigned int flags = SCRIPT_VERIFY_P2SH;
 
@@ -2100,6 +2183,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     CBlockUndo blockundo;
 
+    // Signature hash data of the transactions, declared before control so
+    // it is still there when control waits for the queued checks
+    std::vector<PrecomputedTransactionData> txdata(block.vtx.size());
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     int64_t nTimeStart = GetTimeMicros();
@@ -2110,9 +2196,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
+    std::vector<CScriptCheck> vChecks;
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
-        const CTransaction &tx = block.vtx[i];
+        const CTransaction &tx = *block.vtx[i];
 
         nInputs += tx.vin.size();
         nSigOps += GetLegacySigOpCount(tx);
@@ -2136,11 +2223,17 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             nFees += view.GetValueIn(tx)-tx.GetValueOut();
 
-            std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, nScriptCheckThreads ? &vChecks : NULL))
+            if (fScriptChecks && tx.vin.size() > 1)
+                txdata[i].Init(tx);
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, nScriptCheckThreads ? &vChecks : NULL, &txdata[i]))
                 return false;
-            control.Add(vChecks);
+            // the checks keep pointers into block.vtx, so they can be queued
+            // for several transactions at once to save on queue locking and wake-ups
+            if (vChecks.size() >= SCRIPT_CHECK_QUEUE_MIN_ADD) {
+                control.Add(vChecks);
+                vChecks.clear();
+            }
         }
 
         CTxUndo undoDummy;
@@ -2152,13 +2245,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
+    control.Add(vChecks);
     int64_t nTime1 = GetTimeMicros(); nTimeConnect += nTime1 - nTimeStart;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime1 - nTimeStart), 0.001 * (nTime1 - nTimeStart) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime1 - nTimeStart) / (nInputs-1), nTimeConnect * 0.000001);
 
     if(!IsBlockValueValid(block, GetBlockValue(pindex->pprev->nHeight, nFees))){
         return state.DoS(100,
                          error("ConnectBlock() : coinbase pays too much (actual=%d vs limit=%d)",
-                               block.vtx[0].GetValueOut(), GetBlockValue(pindex->pprev->nHeight, nFees)),
+                               block.vtx[0]->GetValueOut(), GetBlockValue(pindex->pprev->nHeight, nFees)),
                                REJECT_INVALID, "bad-cb-amount");
     }
 
@@ -2193,6 +2287,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    if (pblockfilterdb)
+        if (!pblockfilterdb->WriteFilter(CBlockFilter(block)))
+            return state.Abort("Failed to write block filter");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2202,7 +2300,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
     g_signals.UpdatedTransaction(hashPrevBestCoinBase);
-    hashPrevBestCoinBase = block.vtx[0].GetHash();
+    hashPrevBestCoinBase = block.vtx[0]->GetHash();
 
     int64_t nTime4 = GetTimeMicros(); nTimeCallbacks += nTime4 - nTime3;
     LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime4 - nTime3), nTimeCallbacks * 0.000001);
@@ -2210,6 +2308,139 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     return true;
 }
 
+/* Calculate the amount of disk space the block & undo files currently use */
+uint64_t CalculateCurrentUsage()
+{
+    uint64_t retval = 0;
+    BOOST_FOREACH(const CBlockFileInfo &file, vinfoBlockFile) {
+        retval += file.nSize + file.nUndoSize;
+    }
+    return retval;
+}
+
+/* Prune a block file (modify associated database entries)*/
+void static PruneOneBlockFile(const int fileNumber)
+{
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex->nFile == fileNumber) {
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex *, CBlockIndex *>::iterator itUnlinked = range.first;
+                range.first++;
+                if (itUnlinked->second == pindex) {
+                    mapBlocksUnlinked.erase(itUnlinked);
+                }
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
+{
+    for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
+        CDiskBlockPos pos(*it, 0);
+        boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+        boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
+    }
+}
+
+/**
+ * Calculate the block/rev files that should be deleted to remain under target.
+ *
+ * Besides the MIN_BLOCKS_TO_KEEP needed for reorgs, a full budget payment
+ * cycle is kept for the superblock checks, as well as the blocks with the fee
+ * transactions of the known budget proposals, which are checked again every
+ * time the proposals are. Nothing is pruned before the budget is synced, false
+ * is returned when the check has to be done again later.
+ */
+bool static FindFilesToPrune(std::set<int>& setFilesToPrune)
+{
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (chainActive.Tip() == NULL || nPruneTarget == 0) {
+        return true;
+    }
+    if (!fLiteMode && !masternodeSync.IsSynced()) {
+        return false;
+    }
+    int64_t nOldestCollateralTime = fLiteMode ? 0 : budget.GetOldestCollateralTime();
+    if (nOldestCollateralTime < 0) {
+        return false;
+    }
+
+    int nMinBlocksToKeep = std::max((int)MIN_BLOCKS_TO_KEEP, GetBudgetPaymentCycleBlocks());
+    if (chainActive.Tip()->nHeight <= nMinBlocksToKeep) {
+        return true;
+    }
+
+    unsigned int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - nMinBlocksToKeep;
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files
+    // So we should leave a buffer under our target to account for another allocation
+    // before the next pruning.
+    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    uint64_t nBytesToPrune;
+    int count = 0;
+
+    if (nCurrentUsage + nBuffer >= nPruneTarget) {
+        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+            nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+
+            if (vinfoBlockFile[fileNumber].nSize == 0)
+                continue;
+
+            if (nCurrentUsage + nBuffer < nPruneTarget)  // are we below our target?
+                break;
+
+            // don't prune files that could have a block within nMinBlocksToKeep of the main chain's tip but keep scanning
+            if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+                continue;
+
+            // nor files that could have the fee transaction of a budget proposal, allowing for block time variability
+            if (nOldestCollateralTime > 0 && (int64_t)vinfoBlockFile[fileNumber].nTimeLast >= nOldestCollateralTime - 7200)
+                continue;
+
+            PruneOneBlockFile(fileNumber);
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+            count++;
+        }
+    }
+
+    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+           nPruneTarget/1024/1024, nCurrentUsage/1024/1024,
+           ((int64_t)nPruneTarget - (int64_t)nCurrentUsage)/1024/1024,
+           nLastBlockWeCanPrune, count);
+    return true;
+}
+
+int GetPruneHeight()
+{
+    LOCK(cs_main);
+    CBlockIndex* pindex = chainActive.Tip();
+    if (pindex == NULL)
+        return 0;
+    while (pindex->pprev && (pindex->pprev->nStatus & BLOCK_HAVE_DATA))
+        pindex = pindex->pprev;
+    return pindex->nHeight;
+}
+
 enum FlushStateMode {
     FLUSH_STATE_IF_NEEDED,
     FLUSH_STATE_PERIODIC,
@@ -2227,7 +2458,21 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
+    if (fPruneMode && fCheckForPruning && !fReindex) {
+        // retried on the next flush when the budget can't be checked yet
+        if (FindFilesToPrune(setFilesToPrune))
+            fCheckForPruning = false;
+        if (!setFilesToPrune.empty()) {
+            fFlushForPrune = true;
+            if (!fHavePruned) {
+                pblocktree->WriteFlag("prunedblockfiles", true);
+                fHavePruned = true;
+            }
+        }
+    }
     int64_t nNow = GetTimeMicros();
     // Avoid writing/flushing immediately after startup.
     if (nLastWrite == 0) {
@@ -2239,7 +2484,7 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     if (nLastSetChain == 0) {
         nLastSetChain = nNow;
     }
-    int64_t nMempoolSizeMax = GetArg("-maxmempool", 300) * 1000000;
+    int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
     int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
     // The cache is large and we're within 10% and 100 MiB of the limit, but we have time now (not in the middle of a block processing).
@@ -2251,7 +2496,7 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
     bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
     // Combine all conditions that result in a full cache flush.
-    bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush;
+    bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
     // Write blocks and block index to disk.
     if (fDoFullFlush || fPeriodicWrite) {
         // Depend on nMinDiskSpace to ensure we can write block index
@@ -2282,17 +2527,20 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
     if (fDoFullFlush) {
-        // Typical CCoins structures on disk are around 128 bytes in size.
+        // Typical Coin structures on disk are around 48 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
         // an overestimation, as most will delete an existing entry or
         // overwrite one. Still, use a conservative safety factor of 2.
-        if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
+        if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
         if (!pcoinsTip->Flush())
             return state.Abort("Failed to write to coin database");
         nLastFlush = nNow;
+        // The block index no longer refers to the pruned files
+        if (fFlushForPrune)
+            UnlinkPrunedFiles(setFilesToPrune);
     }
     if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
         // Update best block in wallet (so we can detect restored wallets).
@@ -2310,9 +2558,28 @@ void FlushStateToDisk() {
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush() {
+    CValidationState state;
+    fCheckForPruning = true;
+    FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
+}
+
+static void SetBestBlockSnapshot(CBlockIndex* pindex)
+{
+    boost::unique_lock<boost::mutex> lock(csBestBlock);
+    pindexBestSnapshot = pindex;
+}
+
+CBlockIndex* GetBestBlockSnapshot()
+{
+    boost::unique_lock<boost::mutex> lock(csBestBlock);
+    return pindexBestSnapshot;
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew) {
     chainActive.SetTip(pindexNew);
+    SetBestBlockSnapshot(pindexNew);
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -2371,20 +2638,23 @@ bool static DisconnectTip(CValidationState &state) {
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
     // Resurrect mempool transactions from the disconnected block.
-    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
+    BOOST_FOREACH(const CTransactionRef& ptx, block.vtx) {
+        const CTransaction& tx = *ptx;
         // ignore validation errors in resurrected transactions
         list<CTransaction> removed;
         CValidationState stateDummy;
-        if (tx.IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL))
+        if (tx.IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, ptx, false, NULL))
             mempool.remove(tx, removed, true);
     }
     mempool.removeCoinbaseSpends(pcoinsTip, pindexDelete->nHeight);
     mempool.check(pcoinsTip);
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
+    masternodePayments.BlockDisconnected(pindexDelete->nHeight);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
-    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
+    BOOST_FOREACH(const CTransactionRef& ptx, block.vtx) {
+        const CTransaction& tx = *ptx;
         SyncWithWallets(tx, NULL);
     }
     return true;
@@ -2441,13 +2711,15 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     mempool.check(pcoinsTip);
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    masternodePayments.BlockConnected(pindexNew->nHeight);
     // Tell wallet about transactions that went from mempool
     // to conflicted:
     BOOST_FOREACH(const CTransaction &tx, txConflicted) {
         SyncWithWallets(tx, NULL);
     }
     // ... and about transactions that got confirmed:
-    BOOST_FOREACH(const CTransaction &tx, pblock->vtx) {
+    BOOST_FOREACH(const CTransactionRef& ptx, pblock->vtx) {
+        const CTransaction& tx = *ptx;
         SyncWithWallets(tx, pblock);
     }
 
@@ -2508,7 +2780,8 @@ bool DisconnectBlockAndInputs(CValidationState &state, CTransaction txLock)
         // Queue memory transactions to resurrect.
         // We only do this for blocks after the last checkpoint (reorganisation before that
         // point should only happen with -reindex/-loadblock, or a misbehaving peer.
-        BOOST_FOREACH(const CTransaction& tx, block.vtx){
+        BOOST_FOREACH(const CTransactionRef& ptx, block.vtx) {
+            const CTransaction& tx = *ptx;
             if (!tx.IsCoinBase()){
                 BOOST_FOREACH(const CTxIn& in1, txLock.vin){
                     BOOST_FOREACH(const CTxIn& in2, tx.vin){
@@ -2913,6 +3186,8 @@ bool FindBlockPos(CValidationState &state, CDiskBlockPos &pos, unsigned int nAdd
         unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         if (nNewChunks > nOldChunks) {
+            if (fPruneMode)
+                fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
                 FILE *file = OpenBlockFile(pos);
                 if (file) {
@@ -2944,6 +3219,8 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     if (nNewChunks > nOldChunks) {
+        if (fPruneMode)
+            fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
             FILE *file = OpenUndoFile(pos);
             if (file) {
@@ -2974,11 +3251,11 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
+bool CheckBlockContextFree(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     // These are checks that are independent of context.
 
-    if (block.fChecked)
+    if (block.fContextFreeChecked)
         return true;
 
     // Check that the header is valid (particularly PoW).  This is mostly
@@ -3012,19 +3289,47 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
                          REJECT_INVALID, "bad-blk-length");
 
     // First transaction must be coinbase, the rest must not be
-    if (block.vtx.empty() || !block.vtx[0].IsCoinBase())
+    if (block.vtx.empty() || !block.vtx[0]->IsCoinBase())
         return state.DoS(100, error("CheckBlock() : first tx is not coinbase"),
                          REJECT_INVALID, "bad-cb-missing");
     for (unsigned int i = 1; i < block.vtx.size(); i++)
-        if (block.vtx[i].IsCoinBase())
+        if (block.vtx[i]->IsCoinBase())
             return state.DoS(100, error("CheckBlock() : more than one coinbase"),
                              REJECT_INVALID, "bad-cb-multiple");
 
+    // Check transactions
+    BOOST_FOREACH(const CTransactionRef& tx, block.vtx)
+        if (!CheckTransaction(*tx, state))
+            return error("CheckBlock() : CheckTransaction failed");
+
+    unsigned int nSigOps = 0;
+    BOOST_FOREACH(const CTransactionRef& tx, block.vtx)
+    {
+        nSigOps += GetLegacySigOpCount(*tx);
+    }
+    if (nSigOps > MAX_BLOCK_SIGOPS)
+        return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
+                         REJECT_INVALID, "bad-blk-sigops", true);
+
+    if (fCheckPOW && fCheckMerkleRoot)
+        block.fContextFreeChecked = true;
+
+    return true;
+}
+
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
+{
+    if (block.fChecked)
+        return true;
+
+    if (!CheckBlockContextFree(block, state, fCheckPOW, fCheckMerkleRoot))
+        return false;
 
     // ----------- instantX transaction scanning -----------
 
     if(IsSporkActive(SPORK_3_INSTANTX_BLOCK_FILTERING)){
-        BOOST_FOREACH(const CTransaction& tx, block.vtx){
+        BOOST_FOREACH(const CTransactionRef& ptx, block.vtx) {
+            const CTransaction& tx = *ptx;
             if (!tx.IsCoinBase()){
                 //only reject blocks when it's based on complete consensus
                 BOOST_FOREACH(const CTxIn& in, tx.vin)
@@ -3062,12 +3367,12 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         }
 
         if(nHeight != 0){
-            if(!IsBlockPayeeValid(block.vtx[0], nHeight))
+            if(!IsBlockPayeeValid(*block.vtx[0], nHeight))
             {
                 mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
                 return state.DoS(100, error("CheckBlock() : Couldn't find masternode/budget payment"));
             }
-            if(!SNIsBlockPayeeValid(block.vtx[0], nHeight))
+            if(!SNIsBlockPayeeValid(*block.vtx[0], nHeight))
             {
                 mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
                 return state.DoS(100, error("CheckBlock() : Couldn't find systemnode/budget payment"));
@@ -3080,20 +3385,6 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 
     // -------------------------------------------
 
-    // Check transactions
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-        if (!CheckTransaction(tx, state))
-            return error("CheckBlock() : CheckTransaction failed");
-
-    unsigned int nSigOps = 0;
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-    {
-        nSigOps += GetLegacySigOpCount(tx);
-    }
-    if (nSigOps > MAX_BLOCK_SIGOPS)
-        return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
-                         REJECT_INVALID, "bad-blk-sigops", true);
-
     if (fCheckPOW && fCheckMerkleRoot)
         block.fChecked = true;
 
@@ -3160,8 +3451,8 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     const int nHeight = pindexPrev == NULL ? 0 : pindexPrev->nHeight + 1;
 
     // Check that all transactions are finalized
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-        if (!IsFinalTx(tx, nHeight, block.GetBlockTime())) {
+    BOOST_FOREACH(const CTransactionRef& tx, block.vtx)
+        if (!IsFinalTx(*tx, nHeight, block.GetBlockTime())) {
             return state.DoS(10, error("%s : contains a non-final transaction", __func__), REJECT_INVALID, "bad-txns-nonfinal");
         }
 
@@ -3171,8 +3462,8 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
         CBlockIndex::IsSuperMajority(2, pindexPrev, Params().EnforceBlockUpgradeMajority()))
     {
         CScript expect = CScript() << nHeight;
-        if (block.vtx[0].vin[0].scriptSig.size() < expect.size() ||
-            !std::equal(expect.begin(), expect.end(), block.vtx[0].vin[0].scriptSig.begin())) {
+        if (block.vtx[0]->vin[0].scriptSig.size() < expect.size() ||
+            !std::equal(expect.begin(), expect.end(), block.vtx[0]->vin[0].scriptSig.begin())) {
             return state.DoS(100, error("%s : block height mismatch in coinbase", __func__), REJECT_INVALID, "bad-cb-height");
         }
     }
@@ -3219,6 +3510,14 @@ bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBloc
     if (pindex == NULL)
         pindex = AddToBlockIndex(block);
 
+    // Keep the auxpow around so that the header can be served without reading the block files
+    if (block.auxpow) {
+        boost::shared_ptr<CAuxPow> auxpow(new CAuxPow(*block.auxpow));
+        auxpowCache.Insert(hash, auxpow);
+        if (fAuxPowIndex && !pblocktree->WriteAuxPow(hash, *auxpow))
+            return state.Abort("Failed to write auxpow");
+    }
+
     if (ppindex)
         *ppindex = pindex;
 
@@ -3562,6 +3861,11 @@ bool static LoadBlockIndexDB()
         }
     }
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
@@ -3571,11 +3875,30 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Fill the auxpow cache with the most recent headers. Until SyncAuxPowIndex
+    // is done the index has gaps, the blocks in them are skipped.
+    if (fAuxPowIndex) {
+        for (CBlockIndex* pindex = pindexBestHeader; pindex != NULL && !auxpowCache.IsFull(); pindex = pindex->pprev) {
+            if (!pindex->nVersion.IsAuxpow())
+                continue;
+            boost::shared_ptr<CAuxPow> auxpow(new CAuxPow());
+            if (!pblocktree->ReadAuxPow(pindex->GetBlockHash(), *auxpow))
+                continue;
+            auxpowCache.Insert(pindex->GetBlockHash(), auxpow);
+        }
+        LogPrintf("LoadBlockIndexDB(): loaded %u auxpow headers (%.1fMiB)\n", auxpowCache.size(), auxpowCache.DynamicMemoryUsage() * (1.0 / 1024 / 1024));
+    } else {
+        // blocks accepted from now on get no record, so start over when the
+        // index is enabled again
+        pblocktree->EraseAuxPowBestBlock();
+    }
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    SetBestBlockSnapshot(it->second);
 
     PruneBlockIndexCandidates();
 
@@ -3621,6 +3944,11 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
         uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
             break;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex))
@@ -3677,9 +4005,11 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
 
 void UnloadBlockIndex()
 {
+    auxpowCache.Clear();
     mapBlockIndex.clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    SetBestBlockSnapshot(NULL);
     pindexBestInvalid = NULL;
 }
 
@@ -3732,99 +4062,301 @@ bool InitBlockIndex() {
 
 
 
+namespace {
+
+/** A block read from an external block file, deserialized and checked by the import queue */
+struct CImportedBlock
+{
+    CDataStream ssBlock;
+    CDiskBlockPos pos;
+    bool fHavePos;
+    unsigned int nSize;
+    //! NULL if the block could not be deserialized
+    boost::shared_ptr<CBlock> pblock;
+    std::string strError;
+
+    CImportedBlock() : ssBlock(SER_DISK, CLIENT_VERSION), fHavePos(false), nSize(0) {}
+};
+
+/** A block whose parent was not known yet when it was imported */
+struct CUnknownParentBlock
+{
+    //! NULL once the memory for out of order blocks is used up, the block is read from disk again then
+    boost::shared_ptr<CBlock> pblock;
+    CDiskBlockPos pos;
+    bool fHavePos;
+    unsigned int nSize;
+};
+
+/** Deserializes an imported block and runs the context-free checks on it */
+class CImportCheck
+{
+private:
+    CImportedBlock* pimported;
+
+public:
+    CImportCheck() : pimported(NULL) {}
+    CImportCheck(CImportedBlock* pimportedIn) : pimported(pimportedIn) {}
+
+    bool operator()()
+    {
+        try {
+            boost::shared_ptr<CBlock> pblock(new CBlock());
+            pimported->ssBlock >> *pblock;
+            // A failure is only remembered by the block not being marked as
+            // checked, ProcessNewBlock() finds and reports it again.
+            CValidationState state;
+            CheckBlockContextFree(*pblock, state);
+            pimported->pblock = pblock;
+        } catch (const std::exception& e) {
+            pimported->strError = e.what();
+        }
+        pimported->ssBlock.clear();
+        return true;
+    }
+
+    void swap(CImportCheck& check)
+    {
+        std::swap(pimported, check.pimported);
+    }
+};
+
+void ThreadImportCheck(CCheckQueue<CImportCheck>* pqueue)
+{
+    RenameThread("crown-importch");
+    pqueue->Thread();
+}
+
+/** Waits for the checks still queued and stops the threads of an import queue, also when the import is interrupted */
+class CImportQueueGuard
+{
+private:
+    CCheckQueue<CImportCheck>& queue;
+    boost::thread_group& threads;
+
+public:
+    CImportQueueGuard(CCheckQueue<CImportCheck>& queueIn, boost::thread_group& threadsIn) : queue(queueIn), threads(threadsIn) {}
+
+    ~CImportQueueGuard()
+    {
+        boost::this_thread::disable_interruption di;
+        queue.Wait();
+        queue.Quit();
+        threads.join_all();
+    }
+};
+
+// Map of blocks with unknown parent, with their disk positions for reindex
+std::multimap<uint256, CUnknownParentBlock> mapBlocksUnknownParent;
+unsigned int nBlocksUnknownParentSize = 0;
+
+void QueueImportChecks(CCheckQueue<CImportCheck>& queue, std::deque<CImportedBlock>& vBatch)
+{
+    std::vector<CImportCheck> vChecks;
+    vChecks.reserve(vBatch.size());
+    BOOST_FOREACH(CImportedBlock& imported, vBatch)
+        vChecks.push_back(CImportCheck(&imported));
+    queue.Add(vChecks);
+}
+
+void WaitForImportChecks(CCheckQueue<CImportCheck>& queue)
+{
+    // Waiting must not be interrupted while the queue still holds
+    // pointers to the batch.
+    boost::this_thread::disable_interruption di;
+    queue.Wait();
+}
+
+/**
+ * Locates the next blocks of an external block file and reads them without
+ * deserializing. Returns false once the end of the file is reached.
+ */
+bool ReadImportBatch(CBufferedFile& blkdat, uint64_t& nRewind, const CDiskBlockPos* dbp, std::deque<CImportedBlock>& vBatch)
+{
+    uint64_t nBatchSize = 0;
+    while (!blkdat.eof()) {
+        boost::this_thread::interruption_point();
+
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        try {
+            // locate a header
+            unsigned char buf[MESSAGE_START_SIZE];
+            blkdat.FindByte(Params().MessageStart()[0]);
+            nRewind = blkdat.GetPos()+1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
+                continue;
+        } catch (const std::exception &) {
+            // no valid block header found; don't complain
+            return false;
+        }
+        try {
+            // read block, it is deserialized by the import queue. A block that
+            // fails to deserialize then is skipped as a whole, the scan is not
+            // restarted inside of it.
+            uint64_t nBlockPos = blkdat.GetPos();
+            blkdat.SetLimit(nBlockPos + nSize);
+            vBatch.push_back(CImportedBlock());
+            CImportedBlock& imported = vBatch.back();
+            if (dbp) {
+                imported.pos = *dbp;
+                imported.pos.nPos = nBlockPos;
+                imported.fHavePos = true;
+            }
+            imported.nSize = nSize;
+            imported.ssBlock.resize(nSize);
+            blkdat.read(&imported.ssBlock[0], nSize);
+            nRewind = blkdat.GetPos();
+        } catch (const std::exception &e) {
+            vBatch.pop_back();
+            LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+            continue;
+        }
+        nBatchSize += nSize;
+        if (nBatchSize >= IMPORT_BATCH_SIZE)
+            return true;
+    }
+    return false;
+}
+
+/** Connects an imported block and the earlier encountered successors of it. Returns false on a system error. */
+bool ProcessImportedBlock(CImportedBlock& imported, int& nLoaded)
+{
+    if (!imported.pblock) {
+        LogPrintf("%s : Deserialize or I/O error - %s", __func__, imported.strError);
+        return true;
+    }
+    CBlock& block = *imported.pblock;
+    CDiskBlockPos* dbp = imported.fHavePos ? &imported.pos : NULL;
+
+    // detect out of order blocks, and store them for later
+    uint256 hash = block.GetHash();
+    bool fParentKnown, fHaveData;
+    int nHeight = 0;
+    {
+        LOCK(cs_main);
+        fParentKnown = hash == Params().HashGenesisBlock() || mapBlockIndex.count(block.hashPrevBlock);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        fHaveData = mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA);
+        if (fHaveData)
+            nHeight = mi->second->nHeight;
+    }
+    if (!fParentKnown) {
+        LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                block.hashPrevBlock.ToString());
+        CUnknownParentBlock unknown;
+        unknown.pos = imported.pos;
+        unknown.fHavePos = imported.fHavePos;
+        unknown.nSize = imported.nSize;
+        if (nBlocksUnknownParentSize + unknown.nSize <= MAX_IMPORT_UNKNOWN_PARENT_SIZE) {
+            unknown.pblock = imported.pblock;
+            nBlocksUnknownParentSize += unknown.nSize;
+        } else if (!unknown.fHavePos) {
+            return true;
+        }
+        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, unknown));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (!fHaveData) {
+        CValidationState state;
+        if (ProcessNewBlock(state, NULL, &block, dbp))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != Params().HashGenesisBlock() && nHeight % 1000 == 0) {
+        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), nHeight);
+    }
+
+    // Recursively process earlier encountered successors of this block
+    deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CUnknownParentBlock>::iterator, std::multimap<uint256, CUnknownParentBlock>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CUnknownParentBlock>::iterator it = range.first;
+            boost::shared_ptr<CBlock> pchild = it->second.pblock;
+            if (pchild) {
+                nBlocksUnknownParentSize -= it->second.nSize;
+            } else {
+                pchild.reset(new CBlock());
+                if (!ReadBlockFromDisk(*pchild, it->second.pos))
+                    pchild.reset();
+            }
+            if (pchild) {
+                LogPrintf("%s: Processing out of order child %s of %s\n", __func__, pchild->GetHash().ToString(),
+                        head.ToString());
+                CValidationState dummy;
+                if (ProcessNewBlock(dummy, NULL, pchild.get(), it->second.fHavePos ? &it->second.pos : NULL))
+                {
+                    nLoaded++;
+                    queue.push_back(pchild->GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+        }
+    }
+    return true;
+}
+
+} // anon namespace
+
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
+    // This thread locates and reads the blocks in batches. The -par threads
+    // deserialize a batch and run the context-free checks (PoW, merkle root,
+    // transactions) on it while the previous batch is connected here, which
+    // has to stay serial.
+    std::deque<CImportedBlock> vBatch, vNextBatch;
+    CCheckQueue<CImportCheck> importqueue(4);
+    boost::thread_group importThreads;
+    for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        importThreads.create_thread(boost::bind(&ThreadImportCheck, &importqueue));
+    CImportQueueGuard guard(importqueue, importThreads);
+
     int nLoaded = 0;
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
-
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
-                    continue;
-            } catch (const std::exception &) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, dbp))
-                        nLoaded++;
-                    if (state.IsError())
+        bool fMore = ReadImportBatch(blkdat, nRewind, dbp, vBatch);
+        QueueImportChecks(importqueue, vBatch);
+        while (!vBatch.empty()) {
+            vNextBatch.clear();
+            if (fMore)
+                fMore = ReadImportBatch(blkdat, nRewind, dbp, vNextBatch);
+            WaitForImportChecks(importqueue);
+            QueueImportChecks(importqueue, vNextBatch);
+
+            bool fAbort = false;
+            BOOST_FOREACH(CImportedBlock& imported, vBatch) {
+                boost::this_thread::interruption_point();
+                try {
+                    if (!ProcessImportedBlock(imported, nLoaded)) {
+                        fAbort = true;
                         break;
-                } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
-
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second))
-                        {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                    head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, NULL, &block, &it->second))
-                            {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
                     }
+                } catch (std::exception &e) {
+                    LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
                 }
-            } catch (std::exception &e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
+            if (fAbort)
+                break;
+            // the elements being checked keep their addresses
+            vBatch.swap(vNextBatch);
         }
     } catch(std::runtime_error &e) {
         AbortNode(std::string("System error: ") + e.what());
@@ -3834,9 +4366,109 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
     return nLoaded > 0;
 }
 
+void SyncBlockFilterIndex()
+{
+    if (!pblockfilterdb)
+        return;
+
+    CBlockIndex* pindex = NULL;
+    {
+        LOCK(cs_main);
+        uint256 hashBest;
+        if (pblockfilterdb->ReadBestBlock(hashBest) && mapBlockIndex.count(hashBest))
+            pindex = chainActive.Next(chainActive.FindFork(mapBlockIndex[hashBest]));
+        else
+            pindex = chainActive.Genesis();
+    }
+    if (!pindex)
+        return;
+
+    LogPrintf("Building block filters from height %d\n", pindex->nHeight);
+    int64_t nStart = GetTimeMillis();
+    int nBuilt = 0;
+    CBlockIndex* pindexLast = NULL;
+    while (pindex)
+    {
+        boost::this_thread::interruption_point();
+
+        // blocks connected from now on get their filter in ConnectBlock
+        if (!pblockfilterdb->HaveFilter(pindex->GetBlockHash())) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex)) {
+                LogPrintf("%s : cannot read block %s\n", __func__, pindex->GetBlockHash().ToString());
+                break;
+            }
+            if (!pblockfilterdb->WriteFilter(CBlockFilter(block)))
+                break;
+            nBuilt++;
+        }
+        pindexLast = pindex;
+        if (pindex->nHeight % 10000 == 0)
+            pblockfilterdb->WriteBestBlock(pindex->GetBlockHash());
+
+        LOCK(cs_main);
+        pindex = chainActive.Next(chainActive.Contains(pindexLast) ? pindexLast : chainActive.FindFork(pindexLast));
+    }
+
+    if (pindexLast)
+        pblockfilterdb->WriteBestBlock(pindexLast->GetBlockHash());
+    LogPrintf("Built %d block filters up to height %d in %dms\n", nBuilt, pindexLast ? pindexLast->nHeight : -1, GetTimeMillis() - nStart);
+}
+
+void SyncAuxPowIndex()
+{
+    if (!fAuxPowIndex)
+        return;
+
+    CBlockIndex* pindex = NULL;
+    {
+        LOCK(cs_main);
+        uint256 hashBest;
+        if (pblocktree->ReadAuxPowBestBlock(hashBest) && mapBlockIndex.count(hashBest))
+            pindex = chainActive.Next(chainActive.FindFork(mapBlockIndex[hashBest]));
+        else
+            pindex = chainActive.Genesis();
+    }
+    if (!pindex)
+        return;
+
+    LogPrintf("Indexing auxpow headers from height %d\n", pindex->nHeight);
+    int64_t nStart = GetTimeMillis();
+    int nWritten = 0;
+    CBlockIndex* pindexLast = NULL;
+    while (pindex)
+    {
+        boost::this_thread::interruption_point();
+
+        // headers accepted from now on get their record in AcceptBlockHeader,
+        // pruned blocks can't be indexed anymore
+        if (pindex->nVersion.IsAuxpow() && (pindex->nStatus & BLOCK_HAVE_DATA) && !pblocktree->HaveAuxPow(pindex->GetBlockHash())) {
+            CBlockHeader header;
+            if (!ReadBlockHeaderFromDisk(header, pindex) || !header.auxpow) {
+                LogPrintf("%s : cannot read auxpow of block %s\n", __func__, pindex->GetBlockHash().ToString());
+                break;
+            }
+            if (!pblocktree->WriteAuxPow(pindex->GetBlockHash(), *header.auxpow))
+                break;
+            nWritten++;
+        }
+        pindexLast = pindex;
+        if (pindex->nHeight % 10000 == 0)
+            pblocktree->WriteAuxPowBestBlock(pindex->GetBlockHash());
+
+        LOCK(cs_main);
+        pindex = chainActive.Next(chainActive.Contains(pindexLast) ? pindexLast : chainActive.FindFork(pindexLast));
+    }
+
+    if (pindexLast)
+        pblocktree->WriteAuxPowBestBlock(pindexLast->GetBlockHash());
+    LogPrintf("Indexed %d auxpow headers up to height %d in %dms\n", nWritten, pindexLast ? pindexLast->nHeight : -1, GetTimeMillis() - nStart);
+}
+
 void static CheckBlockIndex()
 {
-    if (!fCheckBlockIndex) {
+    // the checks below assume that block data is never deleted
+    if (!fCheckBlockIndex || fHavePruned) {
         return;
     }
 
@@ -4055,8 +4687,11 @@ bool static AlreadyHave(const CInv& inv)
         {
             bool txInMap = false;
             txInMap = mempool.exists(inv.hash);
+            // Only the cache is checked for confirmed transactions, looking
+            // up their outputs on disk for every announcement is too slow
             return txInMap || mapOrphanTransactions.count(inv.hash) ||
-                pcoinsTip->HaveCoins(inv.hash);
+                pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) ||
+                pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
         }
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash);
@@ -4161,7 +4796,9 @@ void static ProcessGetData(CNode* pfrom)
                         }
                     }
                 }
-                if (send)
+                // Pruned nodes may have deleted the block, so check whether
+                // it's available before trying to send.
+                if (send && ((*mi).second->nStatus & BLOCK_HAVE_DATA))
                 {
                     // Send block from disk
                     CBlock block;
@@ -4185,7 +4822,7 @@ void static ProcessGetData(CNode* pfrom)
                             typedef std::pair<unsigned int, uint256> PairType;
                             BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
                                 if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
-                                    pfrom->PushMessage("tx", block.vtx[pair.first]);
+                                    pfrom->PushMessage("tx", *block.vtx[pair.first]);
                         }
                         // else
                             // no response
@@ -4208,23 +4845,19 @@ void static ProcessGetData(CNode* pfrom)
             {
                 // Send stream from relay memory
                 bool pushed = false;
-                {
+                if (inv.type == MSG_TX) {
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    map<uint256, CTransactionRef>::iterator mi = mapRelay.find(inv.hash);
                     if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                        pfrom->PushMessage("tx", *mi->second);
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_TX) {
-
-                    CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
-                        pfrom->PushMessage("tx", ss);
+                    CTransactionRef ptx = mempool.get(inv.hash);
+                    if (ptx) {
+                        pfrom->PushMessage("tx", *ptx);
                         pushed = true;
                     }
                 }
@@ -4240,12 +4873,12 @@ void static ProcessGetData(CNode* pfrom)
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    boost::optional<CTransaction> lockedTx = GetInstantSend().GetLockReq(inv.hash);
+                    CTransactionRef lockedTx = GetInstantSend().GetLockReq(inv.hash);
                     if (lockedTx)
                     {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << lockedTx.get();
+                        ss << *lockedTx;
                         pfrom->PushMessage("ix", ss);
                         pushed = true;
                     }
@@ -4710,6 +5343,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 LogPrint("net", "  getblocks stopping at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
                 break;
             }
+            // If pruning, don't inv blocks unless we have on disk and are likely to still have
+            // for some reasonable time window (1 hour) that block relay might require.
+            const int nPrunedBlocksLikelyToHave = MIN_BLOCKS_TO_KEEP - 3600 / Params().TargetSpacing();
+            if (fPruneMode && (!(pindex->nStatus & BLOCK_HAVE_DATA) || pindex->nHeight <= chainActive.Tip()->nHeight - nPrunedBlocksLikelyToHave))
+            {
+                LogPrint("net", " getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                break;
+            }
             pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
             if (--nLimit <= 0)
             {
@@ -4769,14 +5410,15 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     {
         vector<uint256> vWorkQueue;
         vector<uint256> vEraseQueue;
-        CTransaction tx;
+        CTransactionRef ptx;
 
         //masternode signed transaction
         bool ignoreFees = false;
         CTxIn vin;
         vector<unsigned char> vchSig;
 
-        vRecv >> tx;
+        vRecv >> ptx;
+        const CTransaction& tx = *ptx;
 
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
@@ -4788,7 +5430,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         mapAlreadyAskedFor.erase(inv);
 
-        if (AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, false, ignoreFees))
+        if (AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, false, ignoreFees))
         {
             mempool.check(pcoinsTip);
             RelayTransaction(tx);
@@ -4857,6 +5499,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
             // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
             unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            // While the mempool is evicting, the missing parents are unlikely to
+            // get in and the orphans take memory from it, so keep fewer of them
+            if (mempool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000) > ::minRelayTxFee)
+                nMaxOrphanTx /= 4;
             unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
             if (nEvicted > 0)
                 LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
@@ -5213,6 +5859,33 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     return true;
 }
 
+namespace {
+
+// Messages are processed by -msghandlerthreads threads. Most messages need the
+// whole node state, they take csMessageProcessing exclusively and are processed
+// one at a time like with a single thread. The messages which have a lock from
+// GetMessageGroupLock() only touch masternode state that has its own locks, they
+// take csMessageProcessing shared and run concurrently with the messages of
+// the other groups. Budget votes check the masternode list, so they share the
+// masternode group instead of having one of their own.
+CCriticalSection cs_msgGroupMasternode;
+CCriticalSection cs_msgGroupSystemnode;
+CCriticalSection cs_msgGroupInstantSend;
+
+CCriticalSection* GetMessageGroupLock(const std::string& strCommand)
+{
+    if (strCommand == "mnp" || strCommand == "mnw" ||
+        strCommand == "mvote" || strCommand == "fbvote")
+        return &cs_msgGroupMasternode;
+    if (strCommand == "snp" || strCommand == "snw")
+        return &cs_msgGroupSystemnode;
+    if (strCommand == "txlvote")
+        return &cs_msgGroupInstantSend;
+    return NULL;
+}
+
+} // anon namespace
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -5230,7 +5903,10 @@ bool ProcessMessages(CNode* pfrom)
     bool fOk = true;
 
     if (!pfrom->vRecvGetData.empty())
+    {
+        boost::unique_lock<boost::shared_mutex> lock(csMessageProcessing);
         ProcessGetData(pfrom);
+    }
 
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
@@ -5290,7 +5966,18 @@ bool ProcessMessages(CNode* pfrom)
         bool fRet = false;
         try
         {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            CCriticalSection* pcsGroup = GetMessageGroupLock(strCommand);
+            if (pcsGroup)
+            {
+                boost::shared_lock<boost::shared_mutex> lock(csMessageProcessing);
+                LOCK(*pcsGroup);
+                fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            }
+            else
+            {
+                boost::unique_lock<boost::shared_mutex> lock(csMessageProcessing);
+                fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            }
             boost::this_thread::interruption_point();
         }
         catch (std::ios_base::failure& e)
@@ -369,6 +369,7 @@ bool CBudgetManager::AddProposal(const CBudgetProposal& budgetProposal, bool che
     }
 
     mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal));
+    InvalidateBudgetCache();
     return true;
 }
 
@@ -410,6 +411,7 @@ void CBudgetManager::CheckAndRemove()
         pbudgetProposal->fValid = pbudgetProposal->IsValid(strError);
         ++it2;
     }
+    InvalidateBudgetCache();
 
     LogPrintf("CBudgetManager::CheckAndRemove - PASSED\n");
 }
@@ -494,6 +496,23 @@ CBudgetProposal* CBudgetManager::FindProposal(const std::string &strProposalName
     return pbudgetProposal;
 }
 
+int64_t CBudgetManager::GetOldestCollateralTime() const
+{
+    // called with cs_main held, while the budget code takes cs first
+    TRY_LOCK(cs, fBudget);
+    if (!fBudget)
+        return -1;
+
+    int64_t nOldest = 0;
+    for (std::map<uint256, CBudgetProposal>::const_iterator it = mapProposals.begin(); it != mapProposals.end(); ++it)
+    {
+        int64_t nTime = it->second.nTime;
+        if (nTime > 0 && (nOldest == 0 || nTime < nOldest))
+            nOldest = nTime;
+    }
+    return nOldest;
+}
+
 CBudgetProposal *CBudgetManager::FindProposal(uint256 nHash)
 {
     LOCK(cs);
@@ -579,6 +598,16 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 {
     LOCK(cs);
 
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    if(pindexPrev == NULL) return std::vector<CBudgetProposal*>();
+
+    // The ranking only changes with the votes, the proposals, the height and the
+    // number of enabled masternodes. Proposals that become established between
+    // two blocks are picked up at the next height.
+    const int nEnabled = mnodeman.CountEnabled(MIN_BUDGET_PEER_PROTO_VERSION);
+    if(nBudgetCacheHeight == pindexPrev->nHeight && nBudgetCacheEnabled == nEnabled)
+        return vecBudgetCache;
+
     // ------- Sort budgets by Yes Count
 
     std::vector<std::pair<CBudgetProposal*, int> > vBudgetPorposalsSort;
@@ -597,9 +626,6 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
     std::vector<CBudgetProposal*> vBudgetProposalsRet;
 
     CAmount nBudgetAllocated = 0;
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    if(pindexPrev == NULL) return vBudgetProposalsRet;
-
     const int blockStart = GetNextSuperblock(pindexPrev->nHeight);
     const int blockEnd  =  blockStart + GetBudgetPaymentCycleBlocks() - 1;
     CAmount totalBudget = GetTotalBudget(blockStart);
@@ -613,7 +639,7 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
         //prop start/end should be inside this period
         if(pbudgetProposal->fValid && pbudgetProposal->nBlockStart <= blockStart &&
                 pbudgetProposal->nBlockEnd >= blockEnd &&
-                pbudgetProposal->GetYeas() - pbudgetProposal->GetNays() > mnodeman.CountEnabled(MIN_BUDGET_PEER_PROTO_VERSION)/10 && 
+                pbudgetProposal->GetYeas() - pbudgetProposal->GetNays() > nEnabled/10 &&
                 pbudgetProposal->IsEstablished())
         {
             if(pbudgetProposal->GetAmount() + nBudgetAllocated <= totalBudget) {
@@ -628,6 +654,10 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
         ++it2;
     }
 
+    vecBudgetCache = vBudgetProposalsRet;
+    nBudgetCacheHeight = pindexPrev->nHeight;
+    nBudgetCacheEnabled = nEnabled;
+
     return vBudgetProposalsRet;
 }
 
@@ -1170,7 +1200,11 @@ bool CBudgetManager::SubmitProposalVote(const CBudgetVote& vote, std::string& st
     }
 
     DebugLogBudget(vote, CAddress(), "VA");
-    return proposal.AddOrUpdateVote(vote, strError);
+    if (!proposal.AddOrUpdateVote(vote, strError))
+        return false;
+
+    InvalidateBudgetCache();
+    return true;
 }
 
 bool CBudgetManager::CanSubmitVotes(int blockStart, int blockEnd) const
@@ -1226,6 +1260,8 @@ bool CBudgetManager::ReceiveProposalVote(const CBudgetVote &vote, CNode *pfrom,
     if(!proposal.AddOrUpdateVote(vote, strError))
         return false;
 
+    InvalidateBudgetCache();
+
     if (fMasterNode)
     {
         for (map<uint256, BudgetDraft>::iterator i = mapBudgetDrafts.begin(); i != mapBudgetDrafts.end(); ++i) {
@@ -1293,6 +1329,7 @@ CBudgetProposal::CBudgetProposal()
     nAmount = 0;
     nTime = 0;
     fValid = true;
+    RecountVotes();
 }
 
 CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strURLIn, int nBlockStartIn, int nBlockEndIn, CScript addressIn, CAmount nAmountIn, uint256 nFeeTXHashIn)
@@ -1305,6 +1342,7 @@ CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strU
     nAmount = nAmountIn;
     nFeeTXHash = nFeeTXHashIn;
     fValid = true;
+    RecountVotes();
 }
 
 CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
@@ -1318,6 +1356,11 @@ CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
     nTime = other.nTime;
     nFeeTXHash = other.nFeeTXHash;
     mapVotes = other.mapVotes;
+    nYeas = other.nYeas;
+    nNays = other.nNays;
+    nAbstains = other.nAbstains;
+    nYeasTotal = other.nYeasTotal;
+    nNaysTotal = other.nNaysTotal;
     fValid = true;
 }
 
@@ -1413,7 +1456,14 @@ bool CBudgetProposal::AddOrUpdateVote(const CBudgetVote& vote, std::string& strE
         return false;
     }        
 
-    mapVotes[hash] = vote;
+    std::map<uint256, CBudgetVote>::iterator found = mapVotes.find(hash);
+    if (found != mapVotes.end()) {
+        CountVote(found->second, -1);
+        found->second = vote;
+    } else {
+        found = mapVotes.insert(std::make_pair(hash, vote)).first;
+    }
+    CountVote(found->second, 1);
     return true;
 }
 
@@ -1423,62 +1473,61 @@ void CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
 
     while(it != mapVotes.end()) {
-        (*it).second.fValid = (*it).second.SignatureValid(fSignatureCheck);
+        bool fValidNow = (*it).second.SignatureValid(fSignatureCheck);
+        if (fValidNow != (*it).second.fValid) {
+            CountVote((*it).second, -1);
+            (*it).second.fValid = fValidNow;
+            CountVote((*it).second, 1);
+        }
         ++it;
     }
 }
 
-double CBudgetProposal::GetRatio() const
+void CBudgetProposal::CountVote(const CBudgetVote& vote, int nDelta)
 {
-    int yeas = 0;
-    int nays = 0;
-
-    for (std::map<uint256, CBudgetVote>::const_iterator i = mapVotes.begin(); i != mapVotes.end(); ++i) {
-        if (i->second.nVote == VOTE_YES)
-            ++yeas;
-        if (i->second.nVote == VOTE_NO)
-            ++nays;
+    if (vote.nVote == VOTE_YES) {
+        nYeasTotal += nDelta;
+        if (vote.fValid)
+            nYeas += nDelta;
+    } else if (vote.nVote == VOTE_NO) {
+        nNaysTotal += nDelta;
+        if (vote.fValid)
+            nNays += nDelta;
+    } else if (vote.nVote == VOTE_ABSTAIN) {
+        if (vote.fValid)
+            nAbstains += nDelta;
     }
+}
 
-    if(yeas + nays == 0) return 0.0f;
+void CBudgetProposal::RecountVotes()
+{
+    nYeas = nNays = nAbstains = 0;
+    nYeasTotal = nNaysTotal = 0;
 
-    return ((double)(yeas) / (double)(yeas+nays));
+    for (std::map<uint256, CBudgetVote>::const_iterator i = mapVotes.begin(); i != mapVotes.end(); ++i)
+        CountVote(i->second, 1);
 }
 
-int CBudgetProposal::GetYeas() const
+double CBudgetProposal::GetRatio() const
 {
-    int ret = 0;
+    if(nYeasTotal + nNaysTotal == 0) return 0.0f;
 
-    for (std::map<uint256, CBudgetVote>::const_iterator i = mapVotes.begin(); i != mapVotes.end(); ++i) {
-        if (i->second.nVote == VOTE_YES && i->second.fValid)
-            ++ret;
-    }
+    return ((double)(nYeasTotal) / (double)(nYeasTotal+nNaysTotal));
+}
 
-    return ret;
+int CBudgetProposal::GetYeas() const
+{
+    return nYeas;
 }
 
 int CBudgetProposal::GetNays() const
 {
-    int ret = 0;
-
-    for (std::map<uint256, CBudgetVote>::const_iterator i = mapVotes.begin(); i != mapVotes.end(); ++i) {
-        if (i->second.nVote == VOTE_NO && i->second.fValid)
-            ++ret;
-    }
-
-    return ret;
+    return nNays;
 }
 
 int CBudgetProposal::GetAbstains() const
 {
-    int ret = 0;
-
-    for (std::map<uint256, CBudgetVote>::const_iterator i = mapVotes.begin(); i != mapVotes.end(); ++i) {
-        if (i->second.nVote == VOTE_ABSTAIN && i->second.fValid)
-            ++ret;
-    }
-
-    return ret;
+    return nAbstains;
 }
 
 int CBudgetProposal::GetBlockStartCycle() const
@@ -64,6 +64,12 @@ private:
     //hold txes until they mature enough to use
     map<uint256, uint256> mapCollateralTxids;
 
+    // GetBudget() result, reused until a proposal or a vote changes or the
+    // chain height or the number of enabled masternodes is different
+    std::vector<CBudgetProposal*> vecBudgetCache;
+    int nBudgetCacheHeight;
+    int nBudgetCacheEnabled;
+
 public:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -83,6 +89,7 @@ public:
     {
         mapProposals.clear();
         mapBudgetDrafts.clear();
+        InvalidateBudgetCache();
     }
 
     void ClearSeen()
@@ -133,6 +140,11 @@ public:
     void CheckOrphanVotes();
     void CheckAndRemove();
 
+    // Block time of the oldest proposal fee transaction, 0 without proposals
+    // and -1 if it can not be told right now. The proposals are checked
+    // against their fee transactions again, so pruning has to keep them.
+    int64_t GetOldestCollateralTime() const;
+
     void Clear()
     {
         LOCK(cs);
@@ -146,6 +158,7 @@ public:
         mapSeenBudgetDraftVotes.clear();
         mapOrphanMasternodeBudgetVotes.clear();
         mapOrphanBudgetDraftVotes.clear();
+        InvalidateBudgetCache();
     }
 
     ADD_SERIALIZE_METHODS;
@@ -153,19 +166,28 @@ public:
     template<typename Stream, typename Operation>
     inline void SerializationOp(Stream &s, Operation ser_action, int nType, int nVersion)
     {
-        READWRITE(mapSeenMasternodeBudgetProposals);
-        READWRITE(mapSeenMasternodeBudgetVotes);
-        READWRITE(mapSeenBudgetDrafts);
-        READWRITE(mapSeenBudgetDraftVotes);
-        READWRITE(mapOrphanMasternodeBudgetVotes);
-        READWRITE(mapOrphanBudgetDraftVotes);
+        LOCK(cs);
+        // accepted proposals, drafts and votes also end up in mapProposals
+        // and mapBudgetDrafts, so the seen and orphan maps are left out of
+        // the hash that tells whether budget-v2.dat needs rewriting
+        if (!(nType & SER_GETHASH)) {
+            READWRITE(mapSeenMasternodeBudgetProposals);
+            READWRITE(mapSeenMasternodeBudgetVotes);
+            READWRITE(mapSeenBudgetDrafts);
+            READWRITE(mapSeenBudgetDraftVotes);
+            READWRITE(mapOrphanMasternodeBudgetVotes);
+            READWRITE(mapOrphanBudgetDraftVotes);
+        }
 
         READWRITE(mapProposals);
         READWRITE(mapBudgetDrafts);
+        if (ser_action.ForRead())
+            InvalidateBudgetCache();
     }
 
 private:
     const BudgetDraft *GetMostVotedBudget(int height) const;
+    void InvalidateBudgetCache() { nBudgetCacheHeight = -1; }
 };
 
 class CTxBudgetPayment
@@ -408,6 +430,19 @@ private:
     mutable CCriticalSection cs;
     CAmount nAlloted;
 
+    // running tallies of mapVotes: valid votes of each kind, and yes/no votes
+    // regardless of validity as used by GetRatio()
+    int nYeas;
+    int nNays;
+    int nAbstains;
+    int nYeasTotal;
+    int nNaysTotal;
+
+    void CountVote(const CBudgetVote& vote, int nDelta);
+
+protected:
+    void RecountVotes();
+
 public:
     bool fValid;
     std::string strProposalName;
@@ -497,6 +532,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            RecountVotes();
     }
 };
 
@@ -525,6 +562,8 @@ public:
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
         first.mapVotes.swap(second.mapVotes);
+        first.RecountVotes();
+        second.RecountVotes();
     }
 
     CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
@@ -45,20 +45,20 @@ bool IsBlockValueValid(const CBlock& block, int64_t nExpectedValue){
         if(nHeight % GetBudgetPaymentCycleBlocks() < 100){
             return true;
         } else {
-            if(block.vtx[0].GetValueOut() > nExpectedValue) return false;
+            if(block.vtx[0]->GetValueOut() > nExpectedValue) return false;
         }
     } else { // we're synced and have data so check the budget schedule
 
         //are these blocks even enabled
         if(!IsSporkActive(SPORK_13_ENABLE_SUPERBLOCKS)){
-            return block.vtx[0].GetValueOut() <= nExpectedValue;
+            return block.vtx[0]->GetValueOut() <= nExpectedValue;
         }
         
         if(budget.IsBudgetPaymentBlock(nHeight)){
             //the value of the block is evaluated in CheckBlock
             return true;
         } else {
-            if(block.vtx[0].GetValueOut() > nExpectedValue) return false;
+            if(block.vtx[0]->GetValueOut() > nExpectedValue) return false;
         }
     }
 
@@ -294,8 +294,9 @@ bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasterno
 
 bool CMasternodePayments::GetBlockPayee(int nBlockHeight, CScript& payee)
 {
-    if(mapMasternodeBlocks.count(nBlockHeight)){
-        return mapMasternodeBlocks[nBlockHeight].GetPayee(payee);
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    if(it != mapMasternodeBlocks.end()){
+        return it->second.GetPayee(payee);
     }
 
     return false;
@@ -318,13 +319,12 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
     mnpayee = GetScriptForDestination(mn.pubkey.GetID());
 
     CScript payee;
-    for(int64_t h = nHeight; h <= nHeight+8; h++){
-        if(h == nNotBlockHeight) continue;
-        if(mapMasternodeBlocks.count(h)){
-            if(mapMasternodeBlocks[h].GetPayee(payee)){
-                if(mnpayee == payee) {
-                    return true;
-                }
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.lower_bound(nHeight);
+    for(; it != mapMasternodeBlocks.end() && it->first <= nHeight+8; ++it){
+        if(it->first == nNotBlockHeight) continue;
+        if(it->second.GetPayee(payee)){
+            if(mnpayee == payee) {
+                return true;
             }
         }
     }
@@ -332,6 +332,98 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
     return false;
 }
 
+void CMasternodePayments::UpdateLastPaid(const CMasternodeBlockPayees& blockPayees)
+{
+    LOCK(cs_vecPayments);
+
+    BOOST_FOREACH(const CMasternodePayee& payee, blockPayees.vecPayments){
+        if(payee.nVotes < MNPAYMENTS_LASTPAID_VOTES_REQUIRED) continue;
+
+        std::map<CScript, int>::iterator it = mapPayeeLastPaid.find(payee.scriptPubKey);
+        if(it == mapPayeeLastPaid.end()) {
+            mapPayeeLastPaid.insert(make_pair(payee.scriptPubKey, blockPayees.nBlockHeight));
+        } else if(it->second < blockPayees.nBlockHeight) {
+            it->second = blockPayees.nBlockHeight;
+        }
+    }
+}
+
+void CMasternodePayments::BlockConnected(int nBlockHeight)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    nLastPaidIndexHeight = nBlockHeight;
+
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    if(it != mapMasternodeBlocks.end()) {
+        UpdateLastPaid(it->second);
+    }
+}
+
+void CMasternodePayments::BlockDisconnected(int nBlockHeight)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    nLastPaidIndexHeight = nBlockHeight - 1;
+
+    // drop every payee that was last paid at or above the disconnected block ...
+    std::set<CScript> setStale;
+    std::map<CScript, int>::iterator it = mapPayeeLastPaid.begin();
+    while(it != mapPayeeLastPaid.end()) {
+        if(it->second >= nBlockHeight) {
+            setStale.insert(it->first);
+            mapPayeeLastPaid.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    if(setStale.empty()) return;
+
+    // ... and find the previous payment for them, newest blocks first
+    std::map<int, CMasternodeBlockPayees>::reverse_iterator rit(mapMasternodeBlocks.lower_bound(nBlockHeight));
+    for(; rit != mapMasternodeBlocks.rend() && !setStale.empty(); ++rit) {
+        LOCK(cs_vecPayments);
+        BOOST_FOREACH(const CMasternodePayee& payee, rit->second.vecPayments){
+            if(payee.nVotes < MNPAYMENTS_LASTPAID_VOTES_REQUIRED) continue;
+            if(setStale.erase(payee.scriptPubKey)) {
+                mapPayeeLastPaid[payee.scriptPubKey] = rit->first;
+            }
+        }
+    }
+}
+
+void CMasternodePayments::RebuildLastPaidIndex()
+{
+    int nHeight;
+    {
+        LOCK(cs_main);
+        if(chainActive.Tip() == NULL) return;
+        nHeight = chainActive.Tip()->nHeight;
+    }
+
+    LOCK(cs_mapMasternodeBlocks);
+
+    mapPayeeLastPaid.clear();
+    nLastPaidIndexHeight = nHeight;
+
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.begin();
+    for(; it != mapMasternodeBlocks.end() && it->first <= nHeight; ++it) {
+        UpdateLastPaid(it->second);
+    }
+
+    LogPrint("mnpayments", "CMasternodePayments::RebuildLastPaidIndex - %d payees indexed up to block %d\n", mapPayeeLastPaid.size(), nHeight);
+}
+
+int CMasternodePayments::GetLastPaidHeight(const CScript& payee)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    std::map<CScript, int>::const_iterator it = mapPayeeLastPaid.find(payee);
+    if(it == mapPayeeLastPaid.end()) return -1;
+
+    return it->second;
+}
+
 bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerIn)
 {
     uint256 blockHash = uint256();
@@ -347,6 +439,7 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
         }
 
         mapMasternodePayeeVotes[winnerIn.GetHash()] = winnerIn;
+        mapVotesByHeight[winnerIn.nBlockHeight].push_back(winnerIn.GetHash());
 
         if(!mapMasternodeBlocks.count(winnerIn.nBlockHeight)){
            CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
@@ -358,6 +451,14 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
     if(IsReferenceNode(winnerIn.vinMasternode)) n = 100;
     mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, n);
 
+    {
+        // late votes for blocks we already have can still make a payee count as paid
+        LOCK(cs_mapMasternodeBlocks);
+        if(winnerIn.nBlockHeight <= nLastPaidIndexHeight) {
+            UpdateLastPaid(mapMasternodeBlocks[winnerIn.nBlockHeight]);
+        }
+    }
+
     return true;
 }
 
@@ -434,8 +535,9 @@ std::string CMasternodePayments::GetRequiredPaymentsString(int nBlockHeight)
 {
     LOCK(cs_mapMasternodeBlocks);
 
-    if(mapMasternodeBlocks.count(nBlockHeight)){
-        return mapMasternodeBlocks[nBlockHeight].GetRequiredPaymentsString();
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    if(it != mapMasternodeBlocks.end()){
+        return it->second.GetRequiredPaymentsString();
     }
 
     return "Unknown";
@@ -445,8 +547,9 @@ bool CMasternodePayments::IsTransactionValid(const CTransaction& txNew, int nBlo
 {
     LOCK(cs_mapMasternodeBlocks);
 
-    if(mapMasternodeBlocks.count(nBlockHeight)){
-        return mapMasternodeBlocks[nBlockHeight].IsTransactionValid(txNew);
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    if(it != mapMasternodeBlocks.end()){
+        return it->second.IsTransactionValid(txNew);
     }
 
     return true;
@@ -466,21 +569,46 @@ void CMasternodePayments::CheckAndRemove()
     //keep up to five cycles for historical sake
     int nLimit = std::max(int(mnodeman.size()*1.25), 1000);
 
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
-    while(it != mapMasternodePayeeVotes.end()) {
-        CMasternodePaymentWinner winner = (*it).second;
+    RemoveVotesBelow(nHeight - nLimit);
 
-        if(nHeight - winner.nBlockHeight > nLimit){
-            LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
-            masternodeSync.mapSeenSyncMNW.erase((*it).first);
-            mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
+    std::map<CScript, int>::iterator it2 = mapPayeeLastPaid.begin();
+    while(it2 != mapPayeeLastPaid.end()) {
+        if(nHeight - (*it2).second > nLimit) {
+            mapPayeeLastPaid.erase(it2++);
         } else {
-            ++it;
+            ++it2;
         }
     }
 }
 
+void CMasternodePayments::RemoveVotesBelow(int nBlockHeight)
+{
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+
+    std::map<int, std::vector<uint256> >::iterator it = mapVotesByHeight.begin();
+    while(it != mapVotesByHeight.end() && it->first < nBlockHeight) {
+        LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payments - block %d\n", it->first);
+        BOOST_FOREACH(const uint256& hash, it->second) {
+            masternodeSync.mapSeenSyncMNW.erase(hash);
+            mapMasternodePayeeVotes.erase(hash);
+        }
+        mapVotesByHeight.erase(it++);
+    }
+
+    mapMasternodeBlocks.erase(mapMasternodeBlocks.begin(), mapMasternodeBlocks.lower_bound(nBlockHeight));
+}
+
+void CMasternodePayments::RebuildVotesByHeight()
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+
+    mapVotesByHeight.clear();
+    std::map<uint256, CMasternodePaymentWinner>::const_iterator it = mapMasternodePayeeVotes.begin();
+    for(; it != mapMasternodePayeeVotes.end(); ++it) {
+        mapVotesByHeight[it->second.nBlockHeight].push_back(it->first);
+    }
+}
+
 bool IsReferenceNode(CTxIn& vin)
 {
     //reference node - hybrid mode
@@ -654,14 +782,12 @@ void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
     if(nCountNeeded > nCount) nCountNeeded = nCount;
 
     int nInvCount = 0;
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
-    while(it != mapMasternodePayeeVotes.end()) {
-        CMasternodePaymentWinner winner = (*it).second;
-        if(winner.nBlockHeight >= nHeight-nCountNeeded && winner.nBlockHeight <= nHeight + 20) {
-            node->PushInventory(CInv(MSG_MASTERNODE_WINNER, winner.GetHash()));
+    std::map<int, std::vector<uint256> >::const_iterator it = mapVotesByHeight.lower_bound(nHeight - nCountNeeded);
+    for(; it != mapVotesByHeight.end() && it->first <= nHeight + 20; ++it) {
+        BOOST_FOREACH(const uint256& hash, it->second) {
+            node->PushInventory(CInv(MSG_MASTERNODE_WINNER, hash));
             nInvCount++;
         }
-        ++it;
     }
     node->PushMessage("ssc", MASTERNODE_SYNC_MNW, nInvCount);
 }
@@ -682,17 +808,9 @@ int CMasternodePayments::GetOldestBlock()
 {
     LOCK(cs_mapMasternodeBlocks);
 
-    int nOldestBlock = std::numeric_limits<int>::max();
-
-    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.begin();
-    while(it != mapMasternodeBlocks.end()) {
-        if((*it).first < nOldestBlock) {
-            nOldestBlock = (*it).first;
-        }
-        it++;
-    }
+    if(mapMasternodeBlocks.empty()) return std::numeric_limits<int>::max();
 
-    return nOldestBlock;
+    return mapMasternodeBlocks.begin()->first;
 }
 
 
@@ -701,15 +819,7 @@ int CMasternodePayments::GetNewestBlock()
 {
     LOCK(cs_mapMasternodeBlocks);
 
-    int nNewestBlock = 0;
-
-    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.begin();
-    while(it != mapMasternodeBlocks.end()) {
-        if((*it).first > nNewestBlock) {
-            nNewestBlock = (*it).first;
-        }
-        it++;
-    }
+    if(mapMasternodeBlocks.empty()) return 0;
 
-    return nNewestBlock;
+    return std::max(mapMasternodeBlocks.rbegin()->first, 0);
 }
@@ -25,6 +25,7 @@ extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED           6
 #define MNPAYMENTS_SIGNATURES_TOTAL              10
+#define MNPAYMENTS_LASTPAID_VOTES_REQUIRED       2
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsReferenceNode(CTxIn& vin);
@@ -199,6 +200,20 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // payee -> last height (not above the active tip) where it had enough votes to be paid,
+    // derived from mapMasternodeBlocks so GetLastPaid doesn't have to walk the chain
+    std::map<CScript, int> mapPayeeLastPaid;
+    // height of the active tip the last paid index was built for
+    int nLastPaidIndexHeight;
+
+    void UpdateLastPaid(const CMasternodeBlockPayees& blockPayees);
+
+    // hashes of mapMasternodePayeeVotes by block height, so that syncing a range
+    // of heights and pruning old ones don't have to walk all the votes
+    std::map<int, std::vector<uint256> > mapVotesByHeight;
+
+    void RebuildVotesByHeight();
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -207,12 +222,15 @@ public:
     CMasternodePayments() {
         nSyncedFromPeer = 0;
         nLastBlockHeight = 0;
+        nLastPaidIndexHeight = 0;
     }
 
     void Clear() {
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapVotesByHeight.clear();
+        mapPayeeLastPaid.clear();
     }
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
@@ -220,12 +238,21 @@ public:
 
     void Sync(CNode* node, int nCountNeeded);
     void CheckAndRemove();
+    /// Forget the votes and payees for blocks below nBlockHeight
+    void RemoveVotesBelow(int nBlockHeight);
     int LastPayment(CMasternode& mn);
 
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     bool IsScheduled(CMasternode& mn, int nNotBlockHeight);
 
+    /// Last paid index maintenance, called when the active tip changes
+    void BlockConnected(int nBlockHeight);
+    void BlockDisconnected(int nBlockHeight);
+    void RebuildLastPaidIndex();
+    /// Last height at which payee was voted to be paid or -1 if it's not in the index
+    int GetLastPaidHeight(const CScript& payee);
+
     bool CanVote(COutPoint outMasternode, int nBlockHeight);
 
     int GetMinMasternodePaymentsProto();
@@ -240,8 +267,10 @@ public:
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
         READWRITE(mapMasternodePayeeVotes);
         READWRITE(mapMasternodeBlocks);
+        if(ser_action.ForRead()) RebuildVotesByHeight();
     }
 };
 
@@ -74,6 +74,7 @@ CMasternode::CMasternode()
     nScanningErrorCount = 0;
     nLastScanningErrorBlockHeight = 0;
     lastTimeChecked = 0;
+    nCollateralHeight = -1;
 }
 
 CMasternode::CMasternode(const CMasternode& other)
@@ -96,6 +97,8 @@ CMasternode::CMasternode(const CMasternode& other)
     nScanningErrorCount = other.nScanningErrorCount;
     nLastScanningErrorBlockHeight = other.nLastScanningErrorBlockHeight;
     lastTimeChecked = 0;
+    nCollateralHeight = other.nCollateralHeight;
+    collateralMinConfBlockHash = other.collateralMinConfBlockHash;
 }
 
 CMasternode::CMasternode(const CMasternodeBroadcast& mnb)
@@ -118,6 +121,7 @@ CMasternode::CMasternode(const CMasternodeBroadcast& mnb)
     nScanningErrorCount = 0;
     nLastScanningErrorBlockHeight = 0;
     lastTimeChecked = 0;
+    nCollateralHeight = -1;
 }
 
 //
@@ -153,10 +157,9 @@ arith_uint256 CMasternode::CalculateScore(int64_t nBlockHeight) const
         return arith_uint256();
 
     // Find the block hash where tx got MASTERNODE_MIN_CONFIRMATIONS
-    CBlockIndex *pblockIndex = chainActive[GetInputHeight(vin) + MASTERNODE_MIN_CONFIRMATIONS - 1];
-    if (!pblockIndex)
+    uint256 collateralMinConfBlockHash = uint256();
+    if(!GetCollateralMinConfBlockHash(collateralMinConfBlockHash))
         return arith_uint256();
-    uint256 collateralMinConfBlockHash = pblockIndex->GetBlockHash();
 
     uint256 hash = uint256();
 
@@ -170,6 +173,47 @@ arith_uint256 CMasternode::CalculateScore(int64_t nBlockHeight) const
     return UintToArith256(ss.GetHash());
 }
 
+//
+// The collateral is looked up in the coins view only until it gets MASTERNODE_MIN_CONFIRMATIONS,
+// after that the cached block hash is enough to notice a reorg that moved or removed it
+//
+void CMasternode::UpdateCollateral() const
+{
+    LOCK(cs);
+
+    if(!collateralMinConfBlockHash.IsNull()) {
+        CBlockIndex* pindex = chainActive[nCollateralHeight + MASTERNODE_MIN_CONFIRMATIONS - 1];
+        if(pindex && pindex->GetBlockHash() == collateralMinConfBlockHash) return;
+    }
+
+    nCollateralHeight = -1;
+    collateralMinConfBlockHash = uint256();
+
+    int nHeight = GetInputHeight(vin);
+    if(nHeight < 0 || nHeight == (int)MEMPOOL_HEIGHT) return;
+
+    nCollateralHeight = nHeight;
+    CBlockIndex* pindex = chainActive[nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1];
+    if(pindex) collateralMinConfBlockHash = pindex->GetBlockHash();
+}
+
+int CMasternode::GetCollateralHeight() const
+{
+    LOCK(cs);
+    UpdateCollateral();
+    return nCollateralHeight;
+}
+
+bool CMasternode::GetCollateralMinConfBlockHash(uint256& hash) const
+{
+    LOCK(cs);
+    UpdateCollateral();
+    if(collateralMinConfBlockHash.IsNull()) return false;
+
+    hash = collateralMinConfBlockHash;
+    return true;
+}
+
 void CMasternode::Check(bool forceCheck)
 {
     if(ShutdownRequested()) return;
@@ -205,6 +249,10 @@ void CMasternode::Check(bool forceCheck)
 
             if(!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)){
                 activeState = MASTERNODE_VIN_SPENT;
+                // the collateral is gone, don't use the cached blocks anymore
+                LOCK(cs);
+                nCollateralHeight = -1;
+                collateralMinConfBlockHash = uint256();
                 return;
 
             }
@@ -221,12 +269,12 @@ bool CMasternode::IsValidNetAddr() const
     return (addr.IsIPv4() && addr.IsRoutable());
 }
 
-int64_t CMasternode::SecondsSincePayment() const
+int64_t CMasternode::SecondsSincePayment(int nMnCount) const
 {
     CScript pubkeyScript;
     pubkeyScript = GetScriptForDestination(pubkey.GetID());
 
-    int64_t sec = (GetAdjustedTime() - GetLastPaid());
+    int64_t sec = (GetAdjustedTime() - GetLastPaid(nMnCount));
     int64_t month = 60*60*24*30;
     if(sec < month) return sec; //if it's less than 30 days, give seconds
 
@@ -239,7 +287,7 @@ int64_t CMasternode::SecondsSincePayment() const
     return month + UintToArith256(hash).GetCompact(false);
 }
 
-int64_t CMasternode::GetLastPaid() const
+int64_t CMasternode::GetLastPaid(int nMnCount) const
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
     if(pindexPrev == NULL) return false;
@@ -255,33 +303,21 @@ int64_t CMasternode::GetLastPaid() const
     // use a deterministic offset to break a tie -- 2.5 minutes
     int64_t nOffset = UintToArith256(hash).GetCompact(false) % 150; 
 
-    if (chainActive.Tip() == NULL) return false;
-
-    const CBlockIndex *BlockReading = chainActive.Tip();
-
-    int nMnCount = mnodeman.CountEnabled()*1.25;
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if(n >= nMnCount){
-            return 0;
-        }
-        n++;
+    /*
+        Search for this payee, with at least 2 votes. This will aid in consensus allowing the network 
+        to converge on the same payees quickly, then keep the same schedule.
+    */
+    int nLastPaidHeight = masternodePayments.GetLastPaidHeight(mnpayee);
+    if(nLastPaidHeight <= 0 || nLastPaidHeight > pindexPrev->nHeight) return 0;
 
-        if(masternodePayments.mapMasternodeBlocks.count(BlockReading->nHeight)){
-            /*
-                Search for this payee, with at least 2 votes. This will aid in consensus allowing the network 
-                to converge on the same payees quickly, then keep the same schedule.
-            */
-            if(masternodePayments.mapMasternodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2)){
-                return BlockReading->nTime + nOffset;
-            }
-        }
+    // only look as far back as the size of the payment queue
+    int nQueueSize = nMnCount*1.25;
+    if(pindexPrev->nHeight - nLastPaidHeight >= nQueueSize) return 0;
 
-        if (BlockReading->pprev == NULL) { assert(BlockReading); break; }
-        BlockReading = BlockReading->pprev;
-    }
+    const CBlockIndex *pindexPaid = chainActive[nLastPaidHeight];
+    if(pindexPaid == NULL) return 0;
 
-    return 0;
+    return pindexPaid->nTime + nOffset;
 }
 
 CMasternodeBroadcast::CMasternodeBroadcast()
@@ -550,7 +586,7 @@ bool CMasternodeBroadcast::CheckAndUpdate(int& nDos) const
     if(pmn->pubkey == pubkey && !pmn->IsBroadcastedWithin(MASTERNODE_MIN_MNB_SECONDS)) {
         //take the newest entry
         LogPrintf("mnb - Got updated entry for %s\n", addr.ToString());
-        if(pmn->UpdateFromNewBroadcast((*this))){
+        if(mnodeman.UpdateFromNewBroadcast(pmn, *this)){
             pmn->Check();
             if(pmn->IsEnabled()) Relay();
         }
@@ -617,11 +653,19 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS) const
     // should be at least not earlier than block when 10000 CRW tx got MASTERNODE_MIN_CONFIRMATIONS
     uint256 hashBlock = uint256();
     CTransaction tx2;
-    GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi != mapBlockIndex.end() && (*mi).second)
+    CBlockIndex* pMNIndex = NULL; // block for 10000 CRW tx -> 1 confirmation
+    if (GetTransaction(vin.prevout.hash, tx2, hashBlock, true)) {
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi != mapBlockIndex.end())
+            pMNIndex = (*mi).second;
+    } else if (fPruneMode) {
+        // the collateral block may be pruned, the coins still know its height
+        int nHeight = GetInputHeight(vin);
+        if (nHeight > 0 && nHeight != MEMPOOL_HEIGHT)
+            pMNIndex = chainActive[nHeight];
+    }
+    if (pMNIndex)
     {
-        CBlockIndex* pMNIndex = (*mi).second; // block for 10000 CRW tx -> 1 confirmation
         CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
         if(pConfIndex->GetBlockTime() > sigTime)
         {
@@ -633,6 +677,7 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS) const
 
     LogPrintf("mnb - Got NEW Masternode entry - %s - %s - %s - %lli \n", GetHash().ToString(), addr.ToString(), vin.ToString(), sigTime);
     CMasternode mn(*this);
+    mn.UpdateCollateral();
     mnodeman.Add(mn);
 
     // if it matches our Masternode privkey, then we've been remotely activated
@@ -797,18 +842,22 @@ bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fChec
                 return false;
             }
 
-            pmn->lastPing = *this;
+            {
+                // the masternode list is read under mnodeman.cs by the other message handler threads
+                LOCK(mnodeman.cs);
+                pmn->lastPing = *this;
+
+                //mnodeman.mapSeenMasternodeBroadcast.lastPing is probably outdated, so we'll update it
+                CMasternodeBroadcast mnb(*pmn);
+                uint256 hash = mnb.GetHash();
+                if(mnodeman.mapSeenMasternodeBroadcast.count(hash)) {
+                    mnodeman.mapSeenMasternodeBroadcast[hash].lastPing = *this;
+                }
 
-            //mnodeman.mapSeenMasternodeBroadcast.lastPing is probably outdated, so we'll update it
-            CMasternodeBroadcast mnb(*pmn);
-            uint256 hash = mnb.GetHash();
-            if(mnodeman.mapSeenMasternodeBroadcast.count(hash)) {
-                mnodeman.mapSeenMasternodeBroadcast[hash].lastPing = *this;
+                pmn->Check(true);
+                if(!pmn->IsEnabled()) return false;
             }
 
-            pmn->Check(true);
-            if(!pmn->IsEnabled()) return false;
-
             LogPrint("masternode", "CMasternodePing::CheckAndUpdate - Masternode ping accepted, vin: %s\n", vin.ToString());
 
             Relay();
@@ -110,6 +110,10 @@ private:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
     int64_t lastTimeChecked;
+    // height of the block with the collateral and the block where it got MASTERNODE_MIN_CONFIRMATIONS,
+    // cached so that score and age calculations don't have to look the collateral up in the coins view
+    mutable int nCollateralHeight;
+    mutable uint256 collateralMinConfBlockHash;
 public:
     enum state
     {
@@ -165,6 +169,8 @@ public:
         swap(first.nLastDsq, second.nLastDsq);
         swap(first.nScanningErrorCount, second.nScanningErrorCount);
         swap(first.nLastScanningErrorBlockHeight, second.nLastScanningErrorBlockHeight);
+        swap(first.nCollateralHeight, second.nCollateralHeight);
+        swap(first.collateralMinConfBlockHash, second.collateralMinConfBlockHash);
     }
 
     CMasternode& operator=(CMasternode from)
@@ -208,7 +214,7 @@ public:
             READWRITE(nLastScanningErrorBlockHeight);
     }
 
-    int64_t SecondsSincePayment() const;
+    int64_t SecondsSincePayment(int nMnCount) const;
     bool UpdateFromNewBroadcast(const CMasternodeBroadcast& mnb);
     void Check(bool forceCheck = false);
 
@@ -243,14 +249,22 @@ public:
     {
         if(chainActive.Tip() == NULL) return 0;
 
-        if(cacheInputAge == 0){
-            cacheInputAge = GetInputAge(vin);
-            cacheInputAgeBlock = chainActive.Tip()->nHeight;
-        }
+        int nHeight = GetCollateralHeight();
+        if(nHeight < 0) return 0;
 
-        return cacheInputAge+(chainActive.Tip()->nHeight-cacheInputAgeBlock);
+        cacheInputAge = (chainActive.Tip()->nHeight + 1) - nHeight;
+        cacheInputAgeBlock = chainActive.Tip()->nHeight;
+
+        return cacheInputAge;
     }
 
+    /// Look the collateral up unless the cached blocks are still in the active chain
+    void UpdateCollateral() const;
+    /// Height of the block with the collateral, -1 if it's unconfirmed or spent
+    int GetCollateralHeight() const;
+    /// Hash of the block where the collateral got MASTERNODE_MIN_CONFIRMATIONS
+    bool GetCollateralMinConfBlockHash(uint256& hash) const;
+
     std::string Status() const
     {
         std::string strStatus = "ACTIVE";
@@ -264,7 +278,9 @@ public:
         return strStatus;
     }
 
-    int64_t GetLastPaid() const;
+    /// Time of the last payment, nMnCount is the number of enabled masternodes which
+    /// limits how far back a payment counts
+    int64_t GetLastPaid(int nMnCount) const;
 };
 
 //
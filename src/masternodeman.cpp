@@ -26,21 +26,12 @@ struct CompareLastPaid
     }
 };
 
-struct CompareScoreTxIn
-{
-    bool operator()(const pair<int64_t, CTxIn>& t1,
-                    const pair<int64_t, CTxIn>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 struct CompareScoreMN
 {
-    bool operator()(const pair<int64_t, CMasternode>& t1,
-                    const pair<int64_t, CMasternode>& t2) const
+    bool operator()(const pair<int64_t, CMasternode*>& t1,
+                    const pair<int64_t, CMasternode*>& t2) const
     {
-        return t1.first < t2.first;
+        return t1.first > t2.first;
     }
 };
 
@@ -60,6 +51,8 @@ bool CMasternodeMan::Add(const CMasternode &mn)
     {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.addr.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        AddToIndexes(vMasternodes.size() - 1);
+        mapScoresCache.clear();
         return true;
     }
 
@@ -99,6 +92,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     LOCK(cs);
 
     //remove inactive and outdated
+    bool fRemoved = false;
     vector<CMasternode>::iterator it = vMasternodes.begin();
     while(it != vMasternodes.end()){
         if((*it).activeState == CMasternode::MASTERNODE_REMOVE ||
@@ -131,11 +125,17 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vMasternodes.erase(it);
+            fRemoved = true;
         } else {
             ++it;
         }
     }
 
+    if(fRemoved) {
+        RebuildIndexes();
+        mapScoresCache.clear();
+    }
+
     // check who's asked for the Masternode list
     map<CNetAddr, int64_t>::iterator it1 = mAskedUsForMasternodeList.begin();
     while(it1 != mAskedUsForMasternodeList.end()){
@@ -194,6 +194,8 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    RebuildIndexes();
+    mapScoresCache.clear();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -204,6 +206,8 @@ void CMasternodeMan::Clear()
 
 int CMasternodeMan::CountEnabled(int protocolVersion)
 {
+    LOCK(cs);
+
     int i = 0;
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
@@ -241,27 +245,21 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
 CMasternode *CMasternodeMan::Find(const CScript &payee)
 {
     LOCK(cs);
-    CScript payee2;
 
-    BOOST_FOREACH(CMasternode& mn, vMasternodes)
-    {
-        payee2 = GetScriptForDestination(mn.pubkey.GetID());
-        if(payee2 == payee)
-            return &mn;
-    }
-    return NULL;
+    std::map<CScript, size_t>::const_iterator it = mapIndexByPayee.find(payee);
+    if(it == mapIndexByPayee.end()) return NULL;
+
+    return &vMasternodes[it->second];
 }
 
 CMasternode *CMasternodeMan::Find(const CTxIn &vin)
 {
     LOCK(cs);
 
-    BOOST_FOREACH(CMasternode& mn, vMasternodes)
-    {
-        if(mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    std::map<COutPoint, size_t>::const_iterator it = mapIndexByVin.find(vin.prevout);
+    if(it == mapIndexByVin.end()) return NULL;
+
+    return &vMasternodes[it->second];
 }
 
 
@@ -269,24 +267,44 @@ CMasternode *CMasternodeMan::Find(const CPubKey &pubKeyMasternode)
 {
     LOCK(cs);
 
-    BOOST_FOREACH(CMasternode& mn, vMasternodes)
-    {
-        if(mn.pubkey2 == pubKeyMasternode)
-            return &mn;
-    }
-    return NULL;
+    std::map<CPubKey, size_t>::const_iterator it = mapIndexByPubKey.find(pubKeyMasternode);
+    if(it == mapIndexByPubKey.end()) return NULL;
+
+    return &vMasternodes[it->second];
 }
 
 CMasternode *CMasternodeMan::Find(const CService& addr)
 {
     LOCK(cs);
 
-    BOOST_FOREACH(CMasternode& mn, vMasternodes)
-    {
-        if(mn.addr == addr)
-            return &mn;
-    }
-    return NULL;
+    std::map<CService, size_t>::const_iterator it = mapIndexByAddr.find(addr);
+    if(it == mapIndexByAddr.end()) return NULL;
+
+    return &vMasternodes[it->second];
+}
+
+void CMasternodeMan::AddToIndexes(size_t nIndex)
+{
+    AssertLockHeld(cs);
+
+    const CMasternode& mn = vMasternodes[nIndex];
+    mapIndexByVin.insert(make_pair(mn.vin.prevout, nIndex));
+    mapIndexByPubKey.insert(make_pair(mn.pubkey2, nIndex));
+    mapIndexByAddr.insert(make_pair(mn.addr, nIndex));
+    mapIndexByPayee.insert(make_pair(GetScriptForDestination(mn.pubkey.GetID()), nIndex));
+}
+
+void CMasternodeMan::RebuildIndexes()
+{
+    AssertLockHeld(cs);
+
+    mapIndexByVin.clear();
+    mapIndexByPubKey.clear();
+    mapIndexByAddr.clear();
+    mapIndexByPayee.clear();
+
+    for(size_t i = 0; i < vMasternodes.size(); i++)
+        AddToIndexes(i);
 }
 
 // 
@@ -322,7 +340,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
         //make sure it has as many confirmations as there are masternodes
         if(mn.GetMasternodeInputAge() < nMnCount) continue;
 
-        vecMasternodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(), mn.vin));
+        vecMasternodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(nMnCount), mn.vin));
     }
 
     nCount = (int)vecMasternodeLastPaid.size();
@@ -389,55 +407,86 @@ CMasternode *CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn> &vecToExclude
 
 CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
-    int64_t score = 0;
-    CMasternode* winner = NULL;
+    LOCK(cs);
 
-    // scan for winner
-    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-        mn.Check();
-        if(mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
+    const std::vector<pair<int64_t, CMasternode*> >* pvecScores = GetScores(nBlockHeight, minProtocol);
+    if(pvecScores == NULL) return NULL;
 
-        // calculate the score for each Masternode
-        arith_uint256 n = mn.CalculateScore(nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+    // scores are sorted, so the winner is the first enabled Masternode
+    BOOST_FOREACH(const PAIRTYPE(int64_t, CMasternode*)& s, *pvecScores){
+        if(s.first <= 0) break;
 
-        // determine the winner
-        if(n2 > score){
-            score = n2;
-            winner = &mn;
-        }
+        s.second->Check();
+        if(s.second->IsEnabled()) return s.second;
     }
 
-    return winner;
+    return NULL;
 }
 
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+const std::vector<pair<int64_t, CMasternode*> >* CMasternodeMan::GetScores(int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    AssertLockHeld(cs);
 
     //make sure we know about this block
     uint256 hash = uint256();
-    if(!GetBlockHash(hash, nBlockHeight)) return -1;
+    if(!GetBlockHash(hash, nBlockHeight)) return NULL;
+
+    // scores depend on the collateral confirmations, so they are only valid for the current tip
+    uint256 hashTip = chainActive.Tip()->GetBlockHash();
+    if(hashTip != hashScoresCacheTip) {
+        mapScoresCache.clear();
+        hashScoresCacheTip = hashTip;
+    }
+
+    pair<int64_t, int> key = make_pair(nBlockHeight, minProtocol);
+    std::map<pair<int64_t, int>, std::vector<pair<int64_t, CMasternode*> > >::iterator it = mapScoresCache.find(key);
+    if(it != mapScoresCache.end()) return &it->second;
+
+    if(mapScoresCache.size() >= MASTERNODES_SCORES_CACHE_SIZE) {
+        // forget the lowest block height, scores are mostly asked for blocks
+        // around the tip
+        mapScoresCache.erase(mapScoresCache.begin());
+    }
+
+    std::vector<pair<int64_t, CMasternode*> >& vecScores = mapScoresCache[key];
+    vecScores.reserve(vMasternodes.size());
 
-    // scan for winner
     BOOST_FOREACH(CMasternode& mn, vMasternodes) {
         if(mn.protocolVersion < minProtocol) continue;
-        if(fOnlyActive) {
-            mn.Check();
-            if(!mn.IsEnabled()) continue;
-        }
+
         arith_uint256 n = mn.CalculateScore(nBlockHeight);
         int64_t n2 = n.GetCompact(false);
 
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
+        vecScores.push_back(make_pair(n2, &mn));
     }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    // sort them high to low, Masternodes with the same score keep their order in the list
+    stable_sort(vecScores.begin(), vecScores.end(), CompareScoreMN());
+
+    return &vecScores;
+}
+
+void CMasternodeMan::ClearScoresCache()
+{
+    LOCK(cs);
+    mapScoresCache.clear();
+}
+
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    LOCK(cs);
+
+    const std::vector<pair<int64_t, CMasternode*> >* pvecScores = GetScores(nBlockHeight, minProtocol);
+    if(pvecScores == NULL) return -1;
 
     int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn)& s, vecMasternodeScores){
+    BOOST_FOREACH(const PAIRTYPE(int64_t, CMasternode*)& s, *pvecScores){
+        if(fOnlyActive) {
+            s.second->Check();
+            if(!s.second->IsEnabled()) continue;
+        }
         rank++;
-        if(s.second.prevout == vin.prevout) {
+        if(s.second->vin.prevout == vin.prevout) {
             return rank;
         }
     }
@@ -447,35 +496,20 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
-    std::vector<pair<int, CMasternode> > vecMasternodeRanks;
-
-    //make sure we know about this block
-    uint256 hash = uint256();
-    if(!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
-
-    // scan for winner
-    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-
-        mn.Check();
-
-        if(mn.protocolVersion < minProtocol) continue;
-        if(!mn.IsEnabled()) {
-            continue;
-        }
-
-        arith_uint256 n = mn.CalculateScore(nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+    LOCK(cs);
 
-        vecMasternodeScores.push_back(make_pair(n2, mn));
-    }
+    std::vector<pair<int, CMasternode> > vecMasternodeRanks;
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
+    const std::vector<pair<int64_t, CMasternode*> >* pvecScores = GetScores(nBlockHeight, minProtocol);
+    if(pvecScores == NULL) return vecMasternodeRanks;
 
     int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CMasternode)& s, vecMasternodeScores){
+    BOOST_FOREACH(const PAIRTYPE(int64_t, CMasternode*)& s, *pvecScores){
+        s.second->Check();
+        if(!s.second->IsEnabled()) continue;
+
         rank++;
-        vecMasternodeRanks.push_back(make_pair(rank, s.second));
+        vecMasternodeRanks.push_back(make_pair(rank, *s.second));
     }
 
     return vecMasternodeRanks;
@@ -483,30 +517,20 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    LOCK(cs);
 
-    // scan for winner
-    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
+    const std::vector<pair<int64_t, CMasternode*> >* pvecScores = GetScores(nBlockHeight, minProtocol);
+    if(pvecScores == NULL) return NULL;
 
-        if(mn.protocolVersion < minProtocol) continue;
+    int rank = 0;
+    BOOST_FOREACH(const PAIRTYPE(int64_t, CMasternode*)& s, *pvecScores){
         if(fOnlyActive) {
-            mn.Check();
-            if(!mn.IsEnabled()) continue;
+            s.second->Check();
+            if(!s.second->IsEnabled()) continue;
         }
-
-        arith_uint256 n = mn.CalculateScore(nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn)& s, vecMasternodeScores){
         rank++;
         if(rank == nRank) {
-            return Find(s.second);
+            return s.second;
         }
     }
 
@@ -641,6 +665,8 @@ void CMasternodeMan::Remove(CTxIn vin)
         if((*it).vin == vin){
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).addr.ToString(), size() - 1);
             vMasternodes.erase(it);
+            RebuildIndexes();
+            mapScoresCache.clear();
             break;
         }
         ++it;
@@ -673,10 +699,29 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb) {
         CMasternode mn(mnb);
         Add(mn);
     } else {
-        pmn->UpdateFromNewBroadcast(mnb);
+        UpdateFromNewBroadcast(pmn, mnb);
     }
 }
 
+bool CMasternodeMan::UpdateFromNewBroadcast(CMasternode* pmn, const CMasternodeBroadcast& mnb)
+{
+    LOCK(cs);
+
+    CPubKey pubkey2Old = pmn->pubkey2;
+    CService addrOld = pmn->addr;
+
+    if(!pmn->UpdateFromNewBroadcast(mnb)) return false;
+
+    // a masternode moving to another address or key is rare, reindex everything then
+    // to keep the first-wins order for the other entries sharing the old keys
+    if(pmn->pubkey2 != pubkey2Old || pmn->addr != addrOld)
+        RebuildIndexes();
+
+    // protocol version might have changed
+    mapScoresCache.clear();
+    return true;
+}
+
 bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CMasternodeBroadcast mnb, int& nDos) {
     nDos = 0;
     LogPrint("masternode", "CMasternodeMan::CheckMnbAndUpdateMasternodeList - Masternode broadcast, vin: %s\n", mnb.vin.ToString());
@@ -16,6 +16,7 @@
 
 #define MASTERNODES_DUMP_SECONDS               (15*60)
 #define MASTERNODES_DSEG_SECONDS               (3*60*60)
+#define MASTERNODES_SCORES_CACHE_SIZE          64
 
 using namespace std;
 
@@ -26,15 +27,22 @@ void DumpMasternodes();
 
 class CMasternodeMan
 {
-private:
+public:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
 
+private:
     // critical section to protect the inner data structures specifically on messaging
     mutable CCriticalSection cs_process_message;
 
     // map to hold all MNs
     std::vector<CMasternode> vMasternodes;
+    // positions in vMasternodes by collateral, masternode key, address and payee script,
+    // if several masternodes share a key the first one wins, as it did with the list scans
+    std::map<COutPoint, size_t> mapIndexByVin;
+    std::map<CPubKey, size_t> mapIndexByPubKey;
+    std::map<CService, size_t> mapIndexByAddr;
+    std::map<CScript, size_t> mapIndexByPayee;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
@@ -42,6 +50,19 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // scores of masternodes with at least given protocol version for a block, sorted
+    // from the highest to the lowest, valid only for the tip they were calculated at
+    std::map<pair<int64_t, int>, std::vector<pair<int64_t, CMasternode*> > > mapScoresCache;
+    uint256 hashScoresCacheTip;
+
+    /// Get cached scores for the block or calculate them, returns NULL if the block is unknown
+    const std::vector<pair<int64_t, CMasternode*> >* GetScores(int64_t nBlockHeight, int minProtocol);
+
+    /// Index the entry at the given position of vMasternodes
+    void AddToIndexes(size_t nIndex);
+    /// Index vMasternodes from scratch, must be called whenever entries are erased
+    void RebuildIndexes();
+
 public:
     // Keep track of all broadcasts I've seen
     map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -56,14 +77,24 @@ public:
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         LOCK(cs);
+        if (ser_action.ForRead())
+            ClearScoresCache();
         READWRITE(vMasternodes);
-        READWRITE(mAskedUsForMasternodeList);
-        READWRITE(mWeAskedForMasternodeList);
-        READWRITE(mWeAskedForMasternodeListEntry);
+        if (ser_action.ForRead())
+            RebuildIndexes();
+        // the request and seen caches change all the time, they are left
+        // out of the hash that tells whether mncache.dat needs rewriting
+        if (!(nType & SER_GETHASH)) {
+            READWRITE(mAskedUsForMasternodeList);
+            READWRITE(mWeAskedForMasternodeList);
+            READWRITE(mWeAskedForMasternodeListEntry);
+        }
         READWRITE(nDsqCount);
 
-        READWRITE(mapSeenMasternodeBroadcast);
-        READWRITE(mapSeenMasternodePing);
+        if (!(nType & SER_GETHASH)) {
+            READWRITE(mapSeenMasternodeBroadcast);
+            READWRITE(mapSeenMasternodePing);
+        }
     }
 
     CMasternodeMan();
@@ -84,6 +115,9 @@ public:
     /// Clear Masternode vector
     void Clear();
 
+    /// Forget calculated scores, must be called whenever vMasternodes changes
+    void ClearScoresCache();
+
     int CountEnabled(int protocolVersion = -1);
 
     void DsegUpdate(CNode* pnode);
@@ -120,6 +154,9 @@ public:
 
     void Remove(CTxIn vin);
 
+    /// Update an entry from a newer broadcast keeping the indexes and cached scores in sync
+    bool UpdateFromNewBroadcast(CMasternode* pmn, const CMasternodeBroadcast& mnb);
+
     /// Update masternode list and maps using provided CMasternodeBroadcast
     void UpdateMasternodeList(CMasternodeBroadcast mnb);
     /// Perform complete check and only then update list and maps
@@ -12,6 +12,7 @@
 #include <vector>
 
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/unordered_map.hpp>
 
@@ -108,6 +109,23 @@ static inline size_t IncrementalDynamicUsage(const std::map<X, Y, Z>& m)
 
 // Boost data structures
 
+struct boost_shared_counter
+{
+private:
+    void* vtable;
+    int use_count;
+    int weak_count;
+};
+
+template<typename X>
+static inline size_t DynamicUsage(const boost::shared_ptr<X>& p)
+{
+    // The object and the counter may be one allocation (make_shared) or two,
+    // assume the worst. An object shared by several pointers is counted for
+    // each of them.
+    return p ? MallocUsage(sizeof(X)) + MallocUsage(sizeof(boost_shared_counter)) : 0;
+}
+
 template<typename X>
 struct boost_unordered_node : private X
 {
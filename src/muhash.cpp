@@ -0,0 +1,164 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <string.h>
+
+namespace
+{
+    //! 2^3072 is congruent to this modulo the prime
+    static const uint32_t MAX_PRIME_DIFF = 1103717;
+
+    /** Fold the carry above 2^3072 back in until the value fits. */
+    void Fold(uint32_t* limbs, uint64_t overflow)
+    {
+        while (overflow) {
+            uint64_t c = overflow * MAX_PRIME_DIFF;
+            for (int i = 0; i < Num3072::LIMBS; i++) {
+                uint64_t cur = (uint64_t)limbs[i] + (c & 0xffffffff);
+                limbs[i] = (uint32_t)cur;
+                c = (c >> 32) + (cur >> 32);
+            }
+            overflow = c;
+        }
+    }
+}
+
+Num3072::Num3072(const unsigned char* data)
+{
+    for (int i = 0; i < LIMBS; i++)
+        limbs[i] = ReadLE32(data + 4 * i);
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; i++)
+        limbs[i] = 0;
+}
+
+bool Num3072::IsOne() const
+{
+    if (limbs[0] != 1)
+        return false;
+    for (int i = 1; i < LIMBS; i++)
+        if (limbs[i] != 0)
+            return false;
+    return true;
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    uint32_t t[2 * LIMBS];
+    memset(t, 0, sizeof(t));
+    for (int i = 0; i < LIMBS; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            uint64_t cur = (uint64_t)limbs[i] * a.limbs[j] + t[i + j] + carry;
+            t[i + j] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+        t[i + LIMBS] = (uint32_t)carry;
+    }
+
+    // low + high * 2^3072 == low + high * MAX_PRIME_DIFF
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        uint64_t cur = (uint64_t)t[LIMBS + i] * MAX_PRIME_DIFF + t[i] + carry;
+        limbs[i] = (uint32_t)cur;
+        carry = cur >> 32;
+    }
+    Fold(limbs, carry);
+}
+
+void Num3072::FullReduce()
+{
+    // this >= p exactly when this + MAX_PRIME_DIFF carries past 2^3072
+    uint32_t reduced[LIMBS];
+    uint64_t c = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; i++) {
+        uint64_t cur = (uint64_t)limbs[i] + c;
+        reduced[i] = (uint32_t)cur;
+        c = cur >> 32;
+    }
+    if (c)
+        memcpy(limbs, reduced, sizeof(limbs));
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat: this^(p-2), four exponent bits at a time. All limbs of p-2 are
+    // ones except the lowest.
+    Num3072 table[16];
+    for (int i = 1; i < 16; i++) {
+        table[i] = table[i - 1];
+        table[i].Multiply(*this);
+    }
+
+    Num3072 result;
+    for (int i = LIMBS - 1; i >= 0; i--) {
+        const uint32_t e = i == 0 ? (uint32_t)0 - MAX_PRIME_DIFF - 2 : 0xffffffff;
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            for (int k = 0; k < 4; k++)
+                result.Multiply(result);
+            const uint32_t nibble = (e >> shift) & 0xf;
+            if (nibble)
+                result.Multiply(table[nibble]);
+        }
+    }
+    return result;
+}
+
+void Num3072::ToBytes(unsigned char* out) const
+{
+    Num3072 reduced(*this);
+    reduced.FullReduce();
+    for (int i = 0; i < LIMBS; i++)
+        WriteLE32(out + 4 * i, reduced.limbs[i]);
+}
+
+Num3072 MuHash3072::ToNum3072(const uint256& element)
+{
+    // Stretch the element hash to 3072 bits, one SHA256 per 32 bytes
+    unsigned char data[Num3072::BYTE_SIZE];
+    for (unsigned int i = 0; i < Num3072::BYTE_SIZE / CSHA256::OUTPUT_SIZE; i++) {
+        unsigned char counter = i;
+        CSHA256().Write(element.begin(), element.size()).Write(&counter, 1).Finalize(data + i * CSHA256::OUTPUT_SIZE);
+    }
+    return Num3072(data);
+}
+
+void MuHash3072::Insert(const uint256& element)
+{
+    numerator.Multiply(ToNum3072(element));
+}
+
+void MuHash3072::Remove(const uint256& element)
+{
+    denominator.Multiply(ToNum3072(element));
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+uint256 MuHash3072::Finalize() const
+{
+    Num3072 result(numerator);
+    if (!denominator.IsOne())
+        result.Multiply(denominator.GetInverse());
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    result.ToBytes(data);
+    uint256 hash;
+    CSHA256().Write(data, Num3072::BYTE_SIZE).Finalize(hash.begin());
+    return hash;
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWN_MUHASH_H
+#define CROWN_MUHASH_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+/** Integer modulo the prime 2^3072 - 1103717, not necessarily fully reduced. */
+class Num3072
+{
+public:
+    static const size_t BYTE_SIZE = 384;
+    static const int LIMBS = 96;
+
+    //! Little endian 32-bit limbs, the value is always below 2^3072
+    uint32_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    //! From BYTE_SIZE little endian bytes
+    explicit Num3072(const unsigned char* data);
+
+    void SetToOne();
+    bool IsOne() const;
+    //! this = this * a mod p
+    void Multiply(const Num3072& a);
+    //! The multiplicative inverse, this must not be zero mod p
+    Num3072 GetInverse() const;
+    //! Write the fully reduced value as BYTE_SIZE little endian bytes
+    void ToBytes(unsigned char* out) const;
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char data[BYTE_SIZE];
+        ToBytes(data);
+        s.write((const char*)data, BYTE_SIZE);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char data[BYTE_SIZE];
+        s.read((char*)data, BYTE_SIZE);
+        *this = Num3072(data);
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return BYTE_SIZE;
+    }
+
+private:
+    //! Subtract the modulus once if the value is not below it
+    void FullReduce();
+};
+
+/**
+ * Hash of a set of elements that can be updated one element at a time, in any
+ * order: every element is mapped to a number modulo a 3072-bit prime and the
+ * set hash is their product. Removal multiplies by the inverse instead, which
+ * is kept in a separate denominator so that only Finalize() has to invert.
+ *
+ * Two MuHash3072 of disjoint changes combine with *=, so a change can be
+ * accumulated on its own and applied to the total later.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const uint256& element);
+
+public:
+    //! The hash of the empty set
+    MuHash3072() {}
+
+    //! Add an element, given as the hash of its serialization
+    void Insert(const uint256& element);
+    //! Remove an element that was inserted before
+    void Remove(const uint256& element);
+
+    MuHash3072& operator*=(const MuHash3072& mul);
+
+    //! True as long as nothing was inserted or removed
+    bool IsEmpty() const { return numerator.IsOne() && denominator.IsOne(); }
+
+    //! The 256-bit hash of the set, independent of how it was built
+    uint256 Finalize() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+#endif // CROWN_MUHASH_H
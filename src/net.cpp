@@ -14,6 +14,7 @@
 #include "addrman.h"
 #include "chainparams.h"
 #include "clientversion.h"
+#include "main.h"
 #include "primitives/transaction.h"
 #include "ui_interface.h"
 #include "legacysigner.h"
@@ -26,6 +27,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -39,6 +44,11 @@
 // Dump addresses to peers.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
 
+// How long ThreadSocketHandler waits for sockets to become ready (ms)
+#define SOCKET_WAIT_TIMEOUT 50
+// Maximum number of events fetched by one epoll_wait() call
+#define MAX_EPOLL_EVENTS 256
+
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -87,8 +97,8 @@ bool fAddressesInitialized = false;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
-deque<pair<int64_t, CInv> > vRelayExpiration;
+map<uint256, CTransactionRef> mapRelay;
+deque<pair<int64_t, uint256> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
@@ -105,12 +115,58 @@ NodeId nLastNodeId = 0;
 CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
+#ifdef HAVE_SYS_EPOLL_H
+// epoll instance of ThreadSocketHandler with -socketevents=epoll, -1 when select() is used
+static int hEpoll = -1;
+// Nodes by socket registered with hEpoll, from when they are added to vNodes
+// until their socket is closed
+static std::map<SOCKET, CNode*> mapEpollNodes;
+static CCriticalSection cs_mapEpollNodes;
+// Nodes that can go on without a new event, only used by ThreadSocketHandler
+static std::set<CNode*> setEpollReady;
+#endif
 boost::condition_variable messageHandlerCondition;
+boost::shared_mutex csMessageProcessing;
+static boost::mutex messageHandlerMutex;
 
 // Signals for message handling
 static CNodeSignals g_signals;
 CNodeSignals& GetNodeSignals() { return g_signals; }
 
+// Register the socket of a node that was just added to vNodes with epoll,
+// edge-triggered for reading and writing
+static void RegisterSocketEvents(CNode* pnode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpoll == -1)
+        return;
+
+    LOCK(cs_mapEpollNodes);
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    event.data.fd = pnode->hSocket;
+    if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0)
+    {
+        LogPrintf("socket epoll_ctl error %s (%s)\n", NetworkErrorString(errno), pnode->addr.ToString());
+        pnode->fDisconnect = true;
+        return;
+    }
+    mapEpollNodes[pnode->hSocket] = pnode;
+#endif
+}
+
+// Forget the socket of a node before it is closed, closing it removes it from
+// epoll and its number can be reused by the next connection
+static void UnregisterSocketEvents(CNode* pnode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    LOCK(cs_mapEpollNodes);
+    std::map<SOCKET, CNode*>::iterator it = mapEpollNodes.find(pnode->hSocket);
+    if (it != mapEpollNodes.end() && it->second == pnode)
+        mapEpollNodes.erase(it);
+#endif
+}
+
 void AddOneShot(string strDest)
 {
     LOCK(cs_vOneShots);
@@ -421,7 +477,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool Masternode, b
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsSocketEventsEpoll() && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -436,6 +492,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool Masternode, b
         {
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
+            RegisterSocketEvents(pnode);
         }
 
         pnode->nTimeConnected = GetTime();
@@ -458,6 +515,7 @@ void CNode::CloseSocketDisconnect()
     if (hSocket != INVALID_SOCKET)
     {
         LogPrint("net", "disconnecting peer=%d\n", id);
+        UnregisterSocketEvents(this);
         CloseSocket(hSocket);
     }
 
@@ -615,7 +673,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            messageHandlerCondition.notify_all();
         }
     }
 
@@ -723,6 +781,189 @@ void SocketSendData(CNode *pnode)
 
 static list<CNode*> vNodesDisconnected;
 
+// Implement the following logic:
+// * If there is data to send, wait for sending data. As this only
+//   happens when optimistic write failed, we choose to first drain the
+//   write buffer in this case before receiving more. This avoids
+//   needlessly queueing received data, if the remote peer is not themselves
+//   receiving data. This means properly utilizing TCP flow control signalling.
+// * Otherwise, if there is no (complete) message in the receive buffer,
+//   or there is space left in the buffer, wait for receiving data.
+// * (if neither of the above applies, there is certainly one message
+//   in the receiver buffer ready to be processed).
+// Together, that means that at least one of the following is always possible,
+// so we don't deadlock:
+// * We send some data.
+// * We wait for data to be received (and disconnect after timeout).
+// * We process a message in the buffer (message handler thread).
+static bool HasDataToSend(CNode* pnode)
+{
+    TRY_LOCK(pnode->cs_vSend, lockSend);
+    return lockSend && !pnode->vSendMsg.empty();
+}
+
+static bool IsReceiveAllowed(CNode* pnode)
+{
+    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+    return lockRecv && (
+        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+        pnode->GetTotalRecvSize() <= ReceiveFloodSize());
+}
+
+bool IsSocketEventsEpoll()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    return hEpoll != -1;
+#else
+    return false;
+#endif
+}
+
+static void WaitForSocketsSelect(std::set<SOCKET>& setRecv, std::set<SOCKET>& setSend, std::set<SOCKET>& setError)
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = SOCKET_WAIT_TIMEOUT * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    std::vector<SOCKET> vSockets;
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = max(hSocketMax, hListenSocket.socket);
+        vSockets.push_back(hListenSocket.socket);
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = max(hSocketMax, pnode->hSocket);
+            vSockets.push_back(pnode->hSocket);
+
+            if (HasDataToSend(pnode))
+                FD_SET(pnode->hSocket, &fdsetSend);
+            else if (IsReceiveAllowed(pnode))
+                FD_SET(pnode->hSocket, &fdsetRecv);
+        }
+    }
+
+    int nSelect = select(!vSockets.empty() ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (!vSockets.empty())
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            setRecv.insert(vSockets.begin(), vSockets.end());
+        }
+        MilliSleep(SOCKET_WAIT_TIMEOUT);
+        return;
+    }
+
+    BOOST_FOREACH(SOCKET hSocket, vSockets)
+    {
+        if (FD_ISSET(hSocket, &fdsetRecv))
+            setRecv.insert(hSocket);
+        if (FD_ISSET(hSocket, &fdsetSend))
+            setSend.insert(hSocket);
+        if (FD_ISSET(hSocket, &fdsetError))
+            setError.insert(hSocket);
+    }
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+// Node sockets are registered edge-triggered for reading and writing when
+// they are added, the readiness is remembered in the node until recv() or
+// send() can't go on. Only the nodes with new events or readiness left from
+// the previous round are looked at, so waiting doesn't depend on the number
+// of connected peers.
+static void WaitForSocketsEpoll(std::set<SOCKET>& setRecv, std::set<SOCKET>& setSend, std::set<SOCKET>& setError)
+{
+    // don't wait if there is something to do already, queued data is sent
+    // before more is received
+    bool fPending = false;
+    BOOST_FOREACH(CNode* pnode, setEpollReady)
+    {
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (pnode->nSendSize > 0 ? pnode->fSocketWritable : (pnode->fSocketReadable && IsReceiveAllowed(pnode)))
+        {
+            fPending = true;
+            break;
+        }
+    }
+
+    struct epoll_event vEvents[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(hEpoll, vEvents, MAX_EPOLL_EVENTS, fPending ? 0 : SOCKET_WAIT_TIMEOUT);
+    if (nEvents < 0)
+    {
+        if (errno != EINTR)
+        {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            MilliSleep(SOCKET_WAIT_TIMEOUT);
+        }
+        nEvents = 0;
+    }
+
+    {
+        LOCK(cs_mapEpollNodes);
+        for (int i = 0; i < nEvents; i++)
+        {
+            SOCKET hSocket = vEvents[i].data.fd;
+            std::map<SOCKET, CNode*>::iterator it = mapEpollNodes.find(hSocket);
+            if (it == mapEpollNodes.end())
+            {
+                // listen sockets are level-triggered
+                if (vEvents[i].events & EPOLLIN)
+                    setRecv.insert(hSocket);
+                continue;
+            }
+
+            CNode* pnode = it->second;
+            if (vEvents[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                pnode->fSocketReadable = true;
+            if (vEvents[i].events & EPOLLOUT)
+                pnode->fSocketWritable = true;
+            if (vEvents[i].events & EPOLLERR)
+                setError.insert(hSocket);
+            setEpollReady.insert(pnode);
+        }
+    }
+
+    std::set<CNode*>::iterator it = setEpollReady.begin();
+    while (it != setEpollReady.end())
+    {
+        CNode* pnode = *it;
+        // an idle writable socket needs no attention until data is queued,
+        // which is sent right away or waits for the next EPOLLOUT
+        if (pnode->hSocket == INVALID_SOCKET || (!pnode->fSocketReadable && !(pnode->fSocketWritable && pnode->nSendSize > 0)))
+        {
+            setEpollReady.erase(it++);
+            continue;
+        }
+        if (HasDataToSend(pnode)) {
+            if (pnode->fSocketWritable)
+                setSend.insert(pnode->hSocket);
+        } else if (pnode->fSocketReadable && IsReceiveAllowed(pnode)) {
+            setRecv.insert(pnode->hSocket);
+        }
+        ++it;
+    }
+}
+#endif
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
@@ -748,6 +989,9 @@ void ThreadSocketHandler()
 
                     // close socket and cleanup
                     pnode->CloseSocketDisconnect();
+#ifdef HAVE_SYS_EPOLL_H
+                    setEpollReady.erase(pnode);
+#endif
 
                     // hold in disconnected pool until all refs are released
                     if (pnode->fNetworkNode || pnode->fInbound)
@@ -794,91 +1038,23 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        std::set<SOCKET> setRecv;
+        std::set<SOCKET> setSend;
+        std::set<SOCKET> setError;
+#ifdef HAVE_SYS_EPOLL_H
+        if (hEpoll != -1)
+            WaitForSocketsEpoll(setRecv, setSend, setError);
+        else
+#endif
+            WaitForSocketsSelect(setRecv, setSend, setError);
         boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
-        }
-
         //
         // Accept new connections
         //
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && setRecv.count(hListenSocket.socket))
             {
                 struct sockaddr_storage sockaddr;
                 socklen_t len = sizeof(sockaddr);
@@ -904,7 +1080,7 @@ void ThreadSocketHandler()
                     if (nErr != WSAEWOULDBLOCK)
                         LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
                 }
-                else if (!IsSelectableSocket(hSocket))
+                else if (!IsSocketEventsEpoll() && !IsSelectableSocket(hSocket))
                 {
                     LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
                     CloseSocket(hSocket);
@@ -937,6 +1113,7 @@ void ThreadSocketHandler()
                     {
                         LOCK(cs_vNodes);
                         vNodes.push_back(pnode);
+                        RegisterSocketEvents(pnode);
                     }
                 }
             }
@@ -961,7 +1138,7 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            if (setRecv.count(pnode->hSocket) || setError.count(pnode->hSocket))
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
@@ -970,6 +1147,9 @@ void ThreadSocketHandler()
                         // typical socket buffer is 8K-64K
                         char pchBuf[0x10000];
                         int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                        // a short read drained the socket, epoll reports when more data arrives
+                        if (nBytes < (int)sizeof(pchBuf))
+                            pnode->fSocketReadable = false;
                         if (nBytes > 0)
                         {
                             if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
@@ -1005,11 +1185,16 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (setSend.count(pnode->hSocket))
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
+                {
                     SocketSendData(pnode);
+                    // the socket buffer is full, epoll reports when there is room again
+                    if (!pnode->vSendMsg.empty())
+                        pnode->fSocketWritable = false;
+                }
             }
 
             //
@@ -1466,28 +1651,38 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
-void ThreadMessageHandler()
+// Peer which gets the trickled inventory, picked from all peers once per round
+// of the first message handler thread and taken by the thread owning the peer,
+// guarded by cs_vNodes
+static NodeId nTrickleNodeId = -1;
+
+// Peers are split over the message handler threads by id, so the messages of
+// a peer are always processed in order by the same thread
+void ThreadMessageHandler(int nThread, int nThreads)
 {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
-    
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true)
     {
         vector<CNode*> vNodesCopy;
+        NodeId nTrickle;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy) {
+            if (nThread == 0)
+                nTrickleNodeId = vNodes.empty() ? -1 : vNodes[GetRand(vNodes.size())]->id;
+            nTrickle = -1;
+            if (nTrickleNodeId != -1 && nTrickleNodeId % nThreads == nThread) {
+                nTrickle = nTrickleNodeId;
+                nTrickleNodeId = -1;
+            }
+            BOOST_FOREACH(CNode* pnode, vNodes) {
+                if (pnode->id % nThreads != nThread)
+                    continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
         // Poll the connected nodes for messages
-        CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
-            pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
-
         bool fSleep = true;
 
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
@@ -1516,9 +1711,10 @@ void ThreadMessageHandler()
 
             // Send messages
             {
+                boost::unique_lock<boost::shared_mutex> lockProcessing(csMessageProcessing);
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
-                    g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
+                    g_signals.SendMessages(pnode, pnode->id == nTrickle || pnode->fWhitelisted);
             }
             boost::this_thread::interruption_point();
         }
@@ -1530,8 +1726,10 @@ void ThreadMessageHandler()
                 pnode->Release();
         }
 
-        if (fSleep)
+        if (fSleep) {
+            boost::unique_lock<boost::mutex> lock(messageHandlerMutex);
             messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+        }
     }
 }
 
@@ -1712,6 +1910,32 @@ void StartNode(boost::thread_group& threadGroup)
     if (pnodeLocalHost == NULL)
         pnodeLocalHost = new CNode(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0), nLocalServices));
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (GetArg("-socketevents", DEFAULT_SOCKETEVENTS) == "epoll" && hEpoll == -1)
+    {
+        hEpoll = epoll_create1(EPOLL_CLOEXEC);
+        if (hEpoll == -1)
+            LogPrintf("epoll_create1 failed: %s, using select()\n", NetworkErrorString(errno));
+
+        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        {
+            if (hEpoll == -1)
+                break;
+
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.fd = hListenSocket.socket;
+            if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0)
+            {
+                LogPrintf("epoll_ctl failed for listening socket: %s, using select()\n", NetworkErrorString(errno));
+                close(hEpoll);
+                hEpoll = -1;
+            }
+        }
+    }
+    LogPrintf("Using %s for socket events\n", IsSocketEventsEpoll() ? "epoll" : "select");
+#endif
+
     Discover(threadGroup);
 
     //
@@ -1736,7 +1960,10 @@ void StartNode(boost::thread_group& threadGroup)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    int nMessageHandlerThreads = GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS);
+    nMessageHandlerThreads = std::max(1, std::min(nMessageHandlerThreads, MAX_MSGHANDLER_THREADS));
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand", boost::function<void()>(boost::bind(&ThreadMessageHandler, i, nMessageHandlerThreads))));
 
     // Dump network addresses
     threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "dumpaddr", &DumpAddresses, DUMP_ADDRESSES_INTERVAL * 1000));
@@ -1784,6 +2011,16 @@ public:
         vNodes.clear();
         vNodesDisconnected.clear();
         vhListenSocket.clear();
+#ifdef HAVE_SYS_EPOLL_H
+        if (hEpoll != -1)
+            close(hEpoll);
+        hEpoll = -1;
+        {
+            LOCK(cs_mapEpollNodes);
+            mapEpollNodes.clear();
+        }
+        setEpollReady.clear();
+#endif
         delete semOutbound;
         semOutbound = NULL;
         delete pnodeLocalHost;
@@ -1807,14 +2044,11 @@ void CExplicitNetCleanup::callCleanup()
 
 void RelayTransaction(const CTransaction& tx)
 {
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
-    ss << tx;
-    RelayTransaction(tx, ss);
-}
+    // Keep the transaction the mempool holds rather than a copy of it
+    CTransactionRef ptx = mempool.get(tx.GetHash());
+    if (!ptx)
+        ptx = MakeTransactionRef(tx);
 
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
-{
     CInv inv(MSG_TX, tx.GetHash());
     {
         LOCK(cs_mapRelay);
@@ -1825,9 +2059,8 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+        mapRelay.insert(std::make_pair(tx.GetHash(), ptx));
+        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, tx.GetHash()));
     }
     LOCK(cs_vNodes);
     BOOST_FOREACH(CNode* pnode, vNodes)
@@ -2046,6 +2279,8 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     fNetworkNode = false;
     fSuccessfullyConnected = false;
     fDisconnect = false;
+    fSocketReadable = false;
+    fSocketWritable = false;
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
@@ -2084,6 +2319,8 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
 
 CNode::~CNode()
 {
+    if (hSocket != INVALID_SOCKET)
+        UnregisterSocketEvents(this);
     CloseSocket(hSocket);
 
     if (pfilter)
@@ -12,6 +12,7 @@
 #include "limitedmap.h"
 #include "mruset.h"
 #include "netbase.h"
+#include "primitives/transaction.h"
 #include "protocol.h"
 #include "random.h"
 #include "streams.h"
@@ -29,6 +30,7 @@
 #include <boost/filesystem/path.hpp>
 #include <boost/foreach.hpp>
 #include <boost/signals2/signal.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 class CAddrMan;
 class CBlockIndex;
@@ -60,6 +62,12 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** The default number of message handler threads */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** The maximum number of message handler threads */
+static const int MAX_MSGHANDLER_THREADS = 16;
+/** The default way of waiting for socket events, "select" or "epoll" where available */
+static const char DEFAULT_SOCKETEVENTS[] = "select";
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -78,6 +86,8 @@ bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhite
 void StartNode(boost::thread_group& threadGroup);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+/** Whether ThreadSocketHandler waits for socket events with epoll instead of select() */
+bool IsSocketEventsEpoll();
 
 typedef int NodeId;
 
@@ -131,8 +141,14 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
-extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
+/**
+ * Taken shared by the messages that can be processed concurrently by the message
+ * handler threads and exclusively by everything else that processes or sends messages.
+ * Must be taken before CNode::cs_vSend.
+ */
+extern boost::shared_mutex csMessageProcessing;
+extern std::map<uint256, CTransactionRef> mapRelay;
+extern std::deque<std::pair<int64_t, uint256> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
 
@@ -230,6 +246,10 @@ public:
     std::deque<CSerializeData> vSendMsg;
     CCriticalSection cs_vSend;
 
+    // epoll state of hSocket, only used by ThreadSocketHandler
+    bool fSocketReadable;
+    bool fSocketWritable;
+
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
@@ -699,9 +719,7 @@ public:
     static void callCleanup();
 };
 
-class CTransaction;
 void RelayTransaction(const CTransaction& tx);
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss);
 void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll=false);    
 void RelayInv(CInv &inv, const int minProtoVersion = MinPeerProtoVersion());
 
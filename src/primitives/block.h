@@ -81,13 +81,14 @@ class CBlock : public CBlockHeader
 {
 public:
     // network and disk
-    std::vector<CTransaction> vtx;
+    std::vector<CTransactionRef> vtx;
 
     // memory only
     mutable CScript payee;
     mutable CScript payeeSN;
     mutable std::vector<uint256> vMerkleTree;
     mutable bool fChecked;
+    mutable bool fContextFreeChecked;
 
     CBlock()
     {
@@ -113,6 +114,7 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         fChecked = false;
+        fContextFreeChecked = false;
         vMerkleTree.clear();
         payee = CScript();
         payeeSN = CScript();
@@ -11,6 +11,9 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
 /** An outpoint - a combination of a transaction hash and an index n into its vout */
 class COutPoint
 {
@@ -293,4 +296,13 @@ struct CMutableTransaction
 
 };
 
+/**
+ * A transaction shared between the mempool, the relay memory, InstantSend and
+ * blocks instead of being copied into each of them. It is immutable, so the
+ * hash cached in it stays valid.
+ */
+typedef boost::shared_ptr<const CTransaction> CTransactionRef;
+static inline CTransactionRef MakeTransactionRef() { return boost::make_shared<const CTransaction>(); }
+template <typename Tx> static inline CTransactionRef MakeTransactionRef(const Tx& txIn) { return boost::make_shared<const CTransaction>(txIn); }
+
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
@@ -420,9 +420,7 @@ void MultisigDialog::on_signTransactionButton_clicked()
         unsigned int x = 0;
         BOOST_FOREACH(const CTxIn& txin, mergedTx.vin) {
             
-            const uint256& prevHash = txin.prevout.hash;
-            CCoins coins;
-            view.AccessCoins(prevHash); // this is certainly allowed to fail
+            view.AccessCoin(txin.prevout); // this is certainly allowed to fail
             MultisigInputEntry *entry = qobject_cast<MultisigInputEntry *>(ui->inputs->itemAt(x)->widget());
             QString redeemScriptStr = entry->getRedeemScript();
             if(redeemScriptStr.size() > 0)
@@ -474,14 +472,14 @@ void MultisigDialog::on_signTransactionButton_clicked()
     {
         CScript redeemScript = redeemScripts[i];
         CTxIn& txin = mergedTx.vin[i];
-        const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-        if (coins == NULL || !coins->IsAvailable(txin.prevout.n)) {
+        const Coin& coin = view.AccessCoin(txin.prevout);
+        if (coin.IsSpent()) {
             QMessageBox::critical(this, tr("Multisig: Sign Button failed!"), tr("Input not found or already spent in coins"));
             fComplete = false;
             continue;
         }
 
-        const CScript& prevPubKey = coins->vout[txin.prevout.n].scriptPubKey;
+        const CScript& prevPubKey = coin.out.scriptPubKey;
 
         txin.scriptSig.clear();
 
@@ -9,6 +9,7 @@
 #include "rpcserver.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "utilstrencodings.h"
 #include "version.h"
 
@@ -111,6 +112,9 @@ static bool rest_block(AcceptedConnection* conn,
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
 
         pblockindex = mapBlockIndex[hash];
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
+
         if (!ReadBlockFromDisk(block, pblockindex))
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
     }
@@ -214,6 +218,61 @@ static bool rest_tx(AcceptedConnection* conn,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_blockfilter(AcceptedConnection* conn,
+                             string& strReq,
+                             map<string, string>& mapHeaders,
+                             bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    string hashStr = params[0];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    if (!pblockfilterdb)
+        throw RESTERR(HTTP_NOT_FOUND, "Block filters are not available (-blockfilterindex is not set)");
+
+    CBlockFilter filter;
+    if (!pblockfilterdb->ReadFilter(hash, filter))
+        throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+
+    CDataStream ssFilter(SER_NETWORK, PROTOCOL_VERSION);
+    ssFilter << filter.GetEncoded();
+
+    switch (rf) {
+    case RF_BINARY: {
+        string binaryFilter = ssFilter.str();
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryFilter.size(), "application/octet-stream") << binaryFilter << std::flush;
+        return true;
+    }
+
+    case RF_HEX: {
+        string strHex = HexStr(ssFilter.begin(), ssFilter.end()) + "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
+        return true;
+    }
+
+    case RF_JSON: {
+        Object objFilter;
+        objFilter.push_back(Pair("blockhash", hash.GetHex()));
+        objFilter.push_back(Pair("elements", (int64_t)filter.GetFilter().GetN()));
+        objFilter.push_back(Pair("filter", HexStr(filter.GetEncoded())));
+        string strJSON = write_string(Value(objFilter), false) + "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(AcceptedConnection* conn,
@@ -224,6 +283,7 @@ static const struct {
       {"/rest/tx/", rest_tx},
       {"/rest/block/notxdetails/", rest_block_notxdetails},
       {"/rest/block/", rest_block_extended},
+      {"/rest/blockfilter/", rest_blockfilter},
 };
 
 bool HTTPReq_REST(AcceptedConnection* conn,
@@ -45,7 +45,7 @@ Value mnbudget(const Array& params, bool fHelp)
 
     if(strCommand == "nextblock")
     {
-        CBlockIndex* pindexPrev = chainActive.Tip();
+        CBlockIndex* pindexPrev = GetBestBlockSnapshot();
         if(!pindexPrev) return "unknown";
 
         return GetNextSuperblock(pindexPrev->nHeight);
@@ -54,7 +54,7 @@ Value mnbudget(const Array& params, bool fHelp)
     if(strCommand == "prepare")
     {
         int nBlockMin = 0;
-        CBlockIndex* pindexPrev = chainActive.Tip();
+        CBlockIndex* pindexPrev = GetBestBlockSnapshot();
 
         std::vector<CNodeEntry> mnEntries;
         mnEntries = masternodeConfig.getEntries();
@@ -132,7 +132,7 @@ Value mnbudget(const Array& params, bool fHelp)
     if(strCommand == "submit")
     {
         int nBlockMin = 0;
-        CBlockIndex* pindexPrev = chainActive.Tip();
+        CBlockIndex* pindexPrev = GetBestBlockSnapshot();
 
         std::vector<CNodeEntry> mnEntries;
         mnEntries = masternodeConfig.getEntries();
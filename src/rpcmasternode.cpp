@@ -140,8 +140,9 @@ Value masternode(const Array& params, bool fHelp)
         {
             int nCount = 0;
 
-            if(chainActive.Tip())
-                mnodeman.GetNextMasternodeInQueueForPayment(chainActive.Tip()->nHeight, true, nCount);
+            CBlockIndex* pindexTip = GetBestBlockSnapshot();
+            if(pindexTip)
+                mnodeman.GetNextMasternodeInQueueForPayment(pindexTip->nHeight, true, nCount);
 
             if(params[1] == "ls") return mnodeman.CountEnabled(MIN_POOL_PEER_PROTO_VERSION);
             if(params[1] == "enabled") return mnodeman.CountEnabled();
@@ -382,7 +383,8 @@ Value masternode(const Array& params, bool fHelp)
 
         Object obj;
 
-        for(int nHeight = chainActive.Tip()->nHeight-nLast; nHeight < chainActive.Tip()->nHeight+20; nHeight++)
+        const int nTipHeight = GetBestBlockSnapshot()->nHeight;
+        for(int nHeight = nTipHeight-nLast; nHeight < nTipHeight+20; nHeight++)
         {
             obj.push_back(Pair(strprintf("%d", nHeight), GetRequiredPaymentsString(nHeight)));
         }
@@ -404,7 +406,8 @@ Value masternode(const Array& params, bool fHelp)
         Object obj;
 
         std::vector<CMasternode> vMasternodes = mnodeman.GetFullMasternodeVector();
-        for(int nHeight = chainActive.Tip()->nHeight-nLast; nHeight < chainActive.Tip()->nHeight+20; nHeight++){
+        const int nTipHeight = GetBestBlockSnapshot()->nHeight;
+        for(int nHeight = nTipHeight-nLast; nHeight < nTipHeight+20; nHeight++){
             arith_uint256  nHigh = 0;
             CMasternode *pBestMasternode = NULL;
             BOOST_FOREACH(CMasternode& mn, vMasternodes) {
@@ -490,7 +493,7 @@ Value masternodelist(const Array& params, bool fHelp)
 
     Object obj;
     if (strMode == "rank") {
-        std::vector<pair<int, CMasternode> > vMasternodeRanks = mnodeman.GetMasternodeRanks(chainActive.Tip()->nHeight);
+        std::vector<pair<int, CMasternode> > vMasternodeRanks = mnodeman.GetMasternodeRanks(GetBestBlockSnapshot()->nHeight);
         BOOST_FOREACH(PAIRTYPE(int, CMasternode)& s, vMasternodeRanks) {
             std::string strVin = s.second.vin.prevout.ToStringShort();
             if(strFilter !="" && strVin.find(strFilter) == string::npos) continue;
@@ -498,6 +501,7 @@ Value masternodelist(const Array& params, bool fHelp)
         }
     } else {
         std::vector<CMasternode> vMasternodes = mnodeman.GetFullMasternodeVector();
+        int nMnCount = mnodeman.CountEnabled();
         BOOST_FOREACH(CMasternode& mn, vMasternodes) {
             std::string strVin = mn.vin.prevout.ToStringShort();
             if (strMode == "activeseconds") {
@@ -519,7 +523,7 @@ Value masternodelist(const Array& params, bool fHelp)
                                mn.addr.ToString() << " " <<
                                (int64_t)mn.lastPing.sigTime << " " << setw(8) <<
                                (int64_t)(mn.lastPing.sigTime - mn.sigTime) << " " <<
-                               (int64_t)mn.GetLastPaid();
+                               (int64_t)mn.GetLastPaid(nMnCount);
                 std::string output = stringStream.str();
                 stringStream << " " << strVin;
                 if(strFilter !="" && stringStream.str().find(strFilter) == string::npos &&
@@ -531,7 +535,7 @@ Value masternodelist(const Array& params, bool fHelp)
             } else if (strMode == "lastpaid"){
                 if(strFilter !="" && mn.vin.prevout.hash.ToString().find(strFilter) == string::npos &&
                     strVin.find(strFilter) == string::npos) continue;
-                obj.push_back(Pair(strVin,      (int64_t)mn.GetLastPaid()));
+                obj.push_back(Pair(strVin,      (int64_t)mn.GetLastPaid(nMnCount)));
             } else if (strMode == "protocol") {
                 if(strFilter !="" && strFilter != strprintf("%d", mn.protocolVersion) &&
                     strVin.find(strFilter) == string::npos) continue;
@@ -571,8 +571,9 @@ Value getblocktemplate(const Array& params, bool fHelp)
     Array transactions;
     map<uint256, int64_t> setTxIndex;
     int i = 0;
-    BOOST_FOREACH (CTransaction& tx, pblock->vtx)
+    BOOST_FOREACH (const CTransactionRef& ptx, pblock->vtx)
     {
+        const CTransaction& tx = *ptx;
         uint256 txHash = tx.GetHash();
         setTxIndex[txHash] = i++;
 
@@ -621,7 +622,7 @@ Value getblocktemplate(const Array& params, bool fHelp)
     result.push_back(Pair("previousblockhash", pblock->hashPrevBlock.GetHex()));
     result.push_back(Pair("transactions", transactions));
     result.push_back(Pair("coinbaseaux", aux));
-    result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0].GetValueOut()));
+    result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0]->GetValueOut()));
     result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
     result.push_back(Pair("target", hashTarget.GetHex()));
     result.push_back(Pair("mintime", (int64_t)pindexPrev->GetMedianTimePast()+1));
@@ -640,7 +641,7 @@ Value getblocktemplate(const Array& params, bool fHelp)
         ExtractDestination(pblock->payee, address1);
         CBitcoinAddress address2(address1);
         result.push_back(Pair("payee", address2.ToString().c_str()));
-        result.push_back(Pair("payee_amount", (int64_t)pblock->vtx[0].vout[1].nValue));
+        result.push_back(Pair("payee_amount", (int64_t)pblock->vtx[0]->vout[1].nValue));
     } else {
         result.push_back(Pair("payee", ""));
         result.push_back(Pair("payee_amount", ""));
@@ -657,7 +658,7 @@ Value getblocktemplate(const Array& params, bool fHelp)
         ExtractDestination(pblock->payeeSN, address1);
         CBitcoinAddress address2(address1);
         result.push_back(Pair("payeeSN", address2.ToString().c_str()));
-        result.push_back(Pair("payeeSN_amount", (int64_t)pblock->vtx[0].vout[2].nValue));
+        result.push_back(Pair("payeeSN_amount", (int64_t)pblock->vtx[0]->vout[2].nValue));
     } else {
         result.push_back(Pair("payeeSN", ""));
         result.push_back(Pair("payeeSN_amount", ""));
@@ -885,7 +886,7 @@ Value getauxblock(const Array& params, bool fHelp)
         result.push_back(Pair("hash", block.GetHash().GetHex()));
         result.push_back(Pair("chainid", block.nVersion.GetChainId()));
         result.push_back(Pair("previousblockhash", block.hashPrevBlock.GetHex()));
-        result.push_back(Pair("coinbasevalue", (int64_t)block.vtx[0].vout[0].nValue));
+        result.push_back(Pair("coinbasevalue", (int64_t)block.vtx[0]->vout[0].nValue));
         result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
         result.push_back(Pair("height", static_cast<int64_t> (pindexPrev->nHeight + 1)));
         result.push_back(Pair("target", HexStr(BEGIN(target), END(target))));
@@ -48,6 +48,62 @@ static boost::thread_group* rpc_worker_group = NULL;
 static boost::asio::io_service::work *rpc_dummy_work = NULL;
 static std::vector<CSubNet> rpc_allow_subnets; //!< List of subnets to allow RPC connections from
 static std::vector< boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
+static bool fRPCUseSSL = false;
+
+/**
+ * Connections with a request ready to be read, waiting for an RPC thread.
+ * Accepting connections and waiting on idle keep-alive clients happens on a
+ * single I/O thread, so the -rpcthreads workers only ever block on calls that
+ * are actually being served. The depth is bounded by -rpcworkqueue, a full
+ * queue refuses further requests instead of piling them up.
+ */
+class CRPCWorkQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque< boost::shared_ptr<AcceptedConnection> > queue;
+    size_t nMaxDepth;
+    bool fRunning;
+
+public:
+    CRPCWorkQueue(size_t nMaxDepthIn) : nMaxDepth(nMaxDepthIn), fRunning(true) {}
+
+    //! Returns false if the queue is full or shutting down
+    bool Enqueue(const boost::shared_ptr<AcceptedConnection>& conn)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!fRunning || queue.size() >= nMaxDepth)
+            return false;
+        queue.push_back(conn);
+        cond.notify_one();
+        return true;
+    }
+
+    //! Wait for the next connection, returns an empty pointer once interrupted
+    boost::shared_ptr<AcceptedConnection> Dequeue()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (fRunning && queue.empty())
+            cond.wait(lock);
+        boost::shared_ptr<AcceptedConnection> conn;
+        if (fRunning) {
+            conn = queue.front();
+            queue.pop_front();
+        }
+        return conn;
+    }
+
+    void Interrupt()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRunning = false;
+        cond.notify_all();
+    }
+};
+
+//! Created by StartRPCThreads, destroyed in StopRPCThreads
+static CRPCWorkQueue* rpc_work_queue = NULL;
 
 void RPCTypeCheck(const Array& params,
                   const list<Value_type>& typesExpected,
@@ -272,17 +328,17 @@ static const CRPCCommand vRPCCommands[] =
 
     /* Block chain and UTXO */
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,      false,      false },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,      false,      false },
-    { "blockchain",         "getblockcount",          &getblockcount,          true,      false,      false },
-    { "blockchain",         "getblock",               &getblock,               true,      false,      false },
-    { "blockchain",         "getblockhash",           &getblockhash,           true,      false,      false },
-    { "blockchain",         "getblockheader",         &getblockheader,         false,     false,      false },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,      true,       false },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,      true,       false },
+    { "blockchain",         "getblock",               &getblock,               true,      true,       false },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,      true,       false },
+    { "blockchain",         "getblockheader",         &getblockheader,         false,     true,       false },
     { "blockchain",         "getchaintips",           &getchaintips,           true,      false,      false },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true,      false,      false },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,      true,       false },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,      true,       false },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true,      false,      false },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,      true,       false },
     { "blockchain",         "gettxout",               &gettxout,               true,      false,      false },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,      false,      false },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,      true,       false },
     { "blockchain",         "verifychain",            &verifychain,            true,      false,      false },
     { "blockchain",         "invalidateblock",        &invalidateblock,        true,      true,       false },
     { "blockchain",         "reconsiderblock",        &reconsiderblock,        true,      true,       false },
@@ -343,6 +399,7 @@ static const CRPCCommand vRPCCommands[] =
 #ifdef ENABLE_WALLET
 
     /* Wallet */
+    { "wallet",             "abortrescan",            &abortrescan,            true,      true,       true },
     { "wallet",             "addmultisigaddress",     &addmultisigaddress,     true,      false,      true },
     { "wallet",             "backupwallet",           &backupwallet,           true,      false,      true },
     { "wallet",             "dumpprivkey",            &dumpprivkey,            true,      false,      true },
@@ -359,9 +416,9 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "gettransaction",         &gettransaction,         false,     false,      true },
     { "wallet",             "getunconfirmedbalance",  &getunconfirmedbalance,  false,     false,      true },
     { "wallet",             "getwalletinfo",          &getwalletinfo,          false,     false,      true },
-    { "wallet",             "importprivkey",          &importprivkey,          true,      false,      true },
-    { "wallet",             "importwallet",           &importwallet,           true,      false,      true },
-    { "wallet",             "importaddress",          &importaddress,          true,      false,      true },
+    { "wallet",             "importprivkey",          &importprivkey,          true,      true,       true },
+    { "wallet",             "importwallet",           &importwallet,           true,      true,       true },
+    { "wallet",             "importaddress",          &importaddress,          true,      true,       true },
     { "wallet",             "keypoolrefill",          &keypoolrefill,          true,      false,      true },
     { "wallet",             "listaccounts",           &listaccounts,           false,     false,      true },
     { "wallet",             "listaddressgroupings",   &listaddressgroupings,   false,     false,      true },
@@ -489,6 +546,11 @@ public:
         _stream.close();
     }
 
+    virtual void async_wait_readable(const boost::function<void(const boost::system::error_code&)>& handler)
+    {
+        sslStream.next_layer().async_read_some(asio::null_buffers(), boost::bind(handler, asio::placeholders::error));
+    }
+
     typename Protocol::endpoint peer;
     asio::ssl::stream<typename Protocol::socket> sslStream;
 
@@ -498,6 +560,8 @@ private:
 };
 
 void ServiceConnection(AcceptedConnection *conn);
+static void QueueRPCConnection(const boost::shared_ptr<AcceptedConnection>& conn);
+static void ThreadRPCWorker();
 
 //! Forward declaration required for RPCListen
 template <typename Protocol, typename SocketAcceptorService>
@@ -561,10 +625,8 @@ static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol,
             conn->stream() << HTTPError(HTTP_FORBIDDEN, false) << std::flush;
         conn->close();
     }
-    else {
-        ServiceConnection(conn.get());
-        conn->close();
-    }
+    else
+        QueueRPCConnection(conn);
 }
 
 static ip::tcp::endpoint ParseEndpoint(const std::string &strEndpoint, int defaultPort)
@@ -631,6 +693,7 @@ void StartRPCThreads()
     rpc_ssl_context = new ssl::context(*rpc_io_service, ssl::context::sslv23);
 
     const bool fUseSSL = GetBoolArg("-rpcssl", false);
+    fRPCUseSSL = fUseSSL;
 
     if (fUseSSL)
     {
@@ -729,9 +792,16 @@ void StartRPCThreads()
         return;
     }
 
+    int nWorkQueueDepth = std::max((int)GetArg("-rpcworkqueue", DEFAULT_RPC_WORKQUEUE), 1);
+    rpc_work_queue = new CRPCWorkQueue(nWorkQueueDepth);
+    LogPrint("rpc", "Allowing %d RPC requests to wait for a thread\n", nWorkQueueDepth);
+
+    // The I/O thread accepts connections and runs the timers, the workers
+    // take requests off the queue
     rpc_worker_group = new boost::thread_group();
+    rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
     for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+        rpc_worker_group->create_thread(&ThreadRPCWorker);
     fRPCRunning = true;
 }
 
@@ -754,6 +824,8 @@ void StopRPCThreads()
     if (rpc_io_service == NULL) return;
     // Set this to false first, so that longpolling loops will exit when woken up
     fRPCRunning = false;
+    if (rpc_work_queue != NULL)
+        rpc_work_queue->Interrupt();
 
     // First, cancel all timers and acceptors
     // This is not done automatically by ->stop(), and in some cases the destructor of
@@ -780,6 +852,7 @@ void StopRPCThreads()
         rpc_worker_group->join_all();
     delete rpc_dummy_work; rpc_dummy_work = NULL;
     delete rpc_worker_group; rpc_worker_group = NULL;
+    delete rpc_work_queue; rpc_work_queue = NULL;
     delete rpc_ssl_context; rpc_ssl_context = NULL;
     delete rpc_io_service; rpc_io_service = NULL;
 }
@@ -975,40 +1048,100 @@ static bool HTTPReq_JSONRPC(AcceptedConnection *conn,
     return true;
 }
 
-void ServiceConnection(AcceptedConnection *conn)
+/**
+ * Read and answer a single request.
+ * @return whether the connection stays open for the next one
+ */
+static bool ServiceRequest(AcceptedConnection *conn)
 {
     bool fRun = true;
-    while (fRun && !ShutdownRequested())
-    {
-        int nProto = 0;
-        map<string, string> mapHeaders;
-        string strRequest, strMethod, strURI;
+    int nProto = 0;
+    map<string, string> mapHeaders;
+    string strRequest, strMethod, strURI;
 
-        // Read HTTP request line
-        if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
-            break;
+    // Read HTTP request line
+    if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
+        return false;
 
-        // Read HTTP message headers and body
-        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
+    // Read HTTP message headers and body
+    ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
 
-        // HTTP Keep-Alive is false; close connection immediately
-        if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
-            fRun = false;
+    // HTTP Keep-Alive is false; close connection immediately
+    if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
+        fRun = false;
 
-        // Process via JSON-RPC API
-        if (strURI == "/") {
-            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
-                break;
+    // Process via JSON-RPC API
+    if (strURI == "/") {
+        if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
+            return false;
 
-        // Process via HTTP REST API
-        } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
-            if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
-                break;
+    // Process via HTTP REST API
+    } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
+        if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
+            return false;
+
+    } else {
+        conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
+        return false;
+    }
+    return fRun;
+}
+
+void ServiceConnection(AcceptedConnection *conn)
+{
+    while (!ShutdownRequested() && ServiceRequest(conn))
+        ;
+}
+
+static void RPCConnectionReadable(boost::shared_ptr<AcceptedConnection> conn, const boost::system::error_code& error)
+{
+    // Errors include the wait being cancelled at shutdown
+    if (error)
+        conn->close();
+    else
+        QueueRPCConnection(conn);
+}
+
+static void QueueRPCConnection(const boost::shared_ptr<AcceptedConnection>& conn)
+{
+    if (rpc_work_queue->Enqueue(conn))
+        return;
 
-        } else {
-            conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
+    if (fRPCRunning)
+        LogPrintf("WARNING: request rejected because RPC work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
+    // Only send a 503 if we're not using SSL to prevent a DoS during the SSL handshake.
+    if (!fRPCUseSSL)
+        conn->stream() << HTTPError(HTTP_SERVICE_UNAVAILABLE, false) << std::flush;
+    conn->close();
+}
+
+static void ThreadRPCWorker()
+{
+    RenameThread("crown-rpcworker");
+    while (true) {
+        boost::shared_ptr<AcceptedConnection> conn = rpc_work_queue->Dequeue();
+        if (!conn)
             break;
+
+        // Whatever the SSL layer has buffered is invisible to the socket, so
+        // SSL connections keep their thread for as long as they stay open
+        if (fRPCUseSSL) {
+            ServiceConnection(conn.get());
+            conn->close();
+            continue;
+        }
+
+        if (!ServiceRequest(conn.get()) || ShutdownRequested()) {
+            conn->close();
+            continue;
         }
+
+        // Keep-alive: a pipelined request can be served right away, otherwise
+        // the I/O thread requeues the connection when the next one arrives
+        if (conn->stream().rdbuf()->in_avail() > 0)
+            QueueRPCConnection(conn);
+        else
+            conn->async_wait_readable(boost::bind(&RPCConnectionReadable, conn, _1));
     }
 }
 
@@ -1041,17 +1174,8 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
                 LOCK(cs_main);
                 result = pcmd->actor(params, false);
             } else {
-                while (true) {
-                    TRY_LOCK(cs_main, lockMain);
-                    if(!lockMain) { MilliSleep(50); continue; }
-                    while (true) {
-                        TRY_LOCK(pwalletMain->cs_wallet, lockWallet);
-                        if(!lockMain) { MilliSleep(50); continue; }
-                        result = pcmd->actor(params, false);
-                        break;
-                    }
-                    break;
-                }
+                LOCK2(cs_main, pwalletMain->cs_wallet);
+                result = pcmd->actor(params, false);
             }
 #else // ENABLE_WALLET
             else {
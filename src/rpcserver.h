@@ -15,6 +15,8 @@
 #include <stdint.h>
 #include <string>
 
+#include <boost/function.hpp>
+
 #include "json/json_spirit_reader_template.h"
 #include "json/json_spirit_utils.h"
 #include "json/json_spirit_writer_template.h"
@@ -22,6 +24,9 @@
 class CBlockIndex;
 class CNetAddr;
 
+/** Default for -rpcworkqueue, requests waiting for a free RPC thread */
+static const int DEFAULT_RPC_WORKQUEUE = 16;
+
 class AcceptedConnection
 {
 public:
@@ -30,6 +35,8 @@ public:
     virtual std::iostream& stream() = 0;
     virtual std::string peer_address_to_string() const = 0;
     virtual void close() = 0;
+    /** Call handler from the RPC I/O thread once the peer has sent more data */
+    virtual void async_wait_readable(const boost::function<void(const boost::system::error_code&)>& handler) = 0;
 };
 
 /** Start RPC threads */
@@ -151,6 +158,7 @@ extern json_spirit::Value importprivkey(const json_spirit::Array& params, bool f
 extern json_spirit::Value importaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value dumpwallet(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value importwallet(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value abortrescan(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getgenerate(const json_spirit::Array& params, bool fHelp); // in rpcmining.cpp
 extern json_spirit::Value setgenerate(const json_spirit::Array& params, bool fHelp);
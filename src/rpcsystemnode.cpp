@@ -107,8 +107,9 @@ Value systemnode(const Array& params, bool fHelp)
         {
             int nCount = 0;
 
-            if(chainActive.Tip())
-                snodeman.GetNextSystemnodeInQueueForPayment(chainActive.Tip()->nHeight, true, nCount);
+            CBlockIndex* pindexTip = GetBestBlockSnapshot();
+            if(pindexTip)
+                snodeman.GetNextSystemnodeInQueueForPayment(pindexTip->nHeight, true, nCount);
 
             if(params[1] == "ls") return snodeman.CountEnabled(MIN_POOL_PEER_PROTO_VERSION);
             if(params[1] == "enabled") return snodeman.CountEnabled();
@@ -347,7 +348,8 @@ Value systemnode(const Array& params, bool fHelp)
 
         Object obj;
 
-        for(int nHeight = chainActive.Tip()->nHeight-nLast; nHeight < chainActive.Tip()->nHeight+20; nHeight++)
+        const int nTipHeight = GetBestBlockSnapshot()->nHeight;
+        for(int nHeight = nTipHeight-nLast; nHeight < nTipHeight+20; nHeight++)
         {
             obj.push_back(Pair(strprintf("%d", nHeight), SNGetRequiredPaymentsString(nHeight)));
         }
@@ -369,7 +371,8 @@ Value systemnode(const Array& params, bool fHelp)
         Object obj;
 
         std::vector<CSystemnode> vSystemnodes = snodeman.GetFullSystemnodeVector();
-        for(int nHeight = chainActive.Tip()->nHeight-nLast; nHeight < chainActive.Tip()->nHeight+20; nHeight++){
+        const int nTipHeight = GetBestBlockSnapshot()->nHeight;
+        for(int nHeight = nTipHeight-nLast; nHeight < nTipHeight+20; nHeight++){
             arith_uint256  nHigh = 0;
             CSystemnode *pBestSystemnode = NULL;
             BOOST_FOREACH(CSystemnode& mn, vSystemnodes) {
@@ -427,7 +430,7 @@ Value systemnodelist(const Array& params, bool fHelp)
 
     Object obj;
     if (strMode == "rank") {
-        std::vector<pair<int, CSystemnode> > vSystemnodeRanks = snodeman.GetSystemnodeRanks(chainActive.Tip()->nHeight);
+        std::vector<pair<int, CSystemnode> > vSystemnodeRanks = snodeman.GetSystemnodeRanks(GetBestBlockSnapshot()->nHeight);
         BOOST_FOREACH(PAIRTYPE(int, CSystemnode)& s, vSystemnodeRanks) {
             std::string strVin = s.second.vin.prevout.ToStringShort();
             if(strFilter !="" && strVin.find(strFilter) == string::npos) continue;
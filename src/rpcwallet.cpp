@@ -2055,6 +2055,11 @@ Value getwalletinfo(const Array& params, bool fHelp)
             "  \"keypoololdest\": xxxxxx,    (numeric) the timestamp (seconds since GMT epoch) of the oldest pre-generated key in the key pool\n"
             "  \"keypoolsize\": xxxx,        (numeric) how many new keys are pre-generated\n"
             "  \"unlocked_until\": ttt,      (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
+            "  \"scanning\":                 (json object) only present while the wallet is rescanning the chain\n"
+            "  {\n"
+            "    \"duration\" : xxxx,        (numeric) elapsed seconds since the rescan started\n"
+            "    \"progress\" : x.xxxx,      (numeric) rescan progress, from 0 to 1\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getwalletinfo", "")
@@ -2069,5 +2074,13 @@ Value getwalletinfo(const Array& params, bool fHelp)
     obj.push_back(Pair("keypoolsize",   (int)pwalletMain->GetKeyPoolSize()));
     if (pwalletMain->IsCrypted())
         obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
+    double dProgress;
+    int64_t nDuration;
+    if (pwalletMain->GetRescanProgress(dProgress, nDuration)) {
+        Object scanning;
+        scanning.push_back(Pair("duration", nDuration));
+        scanning.push_back(Pair("progress", dProgress));
+        obj.push_back(Pair("scanning", scanning));
+    }
     return obj;
 }
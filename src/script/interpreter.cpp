@@ -11,6 +11,7 @@
 #include "crypto/sha256.h"
 #include "pubkey.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 
 using namespace std;
@@ -1024,7 +1025,38 @@ public:
 
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+void PrecomputedTransactionData::Init(const CTransaction& txTo)
+{
+    // serialized as for SIGHASH_ALL with an input index past the end, so that
+    // every input is blanked
+    const CScript scriptEmpty;
+    CTransactionSignatureSerializer txTmp(txTo, scriptEmpty, txTo.vin.size(), SIGHASH_ALL);
+
+    CDataStream ss(SER_GETHASH, 0);
+    ss << txTo.nVersion;
+    ::WriteCompactSize(ss, txTo.vin.size());
+    CHash256 hasher;
+    hasher.Write((const unsigned char*)&ss[0], ss.size());
+
+    ss.clear();
+    for (unsigned int nInput = 0; nInput < txTo.vin.size(); nInput++)
+        txTmp.SerializeInput(ss, nInput, SER_GETHASH, 0);
+    assert(ss.size() == txTo.vin.size() * BLANK_INPUT_SIZE);
+    ::WriteCompactSize(ss, txTo.vout.size());
+    for (unsigned int nOutput = 0; nOutput < txTo.vout.size(); nOutput++)
+        txTmp.SerializeOutput(ss, nOutput, SER_GETHASH, 0);
+    ss << txTo.nLockTime;
+    vchTail.assign(ss.begin(), ss.end());
+
+    vInputMidstates.clear();
+    vInputMidstates.reserve(txTo.vin.size());
+    for (unsigned int nInput = 0; nInput < txTo.vin.size(); nInput++) {
+        vInputMidstates.push_back(hasher);
+        hasher.Write(&vchTail[nInput * BLANK_INPUT_SIZE], BLANK_INPUT_SIZE);
+    }
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* cache)
 {
     static const uint256 one(uint256S("0000000000000000000000000000000000000000000000000000000000000001"));
     if (nIn >= txTo.vin.size()) {
@@ -1043,6 +1075,18 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    if (cache && !cache->IsNull() && !(nHashType & SIGHASH_ANYONECANPAY) &&
+        (nHashType & 0x1f) != SIGHASH_NONE && (nHashType & 0x1f) != SIGHASH_SINGLE) {
+        // Continue from the state before this input, only the input itself
+        // has to be serialized, the rest is copied from the cache
+        CHashWriter ss(cache->vInputMidstates[nIn], SER_GETHASH, 0);
+        txTmp.SerializeInput(ss, nIn, SER_GETHASH, 0);
+        size_t nTail = (nIn + 1) * PrecomputedTransactionData::BLANK_INPUT_SIZE;
+        ss.write((const char*)&cache->vchTail[nTail], cache->vchTail.size() - nTail);
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1067,7 +1111,7 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
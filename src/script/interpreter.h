@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include "hash.h"
 #include "script_error.h"
 #include "primitives/transaction.h"
 
@@ -72,7 +73,28 @@ enum
 
 };
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+/**
+ * The parts of the SIGHASH_ALL signature hash that are the same for every
+ * input of a transaction, so they are serialized once instead of once per
+ * input: the hasher state before each input, all other inputs being blanked,
+ * and the serialization of the blanked inputs, the outputs and nLockTime.
+ */
+struct PrecomputedTransactionData
+{
+    //! Size of a serialized input with an empty script
+    static const size_t BLANK_INPUT_SIZE = 41;
+
+    std::vector<CHash256> vInputMidstates;
+    std::vector<unsigned char> vchTail;
+
+    PrecomputedTransactionData() {}
+    explicit PrecomputedTransactionData(const CTransaction& txTo) { Init(txTo); }
+
+    void Init(const CTransaction& txTo);
+    bool IsNull() const { return vInputMidstates.empty(); }
+};
+
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* cache = NULL);
 
 class BaseSignatureChecker
 {
@@ -90,12 +112,13 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn = NULL) : txTo(txToIn), nIn(nInIn), txdata(txdataIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
 };
 
@@ -18,6 +18,8 @@
 #include <utility>
 #include <vector>
 
+#include <boost/shared_ptr.hpp>
+
 #include "prevector.h"
 
 static const unsigned int MAX_SIZE = 0x02000000;
@@ -491,6 +493,13 @@ template<typename K, typename Pred, typename A> unsigned int GetSerializeSize(co
 template<typename Stream, typename K, typename Pred, typename A> void Serialize(Stream& os, const std::set<K, Pred, A>& m, int nType, int nVersion);
 template<typename Stream, typename K, typename Pred, typename A> void Unserialize(Stream& is, std::set<K, Pred, A>& m, int nType, int nVersion);
 
+/**
+ * shared_ptr to an immutable object, serialized as the object itself
+ */
+template<typename T> unsigned int GetSerializeSize(const boost::shared_ptr<const T>& p, int nType, int nVersion);
+template<typename Stream, typename T> void Serialize(Stream& os, const boost::shared_ptr<const T>& p, int nType, int nVersion);
+template<typename Stream, typename T> void Unserialize(Stream& is, boost::shared_ptr<const T>& p, int nType, int nVersion);
+
 
 
 
@@ -828,6 +837,31 @@ void Unserialize(Stream& is, std::set<K, Pred, A>& m, int nType, int nVersion)
 
 
 
+/**
+ * shared_ptr
+ */
+template<typename T>
+unsigned int GetSerializeSize(const boost::shared_ptr<const T>& p, int nType, int nVersion)
+{
+    return GetSerializeSize(*p, nType, nVersion);
+}
+
+template<typename Stream, typename T>
+void Serialize(Stream& os, const boost::shared_ptr<const T>& p, int nType, int nVersion)
+{
+    Serialize(os, *p, nType, nVersion);
+}
+
+template<typename Stream, typename T>
+void Unserialize(Stream& is, boost::shared_ptr<const T>& p, int nType, int nVersion)
+{
+    boost::shared_ptr<T> pnew(new T());
+    Unserialize(is, *pnew, nType, nVersion);
+    p = pnew;
+}
+
+
+
 /**
  * Support for ADD_SERIALIZE_METHODS and READWRITE macro
  */
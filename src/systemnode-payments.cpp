@@ -67,8 +67,9 @@ bool CSystemnodePayments::IsTransactionValid(const CTransaction& txNew, int nBlo
 {
     LOCK(cs_mapSystemnodeBlocks);
 
-    if(mapSystemnodeBlocks.count(nBlockHeight)){
-        return mapSystemnodeBlocks[nBlockHeight].IsTransactionValid(txNew);
+    std::map<int, CSystemnodeBlockPayees>::iterator it = mapSystemnodeBlocks.find(nBlockHeight);
+    if(it != mapSystemnodeBlocks.end()){
+        return it->second.IsTransactionValid(txNew);
     }
 
     return true;
@@ -267,8 +268,9 @@ std::string CSystemnodePayments::GetRequiredPaymentsString(int nBlockHeight)
 {
     LOCK(cs_mapSystemnodeBlocks);
 
-    if(mapSystemnodeBlocks.count(nBlockHeight)){
-        return mapSystemnodeBlocks[nBlockHeight].GetRequiredPaymentsString();
+    std::map<int, CSystemnodeBlockPayees>::iterator it = mapSystemnodeBlocks.find(nBlockHeight);
+    if(it != mapSystemnodeBlocks.end()){
+        return it->second.GetRequiredPaymentsString();
     }
 
     return "Unknown";
@@ -323,8 +325,9 @@ bool CSystemnodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 
 bool CSystemnodePayments::GetBlockPayee(int nBlockHeight, CScript& payee)
 {
-    if(mapSystemnodeBlocks.count(nBlockHeight)){
-        return mapSystemnodeBlocks[nBlockHeight].GetPayee(payee);
+    std::map<int, CSystemnodeBlockPayees>::iterator it = mapSystemnodeBlocks.find(nBlockHeight);
+    if(it != mapSystemnodeBlocks.end()){
+        return it->second.GetPayee(payee);
     }
 
     return false;
@@ -344,18 +347,34 @@ void CSystemnodePayments::CheckAndRemove()
     //keep up to five cycles for historical sake
     int nLimit = std::max(int(snodeman.size()*1.25), 1000);
 
-    std::map<uint256, CSystemnodePaymentWinner>::iterator it = mapSystemnodePayeeVotes.begin();
-    while(it != mapSystemnodePayeeVotes.end()) {
-        CSystemnodePaymentWinner winner = (*it).second;
+    RemoveVotesBelow(nHeight - nLimit);
+}
 
-        if(nHeight - winner.nBlockHeight > nLimit){
-            LogPrint("snpayments", "CSystemnodePayments::CleanPaymentList - Removing old Systemnode payment - block %d\n", winner.nBlockHeight);
-            systemnodeSync.mapSeenSyncSNW.erase((*it).first);
-            mapSystemnodePayeeVotes.erase(it++);
-            mapSystemnodeBlocks.erase(winner.nBlockHeight);
-        } else {
-            ++it;
+void CSystemnodePayments::RemoveVotesBelow(int nBlockHeight)
+{
+    LOCK2(cs_mapSystemnodePayeeVotes, cs_mapSystemnodeBlocks);
+
+    std::map<int, std::vector<uint256> >::iterator it = mapVotesByHeight.begin();
+    while(it != mapVotesByHeight.end() && it->first < nBlockHeight) {
+        LogPrint("snpayments", "CSystemnodePayments::CleanPaymentList - Removing old Systemnode payments - block %d\n", it->first);
+        BOOST_FOREACH(const uint256& hash, it->second) {
+            systemnodeSync.mapSeenSyncSNW.erase(hash);
+            mapSystemnodePayeeVotes.erase(hash);
         }
+        mapVotesByHeight.erase(it++);
+    }
+
+    mapSystemnodeBlocks.erase(mapSystemnodeBlocks.begin(), mapSystemnodeBlocks.lower_bound(nBlockHeight));
+}
+
+void CSystemnodePayments::RebuildVotesByHeight()
+{
+    LOCK(cs_mapSystemnodePayeeVotes);
+
+    mapVotesByHeight.clear();
+    std::map<uint256, CSystemnodePaymentWinner>::const_iterator it = mapSystemnodePayeeVotes.begin();
+    for(; it != mapSystemnodePayeeVotes.end(); ++it) {
+        mapVotesByHeight[it->second.nBlockHeight].push_back(it->first);
     }
 }
 
@@ -488,6 +507,7 @@ bool CSystemnodePayments::AddWinningSystemnode(CSystemnodePaymentWinner& winnerI
         }
 
         mapSystemnodePayeeVotes[winnerIn.GetHash()] = winnerIn;
+        mapVotesByHeight[winnerIn.nBlockHeight].push_back(winnerIn.GetHash());
 
         if(!mapSystemnodeBlocks.count(winnerIn.nBlockHeight)){
            CSystemnodeBlockPayees blockPayees(winnerIn.nBlockHeight);
@@ -545,14 +565,12 @@ void CSystemnodePayments::Sync(CNode* node, int nCountNeeded)
     if(nCountNeeded > nCount) nCountNeeded = nCount;
 
     int nInvCount = 0;
-    std::map<uint256, CSystemnodePaymentWinner>::iterator it = mapSystemnodePayeeVotes.begin();
-    while(it != mapSystemnodePayeeVotes.end()) {
-        CSystemnodePaymentWinner winner = (*it).second;
-        if(winner.nBlockHeight >= nHeight-nCountNeeded && winner.nBlockHeight <= nHeight + 20) {
-            node->PushInventory(CInv(MSG_SYSTEMNODE_WINNER, winner.GetHash()));
+    std::map<int, std::vector<uint256> >::const_iterator it = mapVotesByHeight.lower_bound(nHeight - nCountNeeded);
+    for(; it != mapVotesByHeight.end() && it->first <= nHeight + 20; ++it) {
+        BOOST_FOREACH(const uint256& hash, it->second) {
+            node->PushInventory(CInv(MSG_SYSTEMNODE_WINNER, hash));
             nInvCount++;
         }
-        ++it;
     }
     node->PushMessage("snssc", SYSTEMNODE_SYNC_SNW, nInvCount);
 }
@@ -574,13 +592,12 @@ bool CSystemnodePayments::IsScheduled(CSystemnode& sn, int nNotBlockHeight)
     snpayee = GetScriptForDestination(sn.pubkey.GetID());
 
     CScript payee;
-    for(int64_t h = nHeight; h <= nHeight+8; h++){
-        if(h == nNotBlockHeight) continue;
-        if(mapSystemnodeBlocks.count(h)){
-            if(mapSystemnodeBlocks[h].GetPayee(payee)){
-                if(snpayee == payee) {
-                    return true;
-                }
+    std::map<int, CSystemnodeBlockPayees>::iterator it = mapSystemnodeBlocks.lower_bound(nHeight);
+    for(; it != mapSystemnodeBlocks.end() && it->first <= nHeight+8; ++it){
+        if(it->first == nNotBlockHeight) continue;
+        if(it->second.GetPayee(payee)){
+            if(snpayee == payee) {
+                return true;
             }
         }
     }
@@ -195,6 +195,12 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // hashes of mapSystemnodePayeeVotes by block height, so that syncing a range
+    // of heights and pruning old ones don't have to walk all the votes
+    std::map<int, std::vector<uint256> > mapVotesByHeight;
+
+    void RebuildVotesByHeight();
+
 public:
     std::map<uint256, CSystemnodePaymentWinner> mapSystemnodePayeeVotes;
     std::map<int, CSystemnodeBlockPayees> mapSystemnodeBlocks;
@@ -210,6 +216,7 @@ public:
         LOCK2(cs_mapSystemnodeBlocks, cs_mapSystemnodePayeeVotes);
         mapSystemnodeBlocks.clear();
         mapSystemnodePayeeVotes.clear();
+        mapVotesByHeight.clear();
     }
 
     bool ProcessBlock(int nBlockHeight);
@@ -217,6 +224,8 @@ public:
     void ProcessMessageSystemnodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
     void Sync(CNode* node, int nCountNeeded);
     void CheckAndRemove();
+    /// Forget the votes and payees for blocks below nBlockHeight
+    void RemoveVotesBelow(int nBlockHeight);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
     bool IsScheduled(CSystemnode& sn, int nNotBlockHeight);
@@ -229,8 +238,10 @@ public:
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        LOCK2(cs_mapSystemnodePayeeVotes, cs_mapSystemnodeBlocks);
         READWRITE(mapSystemnodePayeeVotes);
         READWRITE(mapSystemnodeBlocks);
+        if(ser_action.ForRead()) RebuildVotesByHeight();
     }
 };
 
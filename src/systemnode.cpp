@@ -172,6 +172,9 @@ CSystemnode::CSystemnode()
     unitTest = false;
     protocolVersion = PROTOCOL_VERSION;
     lastTimeChecked = 0;
+    cacheInputAge = 0;
+    cacheInputAgeBlock = 0;
+    nCollateralHeight = -1;
 }
 
 CSystemnode::CSystemnode(const CSystemnode& other)
@@ -188,6 +191,10 @@ CSystemnode::CSystemnode(const CSystemnode& other)
     unitTest = other.unitTest;
     protocolVersion = other.protocolVersion;
     lastTimeChecked = 0;
+    cacheInputAge = other.cacheInputAge;
+    cacheInputAgeBlock = other.cacheInputAgeBlock;
+    nCollateralHeight = other.nCollateralHeight;
+    collateralMinConfBlockHash = other.collateralMinConfBlockHash;
 }
 
 CSystemnode::CSystemnode(const CSystemnodeBroadcast& snb)
@@ -204,6 +211,9 @@ CSystemnode::CSystemnode(const CSystemnodeBroadcast& snb)
     unitTest = false;
     protocolVersion = snb.protocolVersion;
     lastTimeChecked = 0;
+    cacheInputAge = 0;
+    cacheInputAgeBlock = 0;
+    nCollateralHeight = -1;
 }
 
 bool CSystemnode::IsValidNetAddr()
@@ -224,10 +234,9 @@ arith_uint256 CSystemnode::CalculateScore(int64_t nBlockHeight) const
         return arith_uint256();
 
     // Find the block hash where tx got SYSTEMNODE_MIN_CONFIRMATIONS
-    CBlockIndex *pblockIndex = chainActive[GetInputHeight(vin) + SYSTEMNODE_MIN_CONFIRMATIONS - 1];
-    if (!pblockIndex)
+    uint256 collateralMinConfBlockHash = uint256();
+    if(!GetCollateralMinConfBlockHash(collateralMinConfBlockHash))
         return arith_uint256();
-    uint256 collateralMinConfBlockHash = pblockIndex->GetBlockHash();
 
     uint256 hash = uint256();
 
@@ -263,6 +272,47 @@ bool CSystemnode::UpdateFromNewBroadcast(const CSystemnodeBroadcast& snb)
     return false;
 }
 
+//
+// The collateral is looked up in the coins view only until it gets SYSTEMNODE_MIN_CONFIRMATIONS,
+// after that the cached block hash is enough to notice a reorg that moved or removed it
+//
+void CSystemnode::UpdateCollateral() const
+{
+    LOCK(cs);
+
+    if(!collateralMinConfBlockHash.IsNull()) {
+        CBlockIndex* pindex = chainActive[nCollateralHeight + SYSTEMNODE_MIN_CONFIRMATIONS - 1];
+        if(pindex && pindex->GetBlockHash() == collateralMinConfBlockHash) return;
+    }
+
+    nCollateralHeight = -1;
+    collateralMinConfBlockHash = uint256();
+
+    int nHeight = GetInputHeight(vin);
+    if(nHeight < 0 || nHeight == (int)MEMPOOL_HEIGHT) return;
+
+    nCollateralHeight = nHeight;
+    CBlockIndex* pindex = chainActive[nHeight + SYSTEMNODE_MIN_CONFIRMATIONS - 1];
+    if(pindex) collateralMinConfBlockHash = pindex->GetBlockHash();
+}
+
+int CSystemnode::GetCollateralHeight() const
+{
+    LOCK(cs);
+    UpdateCollateral();
+    return nCollateralHeight;
+}
+
+bool CSystemnode::GetCollateralMinConfBlockHash(uint256& hash) const
+{
+    LOCK(cs);
+    UpdateCollateral();
+    if(collateralMinConfBlockHash.IsNull()) return false;
+
+    hash = collateralMinConfBlockHash;
+    return true;
+}
+
 void CSystemnode::Check(bool forceCheck)
 {
     if(ShutdownRequested()) return;
@@ -298,6 +348,10 @@ void CSystemnode::Check(bool forceCheck)
 
             if(!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)){
                 activeState = SYSTEMNODE_VIN_SPENT;
+                // the collateral is gone, don't use the cached blocks anymore
+                LOCK(cs);
+                nCollateralHeight = -1;
+                collateralMinConfBlockHash = uint256();
                 return;
             }
         }
@@ -494,7 +548,7 @@ bool CSystemnodeBroadcast::CheckAndUpdate(int& nDos) const
     if(psn->pubkey == pubkey && !psn->IsBroadcastedWithin(SYSTEMNODE_MIN_SNB_SECONDS)) {
         //take the newest entry
         LogPrintf("snb - Got updated entry for %s\n", addr.ToString());
-        if(psn->UpdateFromNewBroadcast((*this))){
+        if(snodeman.UpdateFromNewBroadcast(psn, *this)){
             psn->Check();
             if(psn->IsEnabled()) Relay();
         }
@@ -562,11 +616,19 @@ bool CSystemnodeBroadcast::CheckInputsAndAdd(int& nDoS) const
     // should be at least not earlier than block when 10000 CRW tx got SYSTEMNODE_MIN_CONFIRMATIONS
     uint256 hashBlock = uint256();
     CTransaction tx2;
-    GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi != mapBlockIndex.end() && (*mi).second)
+    CBlockIndex* pMNIndex = NULL; // block for 10000 CRW tx -> 1 confirmation
+    if (GetTransaction(vin.prevout.hash, tx2, hashBlock, true)) {
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi != mapBlockIndex.end())
+            pMNIndex = (*mi).second;
+    } else if (fPruneMode) {
+        // the collateral block may be pruned, the coins still know its height
+        int nHeight = GetInputHeight(vin);
+        if (nHeight > 0 && nHeight != MEMPOOL_HEIGHT)
+            pMNIndex = chainActive[nHeight];
+    }
+    if (pMNIndex)
     {
-        CBlockIndex* pMNIndex = (*mi).second; // block for 10000 CRW tx -> 1 confirmation
         CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + SYSTEMNODE_MIN_CONFIRMATIONS - 1]; // block where tx got SYSTEMNODE_MIN_CONFIRMATIONS
         if(pConfIndex->GetBlockTime() > sigTime)
         {
@@ -578,6 +640,7 @@ bool CSystemnodeBroadcast::CheckInputsAndAdd(int& nDoS) const
 
     LogPrintf("snb - Got NEW systemnode entry - %s - %s - %s - %lli \n", GetHash().ToString(), addr.ToString(), vin.ToString(), sigTime);
     CSystemnode sn(*this);
+    sn.UpdateCollateral();
     snodeman.Add(sn);
 
     // if it matches our systemnode privkey, then we've been remotely activated
@@ -109,6 +109,10 @@ private:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
     int64_t lastTimeChecked;
+    // height of the block with the collateral and the block where it got SYSTEMNODE_MIN_CONFIRMATIONS,
+    // cached so that score and age calculations don't have to look the collateral up in the coins view
+    mutable int nCollateralHeight;
+    mutable uint256 collateralMinConfBlockHash;
 public:
     enum state
     {
@@ -153,6 +157,8 @@ public:
         swap(first.lastPing, second.lastPing);
         swap(first.unitTest, second.unitTest);
         swap(first.protocolVersion, second.protocolVersion);
+        swap(first.nCollateralHeight, second.nCollateralHeight);
+        swap(first.collateralMinConfBlockHash, second.collateralMinConfBlockHash);
     }
 
     CSystemnode& operator=(CSystemnode from)
@@ -206,13 +212,21 @@ public:
     {
         if(chainActive.Tip() == NULL) return 0;
 
-        if(cacheInputAge == 0){
-            cacheInputAge = GetInputAge(vin);
-            cacheInputAgeBlock = chainActive.Tip()->nHeight;
-        }
+        int nHeight = GetCollateralHeight();
+        if(nHeight < 0) return 0;
 
-        return cacheInputAge+(chainActive.Tip()->nHeight-cacheInputAgeBlock);
+        cacheInputAge = (chainActive.Tip()->nHeight + 1) - nHeight;
+        cacheInputAgeBlock = chainActive.Tip()->nHeight;
+
+        return cacheInputAge;
     }
+
+    /// Look the collateral up unless the cached blocks are still in the active chain
+    void UpdateCollateral() const;
+    /// Height of the block with the collateral, -1 if it's unconfirmed or spent
+    int GetCollateralHeight() const;
+    /// Hash of the block where the collateral got SYSTEMNODE_MIN_CONFIRMATIONS
+    bool GetCollateralMinConfBlockHash(uint256& hash) const;
     bool IsPingedWithin(int seconds, int64_t now = -1) const
     {
         now == -1 ? now = GetAdjustedTime() : now;
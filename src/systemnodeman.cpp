@@ -264,36 +264,52 @@ CSystemnode *CSystemnodeMan::Find(const CTxIn &vin)
 {
     LOCK(cs);
 
-    BOOST_FOREACH(CSystemnode& sn, vSystemnodes)
-    {
-        if(sn.vin.prevout == vin.prevout)
-            return &sn;
-    }
-    return NULL;
+    std::map<COutPoint, size_t>::const_iterator it = mapIndexByVin.find(vin.prevout);
+    if(it == mapIndexByVin.end()) return NULL;
+
+    return &vSystemnodes[it->second];
 }
 
 CSystemnode *CSystemnodeMan::Find(const CPubKey &pubKeySystemnode)
 {
     LOCK(cs);
 
-    BOOST_FOREACH(CSystemnode& mn, vSystemnodes)
-    {
-        if(mn.pubkey2 == pubKeySystemnode)
-            return &mn;
-    }
-    return NULL;
+    std::map<CPubKey, size_t>::const_iterator it = mapIndexByPubKey.find(pubKeySystemnode);
+    if(it == mapIndexByPubKey.end()) return NULL;
+
+    return &vSystemnodes[it->second];
 }
 
 CSystemnode *CSystemnodeMan::Find(const CService& addr)
 {
     LOCK(cs);
 
-    BOOST_FOREACH(CSystemnode& sn, vSystemnodes)
-    {
-        if(sn.addr == addr)
-            return &sn;
-    }
-    return NULL;
+    std::map<CService, size_t>::const_iterator it = mapIndexByAddr.find(addr);
+    if(it == mapIndexByAddr.end()) return NULL;
+
+    return &vSystemnodes[it->second];
+}
+
+void CSystemnodeMan::AddToIndexes(size_t nIndex)
+{
+    AssertLockHeld(cs);
+
+    const CSystemnode& sn = vSystemnodes[nIndex];
+    mapIndexByVin.insert(make_pair(sn.vin.prevout, nIndex));
+    mapIndexByPubKey.insert(make_pair(sn.pubkey2, nIndex));
+    mapIndexByAddr.insert(make_pair(sn.addr, nIndex));
+}
+
+void CSystemnodeMan::RebuildIndexes()
+{
+    AssertLockHeld(cs);
+
+    mapIndexByVin.clear();
+    mapIndexByPubKey.clear();
+    mapIndexByAddr.clear();
+
+    for(size_t i = 0; i < vSystemnodes.size(); i++)
+        AddToIndexes(i);
 }
 
 // 
@@ -374,6 +390,7 @@ bool CSystemnodeMan::Add(CSystemnode &sn)
     {
         LogPrint("systemnode", "CSystemnodeMan: Adding new Systemnode %s - %i now\n", sn.addr.ToString(), size() + 1);
         vSystemnodes.push_back(sn);
+        AddToIndexes(vSystemnodes.size() - 1);
         return true;
     }
 
@@ -393,10 +410,27 @@ void CSystemnodeMan::UpdateSystemnodeList(CSystemnodeBroadcast snb) {
         CSystemnode sn(snb);
         Add(sn);
     } else {
-        psn->UpdateFromNewBroadcast(snb);
+        UpdateFromNewBroadcast(psn, snb);
     }
 }
 
+bool CSystemnodeMan::UpdateFromNewBroadcast(CSystemnode* psn, const CSystemnodeBroadcast& snb)
+{
+    LOCK(cs);
+
+    CPubKey pubkey2Old = psn->pubkey2;
+    CService addrOld = psn->addr;
+
+    if(!psn->UpdateFromNewBroadcast(snb)) return false;
+
+    // a systemnode moving to another address or key is rare, reindex everything then
+    // to keep the first-wins order for the other entries sharing the old keys
+    if(psn->pubkey2 != pubkey2Old || psn->addr != addrOld)
+        RebuildIndexes();
+
+    return true;
+}
+
 void CSystemnodeMan::Remove(CTxIn vin)
 {
     LOCK(cs);
@@ -406,6 +440,7 @@ void CSystemnodeMan::Remove(CTxIn vin)
         if((*it).vin == vin){
             LogPrint("systemnode", "CSystemnodeMan: Removing Systemnode %s - %i now\n", (*it).addr.ToString(), size() - 1);
             vSystemnodes.erase(it);
+            RebuildIndexes();
             break;
         }
         ++it;
@@ -414,6 +449,8 @@ void CSystemnodeMan::Remove(CTxIn vin)
 
 int CSystemnodeMan::CountEnabled(int protocolVersion)
 {
+    LOCK(cs);
+
     int i = 0;
     protocolVersion = protocolVersion == -1 ? systemnodePayments.GetMinSystemnodePaymentsProto() : protocolVersion;
 
@@ -464,6 +501,7 @@ void CSystemnodeMan::Clear()
 {
     LOCK(cs);
     vSystemnodes.clear();
+    RebuildIndexes();
     mAskedUsForSystemnodeList.clear();
     mWeAskedForSystemnodeList.clear();
     mWeAskedForSystemnodeListEntry.clear();
@@ -543,6 +581,7 @@ void CSystemnodeMan::CheckAndRemove(bool forceExpiredRemoval)
     LOCK(cs);
 
     //remove inactive and outdated
+    bool fRemoved = false;
     vector<CSystemnode>::iterator it = vSystemnodes.begin();
     while(it != vSystemnodes.end()){
         if((*it).activeState == CSystemnode::SYSTEMNODE_REMOVE ||
@@ -575,11 +614,14 @@ void CSystemnodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vSystemnodes.erase(it);
+            fRemoved = true;
         } else {
             ++it;
         }
     }
 
+    if(fRemoved) RebuildIndexes();
+
     // check who's asked for the Systemnode list
     map<CNetAddr, int64_t>::iterator it1 = mAskedUsForSystemnodeList.begin();
     while(it1 != mAskedUsForSystemnodeList.end()){
@@ -33,6 +33,11 @@ private:
 
     // map to hold all SNs
     std::vector<CSystemnode> vSystemnodes;
+    // positions in vSystemnodes by collateral, systemnode key and address,
+    // if several systemnodes share a key the first one wins, as it did with the list scans
+    std::map<COutPoint, size_t> mapIndexByVin;
+    std::map<CPubKey, size_t> mapIndexByPubKey;
+    std::map<CService, size_t> mapIndexByAddr;
     // who's asked for the Systemnode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForSystemnodeList;
     // who we asked for the Systemnode list and the last time
@@ -40,6 +45,11 @@ private:
     // which Systemnodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForSystemnodeListEntry;
 
+    /// Index the entry at the given position of vSystemnodes
+    void AddToIndexes(size_t nIndex);
+    /// Index vSystemnodes from scratch, must be called whenever entries are erased
+    void RebuildIndexes();
+
 public:
     // Keep track of all broadcasts I've seen
     map<uint256, CSystemnodeBroadcast> mapSeenSystemnodeBroadcast;
@@ -52,12 +62,18 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         LOCK(cs);
         READWRITE(vSystemnodes);
-        READWRITE(mAskedUsForSystemnodeList);
-        READWRITE(mWeAskedForSystemnodeList);
-        READWRITE(mWeAskedForSystemnodeListEntry);
-
-        READWRITE(mapSeenSystemnodeBroadcast);
-        READWRITE(mapSeenSystemnodePing);
+        if (ser_action.ForRead())
+            RebuildIndexes();
+        // the request and seen caches change all the time, they are left
+        // out of the hash that tells whether sncache.dat needs rewriting
+        if (!(nType & SER_GETHASH)) {
+            READWRITE(mAskedUsForSystemnodeList);
+            READWRITE(mWeAskedForSystemnodeList);
+            READWRITE(mWeAskedForSystemnodeListEntry);
+
+            READWRITE(mapSeenSystemnodeBroadcast);
+            READWRITE(mapSeenSystemnodePing);
+        }
     }
 
     //CSystemnodeMan();
@@ -109,6 +125,9 @@ public:
 
     void Remove(CTxIn vin);
 
+    /// Update an entry from a newer broadcast keeping the indexes in sync
+    bool UpdateFromNewBroadcast(CSystemnode* psn, const CSystemnodeBroadcast& snb);
+
     /// Update systemnode list and maps using provided CSystemnodeBroadcast
     void UpdateSystemnodeList(CSystemnodeBroadcast snb);
 
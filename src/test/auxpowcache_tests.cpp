@@ -0,0 +1,87 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "auxpowcache.h"
+#include "arith_uint256.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    boost::shared_ptr<CAuxPow> CreateAuxPow(int n)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << n;
+        tx.vout.resize(1);
+
+        boost::shared_ptr<CAuxPow> auxpow(new CAuxPow(tx));
+        auxpow->vChainMerkleBranch.resize(4);
+        auxpow->nChainIndex = n;
+        return auxpow;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(auxpowcache_tests)
+
+BOOST_AUTO_TEST_CASE(auxpowcache_insert_get)
+{
+    CAuxPowCache cache;
+    boost::shared_ptr<CAuxPow> auxpow = CreateAuxPow(1);
+
+    BOOST_CHECK(!cache.Get(ArithToUint256(1)));
+
+    cache.Insert(ArithToUint256(1), auxpow);
+    BOOST_CHECK(cache.Get(ArithToUint256(1)) == auxpow);
+    BOOST_CHECK(!cache.Get(ArithToUint256(2)));
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+    BOOST_CHECK(cache.DynamicMemoryUsage() > 0);
+
+    // inserting the same block again doesn't count it twice
+    size_t nUsage = cache.DynamicMemoryUsage();
+    cache.Insert(ArithToUint256(1), CreateAuxPow(1));
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), nUsage);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(auxpowcache_evicts_least_recently_used)
+{
+    CAuxPowCache probe;
+    probe.Insert(ArithToUint256(1), CreateAuxPow(1));
+    const size_t nEntryUsage = probe.DynamicMemoryUsage();
+
+    // room for exactly ten entries
+    CAuxPowCache cache(10 * nEntryUsage);
+    for (int i = 0; i < 10; ++i)
+        cache.Insert(ArithToUint256(i), CreateAuxPow(i));
+    BOOST_CHECK_EQUAL(cache.size(), 10U);
+    BOOST_CHECK(cache.IsFull());
+
+    // touch the oldest entry, so the second oldest is the one to go
+    BOOST_CHECK(cache.Get(ArithToUint256(0)));
+    cache.Insert(ArithToUint256(10), CreateAuxPow(10));
+
+    BOOST_CHECK_EQUAL(cache.size(), 10U);
+    BOOST_CHECK(cache.Contains(ArithToUint256(0)));
+    BOOST_CHECK(!cache.Contains(ArithToUint256(1)));
+    BOOST_CHECK(cache.Contains(ArithToUint256(10)));
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= 10 * nEntryUsage);
+
+    // shrinking the limit drops the least recently used entries right away
+    cache.SetMaxUsage(5 * nEntryUsage);
+    BOOST_CHECK_EQUAL(cache.size(), 5U);
+    BOOST_CHECK(cache.Contains(ArithToUint256(10)));
+    BOOST_CHECK(!cache.Contains(ArithToUint256(2)));
+
+    // a zero limit disables the cache
+    cache.SetMaxUsage(0);
+    cache.Insert(ArithToUint256(11), CreateAuxPow(11));
+    BOOST_CHECK_EQUAL(cache.size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
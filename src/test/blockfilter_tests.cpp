@@ -0,0 +1,118 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "arith_uint256.h"
+#include "primitives/block.h"
+#include "script/script.h"
+
+#include <ios>
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    CGolombCodedSet::Element CreateElement(int n)
+    {
+        CScript script = CScript() << OP_DUP << OP_HASH160 << n << OP_EQUALVERIFY << OP_CHECKSIG;
+        return CBlockFilter::ScriptElement(script);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(blockfilter_tests)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_match)
+{
+    CGolombCodedSet::ElementSet included;
+    CGolombCodedSet::ElementSet excluded;
+    for (int i = 0; i < 1000; i++) {
+        included.insert(CreateElement(i));
+        excluded.insert(CreateElement(1000 + i));
+    }
+
+    CGolombCodedSet filter(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), 1000U);
+
+    BOOST_FOREACH(const CGolombCodedSet::Element& element, included)
+        BOOST_CHECK(filter.Match(element));
+
+    // false positives are about 1 in 784931
+    int nFalsePositives = 0;
+    BOOST_FOREACH(const CGolombCodedSet::Element& element, excluded)
+        if (filter.Match(element))
+            nFalsePositives++;
+    BOOST_CHECK(nFalsePositives <= 1);
+    BOOST_CHECK_EQUAL(filter.MatchAny(excluded), nFalsePositives > 0);
+
+    CGolombCodedSet::ElementSet query(excluded);
+    query.insert(CreateElement(500));
+    BOOST_CHECK(filter.MatchAny(query));
+
+    // the decoded set matches the same elements
+    CGolombCodedSet decoded(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 1000U);
+    BOOST_CHECK(decoded.GetEncoded() == filter.GetEncoded());
+    BOOST_FOREACH(const CGolombCodedSet::Element& element, included)
+        BOOST_CHECK(decoded.Match(element));
+
+    // the key is part of the filter
+    CGolombCodedSet rekeyed(1, 2, filter.GetEncoded());
+    BOOST_CHECK(!rekeyed.MatchAny(included));
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_empty_and_malformed)
+{
+    CGolombCodedSet empty(1, 2, CGolombCodedSet::ElementSet());
+    BOOST_CHECK_EQUAL(empty.GetN(), 0U);
+    BOOST_CHECK(!empty.Match(CreateElement(1)));
+    BOOST_CHECK(empty.GetEncoded() == CGolombCodedSet().GetEncoded());
+
+    CGolombCodedSet::ElementSet elements;
+    for (int i = 0; i < 100; i++)
+        elements.insert(CreateElement(i));
+    std::vector<unsigned char> vchEncoded = CGolombCodedSet(1, 2, elements).GetEncoded();
+
+    vchEncoded.resize(vchEncoded.size() / 2);
+    BOOST_CHECK_THROW(CGolombCodedSet(1, 2, vchEncoded), std::ios_base::failure);
+    BOOST_CHECK_THROW(CGolombCodedSet(1, 2, std::vector<unsigned char>()), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_elements)
+{
+    CScript scriptPayment = CScript() << OP_DUP << OP_HASH160 << 1 << OP_EQUALVERIFY << OP_CHECKSIG;
+    CScript scriptData = CScript() << OP_RETURN << 2;
+    COutPoint prevout(ArithToUint256(3), 4);
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.resize(2);
+    tx.vout[0].scriptPubKey = scriptPayment;
+    tx.vout[1].scriptPubKey = scriptData;
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    CBlockFilter filter(block);
+    BOOST_CHECK(filter.GetBlockHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(filter.GetFilter().GetN(), 3U);
+    BOOST_CHECK(filter.Match(CBlockFilter::ScriptElement(scriptPayment)));
+    BOOST_CHECK(filter.Match(CBlockFilter::ScriptElement(CScript() << OP_TRUE)));
+    BOOST_CHECK(filter.Match(CBlockFilter::OutPointElement(prevout)));
+    BOOST_CHECK(!filter.Match(CBlockFilter::ScriptElement(scriptData)));
+    BOOST_CHECK(!filter.Match(CBlockFilter::OutPointElement(COutPoint(ArithToUint256(3), 5))));
+
+    CBlockFilter decoded(block.GetHash(), filter.GetEncoded());
+    BOOST_CHECK(decoded.Match(CBlockFilter::OutPointElement(prevout)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,9 +2,17 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "coins.h"
+#include "key.h"
+#include "main.h"
 #include "random.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "txdb.h"
 #include "uint256.h"
+#include "undo.h"
+#include "utilstrencodings.h"
 
 #include <vector>
 #include <map>
@@ -16,47 +24,58 @@ namespace
 class CCoinsViewTest : public CCoinsView
 {
     uint256 hashBestBlock_;
-    std::map<uint256, CCoins> map_;
+    std::map<COutPoint, Coin> map_;
+    CCoinsStats stats_;
 
 public:
-    bool GetCoins(const uint256& txid, CCoins& coins) const
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const
     {
-        std::map<uint256, CCoins>::const_iterator it = map_.find(txid);
+        std::map<COutPoint, Coin>::const_iterator it = map_.find(outpoint);
         if (it == map_.end()) {
             return false;
         }
-        coins = it->second;
-        if (coins.IsPruned() && insecure_rand() % 2 == 0) {
-            // Randomly return false in case of an empty entry.
-            return false;
-        }
-        return true;
+        coin = it->second;
+        return !coin.IsSpent();
     }
 
-    bool HaveCoins(const uint256& txid) const
+    bool SeekCoin(const COutPoint& from, COutPoint& outpoint, Coin& coin) const
     {
-        CCoins coins;
-        return GetCoins(txid, coins);
+        std::map<COutPoint, Coin>::const_iterator it = map_.lower_bound(from);
+        for (; it != map_.end() && it->first.hash == from.hash; it++) {
+            if (!it->second.IsSpent()) {
+                outpoint = it->first;
+                coin = it->second;
+                return true;
+            }
+        }
+        return false;
     }
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsStats& statsDelta)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
-            map_[it->first] = it->second.coins;
-            if (it->second.coins.IsPruned() && insecure_rand() % 3 == 0) {
-                // Randomly delete empty entries on write.
-                map_.erase(it->first);
+            if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                // Same optimization used in CCoinsViewDB is to only write dirty entries.
+                map_[it->first] = it->second.coin;
+                if (it->second.coin.IsSpent() && insecure_rand() % 3 == 0) {
+                    // Randomly delete empty entries on write.
+                    map_.erase(it->first);
+                }
             }
             mapCoins.erase(it++);
         }
-        mapCoins.clear();
         hashBestBlock_ = hashBlock;
+        stats_ += statsDelta;
         return true;
     }
 
-    bool GetStats(CCoinsStats& stats) const { return false; }
+    bool GetStats(CCoinsStats& stats) const
+    {
+        stats = stats_;
+        return true;
+    }
 };
 
 class CCoinsViewCacheTest : public CCoinsViewCache
@@ -67,15 +86,23 @@ public:
     void SelfTest() const
     {
         // Manually recompute the dynamic usage of the whole data, and compare it.
-        size_t ret = memusage::DynamicUsage(cacheCoins);
+        size_t ret = memusage::DynamicUsage(cacheCoins) + memusage::DynamicUsage(cacheOutputCounts);
         for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
-            ret += it->second.coins.DynamicMemoryUsage();
+            ret += it->second.coin.DynamicMemoryUsage();
         }
         BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
     }
 
 };
 
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true) {}
+
+    CLevelDBWrapper& GetDB() { return db; }
+};
+
 }
 
 BOOST_AUTO_TEST_SUITE(coins_tests)
@@ -85,7 +112,7 @@ static const unsigned int NUM_SIMULATION_ITERATIONS = 40000;
 // This is a large randomized insert/remove simulation test on a variable-size
 // stack of caches on top of CCoinsViewTest.
 //
-// It will randomly create/update/delete CCoins entries to a tip of caches, with
+// It will randomly create/update/delete Coin entries to a tip of caches, with
 // txids picked from a limited list of random 256-bit hashes. Occasionally, a
 // new tip is added to the stack of caches, or the tip is flushed and removed.
 //
@@ -97,13 +124,14 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool removed_all_caches = false;
     bool reached_4_caches = false;
     bool added_an_entry = false;
+    bool added_an_unspendable_entry = false;
     bool removed_an_entry = false;
     bool updated_an_entry = false;
     bool found_an_entry = false;
     bool missed_an_entry = false;
 
     // A simple map to track what we expect the cache stack to represent.
-    std::map<uint256, CCoins> result;
+    std::map<COutPoint, Coin> result;
 
     // The cache stack.
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
@@ -120,42 +148,84 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     for (unsigned int i = 0; i < NUM_SIMULATION_ITERATIONS; i++) {
         // Do a random modification.
         {
-            uint256 txid = txids[insecure_rand() % txids.size()]; // txid we're going to modify in this iteration.
-            CCoins& coins = result[txid];
-            CCoinsModifier entry = stack.back()->ModifyCoins(txid);
-            BOOST_CHECK(coins == *entry);
-            if (insecure_rand() % 5 == 0 || coins.IsPruned()) {
-                if (coins.IsPruned()) {
-                    added_an_entry = true;
+            COutPoint outpoint(txids[insecure_rand() % txids.size()], insecure_rand() % 2); // output we're going to modify in this iteration.
+            Coin& coin = result[outpoint];
+            BOOST_CHECK(coin == stack.back()->AccessCoin(outpoint));
+
+            if (insecure_rand() % 5 == 0 || coin.IsSpent()) {
+                Coin newcoin;
+                newcoin.out.nValue = insecure_rand();
+                newcoin.nHeight = 1;
+                bool fOverwrite = !coin.IsSpent() || insecure_rand() % 2;
+                if (insecure_rand() % 16 == 0 && coin.IsSpent()) {
+                    newcoin.out.scriptPubKey.assign(1 + (insecure_rand() & 0x3F), OP_RETURN);
+                    BOOST_CHECK(newcoin.out.scriptPubKey.IsUnspendable());
+                    added_an_unspendable_entry = true;
                 } else {
-                    updated_an_entry = true;
+                    // Random sizes so we can test memory usage accounting
+                    newcoin.out.scriptPubKey.assign(insecure_rand() & 0x3F, 0);
+                    if (coin.IsSpent())
+                        added_an_entry = true;
+                    else
+                        updated_an_entry = true;
+                    coin = newcoin;
                 }
-                coins.nVersion = insecure_rand();
-                coins.vout.resize(1);
-                coins.vout[0].nValue = insecure_rand();
-                *entry = coins;
+                stack.back()->AddCoin(outpoint, newcoin, fOverwrite);
             } else {
-                coins.Clear();
-                entry->Clear();
                 removed_an_entry = true;
+                coin.Clear();
+                BOOST_CHECK(stack.back()->SpendCoin(outpoint));
             }
         }
 
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
-            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
-                const CCoins* coins = stack.back()->AccessCoins(it->first);
-                if (coins) {
-                    BOOST_CHECK(*coins == it->second);
-                    found_an_entry = true;
-                } else {
-                    BOOST_CHECK(it->second.IsPruned());
+            // Hashing the whole set is slow, only done at the end
+            bool fLast = i == NUM_SIMULATION_ITERATIONS - 1;
+            int64_t nOutputs = 0;
+            CAmount nAmount = 0;
+            CCoinsStats expected;
+            for (std::map<COutPoint, Coin>::iterator it = result.begin(); it != result.end(); it++) {
+                bool have = stack.back()->HaveCoin(it->first);
+                const Coin& coin = stack.back()->AccessCoin(it->first);
+                BOOST_CHECK(have == !coin.IsSpent());
+                BOOST_CHECK(coin == it->second);
+                if (coin.IsSpent()) {
                     missed_an_entry = true;
+                } else {
+                    BOOST_CHECK(stack.back()->HaveCoinInCache(it->first));
+                    found_an_entry = true;
+                    nOutputs++;
+                    nAmount += coin.out.nValue;
+                    if (fLast)
+                        expected.AddCoin(it->first, coin);
                 }
             }
             BOOST_FOREACH(const CCoinsViewCacheTest *test, stack) {
                 test->SelfTest();
             }
+
+            // Finding an unspent output by txid sees through all the caches
+            for (unsigned int t = 0; t < txids.size(); t++) {
+                std::map<COutPoint, Coin>::iterator it = result.lower_bound(COutPoint(txids[t], 0));
+                while (it != result.end() && it->first.hash == txids[t] && it->second.IsSpent())
+                    it++;
+                const Coin& coin = AccessByTxid(*stack.back(), txids[t]);
+                if (it == result.end() || it->first.hash != txids[t])
+                    BOOST_CHECK(coin.IsSpent());
+                else
+                    BOOST_CHECK(coin == it->second);
+            }
+
+            // The statistics summed up along the stack describe the same set
+            CCoinsStats stats;
+            BOOST_CHECK(stack.back()->GetStats(stats));
+            BOOST_CHECK_EQUAL(stats.nTransactionOutputs, nOutputs);
+            BOOST_CHECK_EQUAL(stats.nTotalAmount, nAmount);
+            if (fLast) {
+                BOOST_CHECK_EQUAL(stats.nBogoSize, expected.nBogoSize);
+                BOOST_CHECK(stats.muhash.Finalize() == expected.muhash.Finalize());
+            }
         }
 
         if (insecure_rand() % 100 == 0) {
@@ -190,10 +260,218 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(removed_all_caches);
     BOOST_CHECK(reached_4_caches);
     BOOST_CHECK(added_an_entry);
+    BOOST_CHECK(added_an_unspendable_entry);
     BOOST_CHECK(removed_an_entry);
     BOOST_CHECK(updated_an_entry);
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
 }
 
+// Spending one output of a transaction leaves the others alone, and a spent
+// output that never reached the base does not reach it on flush either
+BOOST_AUTO_TEST_CASE(coins_spend_flags)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(3);
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        tx.vout[i].nValue = (i + 1) * COIN;
+        tx.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    AddCoins(cache, tx, 1);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 3U);
+
+    // fresh in the cache: spending erases the entry
+    BOOST_CHECK(cache.SpendCoin(COutPoint(tx.GetHash(), 2)));
+    BOOST_CHECK(!cache.SpendCoin(COutPoint(tx.GetHash(), 2)));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 2U);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!base.HaveCoin(COutPoint(tx.GetHash(), 2)));
+
+    // known to the base: spending leaves a dirty spent entry to flush
+    Coin spent;
+    BOOST_CHECK(cache.SpendCoin(COutPoint(tx.GetHash(), 0), &spent));
+    BOOST_CHECK(spent.out == tx.vout[0]);
+    BOOST_CHECK_EQUAL(spent.nHeight, 1U);
+    BOOST_CHECK(!spent.IsCoinBase());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+    BOOST_CHECK(!cache.HaveCoin(COutPoint(tx.GetHash(), 0)));
+    BOOST_CHECK(cache.HaveCoin(COutPoint(tx.GetHash(), 1)));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!base.HaveCoin(COutPoint(tx.GetHash(), 0)));
+    BOOST_CHECK(base.HaveCoin(COutPoint(tx.GetHash(), 1)));
+    BOOST_CHECK(!AccessByTxid(cache, tx.GetHash()).IsSpent());
+}
+
+// The statistics kept up to date by UpdateCoins match the ones computed from
+// the resulting coins, also after being flushed to the base view
+BOOST_AUTO_TEST_CASE(coins_stats_test)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    CValidationState state;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(3);
+    for (unsigned int i = 0; i < coinbase.vout.size(); i++) {
+        coinbase.vout[i].nValue = (i + 1) * COIN;
+        coinbase.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    coinbase.vout[2].scriptPubKey = CScript() << OP_RETURN;
+    CTxUndo undoCoinbase;
+    UpdateCoins(coinbase, state, cache, undoCoinbase, 1);
+
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbase.GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = COIN / 2;
+    spend.vout[0].scriptPubKey = CScript() << OP_TRUE << OP_DROP << OP_TRUE;
+    CTxUndo undoSpend;
+    UpdateCoins(spend, state, cache, undoSpend, 2);
+    BOOST_CHECK_EQUAL(undoSpend.vprevout[0].nHeight, 1U);
+    BOOST_CHECK(undoSpend.vprevout[0].fCoinBase);
+
+    // built in the other order
+    CCoinsStats expected;
+    COutPoint outSpend(spend.GetHash(), 0), outCoinbase(coinbase.GetHash(), 1);
+    expected.AddCoin(outSpend, cache.AccessCoin(outSpend));
+    expected.AddCoin(outCoinbase, cache.AccessCoin(outCoinbase));
+    BOOST_CHECK_EQUAL(expected.nTransactionOutputs, 2);
+    BOOST_CHECK_EQUAL(expected.nTotalAmount, 2 * COIN + COIN / 2);
+
+    CCoinsStats stats;
+    BOOST_CHECK(cache.GetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, expected.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, expected.nBogoSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, expected.nTotalAmount);
+    BOOST_CHECK(stats.muhash.Finalize() == expected.muhash.Finalize());
+
+    BOOST_CHECK(cache.Flush());
+    CCoinsStats flushed;
+    BOOST_CHECK(base.GetStats(flushed));
+    BOOST_CHECK_EQUAL(flushed.nTransactionOutputs, expected.nTransactionOutputs);
+    BOOST_CHECK(flushed.muhash.Finalize() == expected.muhash.Finalize());
+
+    // spending everything returns to the empty set
+    CMutableTransaction spendAll;
+    spendAll.vin.resize(2);
+    spendAll.vin[0].prevout = COutPoint(coinbase.GetHash(), 1);
+    spendAll.vin[1].prevout = COutPoint(spend.GetHash(), 0);
+    CTxUndo undoAll;
+    UpdateCoins(spendAll, state, cache, undoAll, 3);
+    BOOST_CHECK(cache.GetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 0);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, 0);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 0);
+    BOOST_CHECK(stats.muhash.Finalize() == CCoinsStats().muhash.Finalize());
+}
+
+BOOST_AUTO_TEST_CASE(coins_serialization)
+{
+    // Good example
+    CDataStream ss1(ParseHex("97f23c835800816115944e077fe7c803cfa57f29b36bf87c1d35"), SER_DISK, CLIENT_VERSION);
+    Coin cc1;
+    ss1 >> cc1;
+    BOOST_CHECK_EQUAL(cc1.fCoinBase, false);
+    BOOST_CHECK_EQUAL(cc1.nHeight, 203998U);
+    BOOST_CHECK_EQUAL(cc1.out.nValue, 60000000000LL);
+    BOOST_CHECK_EQUAL(HexStr(cc1.out.scriptPubKey), HexStr(GetScriptForDestination(CKeyID(uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"))))));
+
+    // Coinbase, round trip
+    Coin cc2(CTxOut(110397, CScript() << OP_TRUE), 120891, true);
+    CDataStream ss2(SER_DISK, CLIENT_VERSION);
+    ss2 << cc2;
+    Coin cc3;
+    ss2 >> cc3;
+    BOOST_CHECK(cc3 == cc2);
+    BOOST_CHECK(cc3.IsCoinBase());
+    BOOST_CHECK_EQUAL(cc3.nHeight, 120891U);
+}
+
+// A chainstate with one record per transaction is converted to one record per
+// unspent output
+BOOST_AUTO_TEST_CASE(coins_upgrade)
+{
+    CCoinsViewDBTest db;
+    uint256 txid = GetRandHash();
+    // version 1, vout[1] unspent: 600 BTC to a pubkey hash, height 203998
+    std::vector<unsigned char> legacy = ParseHex("0104835800816115944e077fe7c803cfa57f29b36bf87c1d358bb85e");
+    BOOST_CHECK(db.GetDB().Write(std::make_pair('c', txid), CFlatData(legacy)));
+    BOOST_CHECK(!db.HaveCoin(COutPoint(txid, 1)));
+
+    BOOST_CHECK(db.Upgrade());
+    BOOST_CHECK(!db.GetDB().Exists(std::make_pair('c', txid)));
+    BOOST_CHECK(!db.HaveCoin(COutPoint(txid, 0)));
+    Coin coin;
+    BOOST_CHECK(db.GetCoin(COutPoint(txid, 1), coin));
+    BOOST_CHECK_EQUAL(coin.nHeight, 203998U);
+    BOOST_CHECK(!coin.IsCoinBase());
+    BOOST_CHECK_EQUAL(coin.out.nValue, 60000000000LL);
+
+    BOOST_CHECK(db.RebuildStats());
+    CCoinsStats stats;
+    BOOST_CHECK(db.GetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 1);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 60000000000LL);
+
+    // nothing left to do the second time
+    BOOST_CHECK(db.Upgrade());
+}
+
+// Finding an unspent output by txid takes one seek in the database and sees
+// the changes of the caches on top of it
+BOOST_AUTO_TEST_CASE(coins_seek_by_txid)
+{
+    CCoinsViewDBTest db;
+    CCoinsViewCacheTest base(&db);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(300);
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        tx.vout[i].nValue = COIN + i;
+        tx.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    AddCoins(base, tx, 7);
+    // outputs 0 to 199 spent, 200 and up in the database
+    for (unsigned int i = 0; i < 200; i++)
+        BOOST_CHECK(base.SpendCoin(COutPoint(tx.GetHash(), i)));
+    BOOST_CHECK(base.Flush());
+
+    COutPoint outpoint;
+    Coin coin;
+    BOOST_CHECK(db.SeekCoin(COutPoint(tx.GetHash(), 0), outpoint, coin));
+    BOOST_CHECK(outpoint == COutPoint(tx.GetHash(), 200));
+    BOOST_CHECK_EQUAL(coin.nHeight, 7U);
+    BOOST_CHECK(db.SeekCoin(COutPoint(tx.GetHash(), 250), outpoint, coin));
+    BOOST_CHECK_EQUAL(outpoint.n, 250U);
+    BOOST_CHECK(!db.SeekCoin(COutPoint(tx.GetHash(), 300), outpoint, coin));
+    BOOST_CHECK(!db.SeekCoin(COutPoint(GetRandHash(), 0), outpoint, coin));
+
+    // spent in the cache, the next one of the database is found
+    CCoinsViewCacheTest cache(&base);
+    BOOST_CHECK(cache.SpendCoin(COutPoint(tx.GetHash(), 200)));
+    BOOST_CHECK_EQUAL(AccessByTxid(cache, tx.GetHash()).out.nValue, COIN + 201);
+
+    // added in the cache before the first one of the database
+    cache.AddCoin(COutPoint(tx.GetHash(), 5), Coin(tx.vout[5], 7, false), false);
+    BOOST_CHECK_EQUAL(AccessByTxid(cache, tx.GetHash()).out.nValue, COIN + 5);
+
+    // all spent
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+        cache.SpendCoin(COutPoint(tx.GetHash(), i));
+    BOOST_CHECK(AccessByTxid(cache, tx.GetHash()).IsSpent());
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(AccessByTxid(base, tx.GetHash()).IsSpent());
+    BOOST_CHECK(base.Flush());
+    BOOST_CHECK(!db.SeekCoin(COutPoint(tx.GetHash(), 0), outpoint, coin));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
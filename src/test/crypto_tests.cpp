@@ -108,7 +108,7 @@ BOOST_AUTO_TEST_CASE(sha1_testvectors) {
     TestSHA1(test1, "b7755760681cbfd971451668f32af5774f4656b5");
 }
 
-BOOST_AUTO_TEST_CASE(sha256_testvectors) {
+void TestSHA256Vectors() {
     TestSHA256("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
     TestSHA256("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
     TestSHA256("message digest",
@@ -130,6 +130,42 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+// every implementation the CPU supports, ending with the default choice
+static const int SHA256_IMPLEMENTATIONS[] = {SHA256_STANDARD, SHA256_USE_SSE41, SHA256_USE_AVX2, SHA256_USE_SHANI, SHA256_USE_ALL};
+
+BOOST_AUTO_TEST_CASE(sha256_testvectors) {
+    for (unsigned int i = 0; i < sizeof(SHA256_IMPLEMENTATIONS) / sizeof(SHA256_IMPLEMENTATIONS[0]); i++) {
+        SHA256AutoDetect(SHA256_IMPLEMENTATIONS[i]);
+        TestSHA256Vectors();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256d64) {
+    // up to 2 * 8 + 4 + 1 inputs covers every mix of the multi-way code
+    unsigned char in[64 * 21];
+    unsigned char out1[32 * 21], out2[32 * 21];
+    for (unsigned int i = 0; i < sizeof(in); i++)
+        in[i] = insecure_rand() & 0xFF;
+
+    SHA256AutoDetect(SHA256_STANDARD);
+    for (int j = 0; j < 21; j++) {
+        unsigned char hash[CSHA256::OUTPUT_SIZE];
+        CSHA256().Write(in + 64 * j, 64).Finalize(hash);
+        CSHA256().Write(hash, sizeof(hash)).Finalize(out1 + 32 * j);
+    }
+
+    for (unsigned int i = 0; i < sizeof(SHA256_IMPLEMENTATIONS) / sizeof(SHA256_IMPLEMENTATIONS[0]); i++) {
+        SHA256AutoDetect(SHA256_IMPLEMENTATIONS[i]);
+        for (int n = 0; n <= 21; n++) {
+            memset(out2, 0, sizeof(out2));
+            SHA256D64(out2, in, n);
+            BOOST_CHECK(memcmp(out1, out2, 32 * n) == 0);
+            for (int j = 32 * n; j < (int)sizeof(out2); j++)
+                BOOST_CHECK(out2[j] == 0);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -0,0 +1,77 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "hash.h"
+#include "utilstrencodings.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    uint256 CreateEntry(int n)
+    {
+        return Hash(BEGIN(n), END(n));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(cuckoocache_tests)
+
+BOOST_AUTO_TEST_CASE(cuckoocache_contains)
+{
+    CCuckooCache cache;
+    BOOST_CHECK_EQUAL(cache.Setup(64 * 1024), 2048U);
+
+    // well below the size of a generation nothing gets lost
+    for (int i = 0; i < 800; i++)
+        cache.Insert(CreateEntry(i));
+    for (int i = 0; i < 800; i++)
+        BOOST_CHECK(cache.Contains(CreateEntry(i), false));
+    for (int i = 800; i < 1600; i++)
+        BOOST_CHECK(!cache.Contains(CreateEntry(i), false));
+    BOOST_CHECK(!cache.Contains(uint256(), false));
+
+    // an erased entry stays until its slot is needed
+    BOOST_CHECK(cache.Contains(CreateEntry(0), true));
+    BOOST_CHECK(cache.Contains(CreateEntry(0), false));
+
+    cache.Setup(64 * 1024);
+    BOOST_CHECK(!cache.Contains(CreateEntry(1), false));
+
+    CCuckooCache disabled(0);
+    disabled.Insert(CreateEntry(1));
+    BOOST_CHECK(!disabled.Contains(CreateEntry(1), false));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_generations)
+{
+    CCuckooCache cache(64 * 1024);
+
+    // keep inserting far more than fits, the newest entries must survive
+    for (int i = 0; i < 20000; i++)
+        cache.Insert(CreateEntry(i));
+    int nOld = 0;
+    for (int i = 0; i < 10000; i++)
+        if (cache.Contains(CreateEntry(i), false))
+            nOld++;
+    int nRecent = 0;
+    for (int i = 20000 - 800; i < 20000; i++)
+        if (cache.Contains(CreateEntry(i), false))
+            nRecent++;
+    BOOST_CHECK(nOld < 100);
+    BOOST_CHECK(nRecent >= 790);
+
+    // erased entries are overwritten before the ones still needed
+    for (int i = 20000 - 800; i < 20000; i++)
+        cache.Contains(CreateEntry(i), true);
+    for (int i = 30000; i < 30800; i++)
+        cache.Insert(CreateEntry(i));
+    int nKept = 0;
+    for (int i = 30000; i < 30800; i++)
+        if (cache.Contains(CreateEntry(i), false))
+            nKept++;
+    BOOST_CHECK(nKept >= 790);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
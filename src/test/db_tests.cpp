@@ -68,6 +68,26 @@ struct DbTestWithSerializeException : public DbTest
     }
 };
 
+// Keeps a cache that is saved, but left out of the state hash like the seen maps
+struct DbTestWithCache : public DbTest
+{
+    DbTestWithCache()
+        : m_cache(0)
+    {
+    }
+
+    ADD_SERIALIZE_METHODS;
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(m_testData);
+        if (!(nType & SER_GETHASH))
+            READWRITE(m_cache);
+    }
+
+    int m_cache;
+};
+
 BOOST_FIXTURE_TEST_SUITE(db_tests, DbCleanupFixture)
 
     BOOST_AUTO_TEST_CASE(FileError)
@@ -143,4 +163,52 @@ BOOST_FIXTURE_TEST_SUITE(db_tests, DbCleanupFixture)
         RemoveFile();
     }
 
+    BOOST_AUTO_TEST_CASE(DbDumpChangedData)
+    {
+        DbTest dbDump;
+        BOOST_CHECK(Dump(dbDump, fileName, "MagicMessage"));
+        BOOST_CHECK(Dump(dbDump, fileName, "MagicMessage"));
+
+        dbDump.m_testData = 16;
+        BOOST_CHECK(Dump(dbDump, fileName, "MagicMessage"));
+
+        DbTest dbLoad;
+        BOOST_CHECK(Load(dbLoad, fileName, "MagicMessage"));
+        BOOST_CHECK_EQUAL(dbLoad.m_testData, 16);
+        BOOST_CHECK(!boost::filesystem::exists(GetDataDir() / (fileName + ".new")));
+        RemoveFile();
+    }
+
+    BOOST_AUTO_TEST_CASE(DbDumpSkipsCacheChanges)
+    {
+        DbTestWithCache dbDump;
+        BOOST_CHECK(Dump(dbDump, fileName, "MagicMessage"));
+
+        // a changed cache alone doesn't make the file be rewritten
+        dbDump.m_cache = 1;
+        BOOST_CHECK(Dump(dbDump, fileName, "MagicMessage"));
+        DbTestWithCache dbLoad;
+        BOOST_CHECK(Load(dbLoad, fileName, "MagicMessage"));
+        BOOST_CHECK_EQUAL(dbLoad.m_cache, 0);
+
+        // it's saved with the next change of the state
+        dbDump.m_testData = 16;
+        BOOST_CHECK(Dump(dbDump, fileName, "MagicMessage"));
+        BOOST_CHECK(Load(dbLoad, fileName, "MagicMessage"));
+        BOOST_CHECK_EQUAL(dbLoad.m_testData, 16);
+        BOOST_CHECK_EQUAL(dbLoad.m_cache, 1);
+        RemoveFile();
+    }
+
+    BOOST_AUTO_TEST_CASE(DbDumpKeepsOtherFiles)
+    {
+        DbTest db;
+        BOOST_CHECK(Dump(db, fileName, "MagicMessage"));
+
+        // File belongs to another kind of object
+        BOOST_CHECK(!Dump(db, fileName, "OtherMagicMessage"));
+        BOOST_CHECK_EQUAL(::details::Read(db, fileName, "MagicMessage"), ::details::Ok);
+        RemoveFile();
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
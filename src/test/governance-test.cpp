@@ -1052,6 +1052,61 @@ BOOST_FIXTURE_TEST_SUITE(BudgetVoting, BudgetManagerVotingFixture)
         BOOST_CHECK(budget.mapProposals[proposal.GetHash()].mapVotes.empty());
     }
 
+    BOOST_AUTO_TEST_CASE(VoteTalliesFollowVoteUpdates)
+    {
+        // Set Up
+        const CBudgetProposal proposal = CreateProposal(nextSbStart + GetBudgetPaymentCycleBlocks(), keyPair, 42);
+        budget.AddProposal(proposal, false); // false = don't check collateral
+
+        const CMasternode mn2 = CreateMasternode(CTxIn(COutPoint(ArithToUint256(2), 1 * COIN)));
+        const CMasternode mn3 = CreateMasternode(CTxIn(COutPoint(ArithToUint256(3), 1 * COIN)));
+
+        BOOST_REQUIRE(budget.SubmitProposalVote(CBudgetVote(mn.vin, proposal.GetHash(), VOTE_YES), error));
+        BOOST_REQUIRE(budget.SubmitProposalVote(CBudgetVote(mn2.vin, proposal.GetHash(), VOTE_NO), error));
+        BOOST_REQUIRE(budget.SubmitProposalVote(CBudgetVote(mn3.vin, proposal.GetHash(), VOTE_ABSTAIN), error));
+
+        CBudgetProposal& stored = budget.mapProposals[proposal.GetHash()];
+        BOOST_CHECK_EQUAL(stored.GetYeas(), 1);
+        BOOST_CHECK_EQUAL(stored.GetNays(), 1);
+        BOOST_CHECK_EQUAL(stored.GetAbstains(), 1);
+        BOOST_CHECK_EQUAL(stored.GetRatio(), 0.5);
+
+        // Replacing a vote moves it to the new tally
+        SetMockTime(GetTime() + BUDGET_VOTE_UPDATE_MIN);
+        BOOST_REQUIRE(budget.SubmitProposalVote(CBudgetVote(mn3.vin, proposal.GetHash(), VOTE_YES), error));
+
+        BOOST_CHECK_EQUAL(stored.GetYeas(), 2);
+        BOOST_CHECK_EQUAL(stored.GetNays(), 1);
+        BOOST_CHECK_EQUAL(stored.GetAbstains(), 0);
+
+        // Votes of unknown masternodes are not counted once the proposal is cleaned
+        mnodeman.Add(mn);
+        stored.CleanAndRemove(false);
+
+        BOOST_CHECK_EQUAL(stored.GetYeas(), 1);
+        BOOST_CHECK_EQUAL(stored.GetNays(), 0);
+        BOOST_CHECK_EQUAL(stored.GetAbstains(), 0);
+
+        // Copies keep the tallies, deserialized votes count until they are cleaned again
+        const CBudgetProposal copied(stored);
+        BOOST_CHECK_EQUAL(copied.GetYeas(), 1);
+        BOOST_CHECK_EQUAL(copied.GetNays(), 0);
+
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << stored;
+        CBudgetProposal restored;
+        stream >> restored;
+
+        BOOST_CHECK_EQUAL(restored.GetYeas(), 2);
+        BOOST_CHECK_EQUAL(restored.GetNays(), 1);
+
+        restored.CleanAndRemove(false);
+        BOOST_CHECK_EQUAL(restored.GetYeas(), 1);
+        BOOST_CHECK_EQUAL(restored.GetNays(), 0);
+
+        mnodeman.Clear();
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
 
 namespace
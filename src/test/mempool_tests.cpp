@@ -99,4 +99,204 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    std::list<CTransaction> removed;
+
+    // Three independent transactions of the same size and a child of the
+    // first one, with different fees and entry times
+    CMutableTransaction tx[4];
+    for (int i = 0; i < 4; i++)
+    {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        tx[i].vin[0].prevout.n = i;
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10 * COIN;
+    }
+    tx[3].vin[0].prevout = COutPoint(tx[0].GetHash(), 0);
+
+    pool.addUnchecked(tx[0].GetHash(), CTxMemPoolEntry(tx[0], 10000, 300, 0.0, 1));
+    pool.addUnchecked(tx[1].GetHash(), CTxMemPoolEntry(tx[1], 20000, 100, 0.0, 1));
+    pool.addUnchecked(tx[2].GetHash(), CTxMemPoolEntry(tx[2], 5000, 200, 0.0, 1));
+    pool.addUnchecked(tx[3].GetHash(), CTxMemPoolEntry(tx[3], 15000, 400, 0.0, 1));
+
+    // sorted by fee rate, highest first
+    std::vector<uint256> sortedOrder;
+    sortedOrder.push_back(tx[1].GetHash());
+    sortedOrder.push_back(tx[3].GetHash());
+    sortedOrder.push_back(tx[0].GetHash());
+    sortedOrder.push_back(tx[2].GetHash());
+    int n = 0;
+    BOOST_FOREACH(const CTxMemPoolEntry& entry, pool.mapTx.get<fee_rate>())
+        BOOST_CHECK_EQUAL(entry.GetTx().GetHash().ToString(), sortedOrder[n++].ToString());
+
+    // sorted by entry time, oldest first
+    CTxMemPool::indexed_transaction_set::index<entry_time>::type::iterator it = pool.mapTx.get<entry_time>().begin();
+    BOOST_CHECK(it->GetTx().GetHash() == tx[1].GetHash());
+    BOOST_CHECK((++it)->GetTx().GetHash() == tx[2].GetHash());
+    BOOST_CHECK((++it)->GetTx().GetHash() == tx[0].GetHash());
+    BOOST_CHECK((++it)->GetTx().GetHash() == tx[3].GetHash());
+
+    // prioritisetransaction moves the lowest fee rate transaction to the top
+    pool.PrioritiseTransaction(tx[2].GetHash(), tx[2].GetHash().ToString(), 0.0, 100000);
+    BOOST_CHECK(pool.mapTx.get<fee_rate>().begin()->GetTx().GetHash() == tx[2].GetHash());
+
+    {
+        LOCK(pool.cs);
+        CTxMemPool::txiter parent = pool.mapTx.find(tx[0].GetHash());
+        CTxMemPool::txiter child = pool.mapTx.find(tx[3].GetHash());
+        BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(parent).size(), 1);
+        BOOST_CHECK(*pool.GetMemPoolChildren(parent).begin() == child);
+        BOOST_CHECK_EQUAL(pool.GetMemPoolParents(child).size(), 1);
+        BOOST_CHECK(*pool.GetMemPoolParents(child).begin() == parent);
+        BOOST_CHECK(pool.GetMemPoolParents(parent).empty());
+    }
+
+    // the parent is confirmed, the child no longer has a parent in the pool
+    pool.remove(tx[0], removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    removed.clear();
+    {
+        LOCK(pool.cs);
+        CTxMemPool::txiter child = pool.mapTx.find(tx[3].GetHash());
+        BOOST_CHECK(pool.GetMemPoolParents(child).empty());
+    }
+
+    // and when it's added back the link is restored
+    pool.addUnchecked(tx[0].GetHash(), CTxMemPoolEntry(tx[0], 10000, 500, 0.0, 1));
+    {
+        LOCK(pool.cs);
+        CTxMemPool::txiter parent = pool.mapTx.find(tx[0].GetHash());
+        CTxMemPool::txiter child = pool.mapTx.find(tx[3].GetHash());
+        BOOST_CHECK(*pool.GetMemPoolChildren(parent).begin() == child);
+        BOOST_CHECK(*pool.GetMemPoolParents(child).begin() == parent);
+    }
+
+    pool.remove(tx[0], removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2);
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    pool.setSanityCheck(true);
+    SetMockTime(100000);
+
+    CMutableTransaction tx[5];
+    for (int i = 0; i < 5; i++)
+    {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        tx[i].vin[0].prevout.n = i;
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10 * COIN;
+    }
+    // tx[2] pays little, but its child tx[3] pays for both
+    tx[3].vin[0].prevout = COutPoint(tx[2].GetHash(), 0);
+
+    pool.addUnchecked(tx[0].GetHash(), CTxMemPoolEntry(tx[0], 10000, 200, 0.0, 1));
+    pool.addUnchecked(tx[1].GetHash(), CTxMemPoolEntry(tx[1], 1000, 200, 0.0, 1));
+    pool.addUnchecked(tx[2].GetHash(), CTxMemPoolEntry(tx[2], 5000, 200, 0.0, 1));
+    pool.addUnchecked(tx[3].GetHash(), CTxMemPoolEntry(tx[3], 20000, 200, 0.0, 1));
+    pool.addUnchecked(tx[4].GetHash(), CTxMemPoolEntry(tx[4], 50000, 100, 0.0, 1));
+
+    {
+        LOCK(pool.cs);
+        CTxMemPool::txiter it = pool.mapTx.find(tx[2].GetHash());
+        BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 2);
+        BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), 25000);
+        BOOST_CHECK_EQUAL(it->GetSizeWithDescendants(), it->GetTxSize() * 2);
+    }
+
+    // the lowest fee rate package goes first and raises the minimum fee
+    BOOST_CHECK(pool.GetMinFee(1) == CFeeRate(0));
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!pool.exists(tx[1].GetHash()));
+    BOOST_CHECK_EQUAL(pool.size(), 4);
+    unsigned int nSize = ::GetSerializeSize(tx[1], SER_NETWORK, PROTOCOL_VERSION);
+    CFeeRate minFee(CFeeRate(1000, nSize).GetFeePerK() + 1000);
+    BOOST_CHECK(pool.GetMinFee(1) == minFee);
+
+    // tx[0] pays less than the package of tx[2] and tx[3]
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!pool.exists(tx[0].GetHash()));
+    BOOST_CHECK(pool.exists(tx[2].GetHash()));
+    BOOST_CHECK(pool.exists(tx[3].GetHash()));
+
+    // the remaining transactions and their descendant state are consistent
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins(&coinsDummy);
+    for (unsigned int i = 0; i < 5; i++)
+        coins.AddCoin(COutPoint(uint256(), i), Coin(CTxOut(11 * COIN, CScript() << OP_11 << OP_EQUAL), 0, false), false);
+    pool.check(&coins);
+
+    // the minimum fee only decays after a block
+    minFee = pool.GetMinFee(1);
+    SetMockTime(100000 + CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK(pool.GetMinFee(1) == minFee);
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(std::vector<CTransactionRef>(), 1, conflicts);
+    SetMockTime(100000 + 2 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK(pool.GetMinFee(1) == CFeeRate(minFee.GetFeePerK() / 2));
+
+    // expiry removes the old transactions only
+    BOOST_CHECK_EQUAL(pool.Expire(150), 1);
+    BOOST_CHECK(!pool.exists(tx[4].GetHash()));
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+
+    // removing the parent leaves nothing to be counted with it
+    std::list<CTransaction> removed;
+    pool.remove(tx[2], removed, false);
+    {
+        LOCK(pool.cs);
+        CTxMemPool::txiter it = pool.mapTx.find(tx[3].GetHash());
+        BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 1);
+    }
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolChainLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+
+    // a chain of five transactions, each spending the previous one
+    CMutableTransaction tx[6];
+    for (int i = 0; i < 6; i++)
+    {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        if (i > 0)
+            tx[i].vin[0].prevout = COutPoint(tx[i - 1].GetHash(), 0);
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10 * COIN;
+        if (i < 5)
+            pool.addUnchecked(tx[i].GetHash(), CTxMemPoolEntry(tx[i], 1000, 0, 0.0, 1));
+    }
+
+    LOCK(pool.cs);
+    CTxMemPoolEntry entry(tx[5], 1000, 0, 0.0, 1);
+    uint64_t nSize = entry.GetTxSize();
+    CTxMemPool::setEntries setAncestors;
+    std::string errString;
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entry, setAncestors, 6, 6 * nSize, 6, 6 * nSize, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 5);
+
+    // the walk stops as soon as a limit is exceeded
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry, setAncestors, 5, 6 * nSize, 6, 6 * nSize, errString));
+    BOOST_CHECK(setAncestors.size() < 5);
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry, setAncestors, 6, 5 * nSize, 6, 6 * nSize, errString));
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry, setAncestors, 6, 6 * nSize, 5, 6 * nSize, errString));
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry, setAncestors, 6, 6 * nSize, 6, 5 * nSize, errString));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,95 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternodeman.h"
+#include "key.h"
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    CPubKey CreatePubKey()
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        return key.GetPubKey();
+    }
+
+    CMasternode CreateMasternode(int n)
+    {
+        CMasternode mn;
+        mn.vin = CTxIn(COutPoint(ArithToUint256(n), 0));
+        mn.addr = CService("10.0.0.1", 9340 + n);
+        mn.pubkey = CreatePubKey();
+        mn.pubkey2 = CreatePubKey();
+        mn.sigTime = 1000;
+        return mn;
+    }
+
+    struct MasternodeIndexFixture
+    {
+        CMasternode mn1;
+        CMasternode mn2;
+
+        MasternodeIndexFixture()
+            : mn1(CreateMasternode(1))
+            , mn2(CreateMasternode(2))
+        {
+            mnodeman.Add(mn1);
+            mnodeman.Add(mn2);
+        }
+
+        ~MasternodeIndexFixture()
+        {
+            mnodeman.Clear();
+        }
+    };
+}
+
+BOOST_FIXTURE_TEST_SUITE(MasternodeIndex, MasternodeIndexFixture)
+
+    BOOST_AUTO_TEST_CASE(FindByAllKeys)
+    {
+        CMasternode* pmn = mnodeman.Find(mn2.vin);
+        BOOST_REQUIRE(pmn != NULL);
+        BOOST_CHECK(pmn->vin == mn2.vin);
+        BOOST_CHECK_EQUAL(mnodeman.Find(mn2.pubkey2), pmn);
+        BOOST_CHECK_EQUAL(mnodeman.Find(mn2.addr), pmn);
+        BOOST_CHECK_EQUAL(mnodeman.Find(GetScriptForDestination(mn2.pubkey.GetID())), pmn);
+
+        BOOST_CHECK(mnodeman.Find(CTxIn(COutPoint(ArithToUint256(3), 0))) == NULL);
+        BOOST_CHECK(mnodeman.Find(CreatePubKey()) == NULL);
+    }
+
+    BOOST_AUTO_TEST_CASE(Remove)
+    {
+        mnodeman.Remove(mn1.vin);
+
+        BOOST_CHECK(mnodeman.Find(mn1.vin) == NULL);
+        BOOST_CHECK(mnodeman.Find(mn1.addr) == NULL);
+
+        // positions of the remaining entries moved
+        CMasternode* pmn = mnodeman.Find(mn2.addr);
+        BOOST_REQUIRE(pmn != NULL);
+        BOOST_CHECK(pmn->vin == mn2.vin);
+    }
+
+    BOOST_AUTO_TEST_CASE(UpdateFromNewBroadcast)
+    {
+        CMasternodeBroadcast mnb(mn1);
+        mnb.sigTime = mn1.sigTime + 1;
+        mnb.addr = CService("10.0.0.2", 9340);
+        mnb.pubkey2 = CreatePubKey();
+        mnb.lastPing = CMasternodePing();
+
+        CMasternode* pmn = mnodeman.Find(mn1.vin);
+        BOOST_REQUIRE(pmn != NULL);
+        BOOST_CHECK(mnodeman.UpdateFromNewBroadcast(pmn, mnb));
+
+        BOOST_CHECK(mnodeman.Find(mn1.addr) == NULL);
+        BOOST_CHECK(mnodeman.Find(mn1.pubkey2) == NULL);
+        BOOST_CHECK_EQUAL(mnodeman.Find(mnb.addr), pmn);
+        BOOST_CHECK_EQUAL(mnodeman.Find(mnb.pubkey2), pmn);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,123 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-payments.h"
+#include "streams.h"
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    CScript CreatePayee(unsigned char n)
+    {
+        return CScript() << std::vector<unsigned char>(20, n) << OP_CHECKSIG;
+    }
+
+    void AddVotes(CMasternodePayments& payments, int nBlockHeight, const CScript& payee, int nVotes)
+    {
+        if (!payments.mapMasternodeBlocks.count(nBlockHeight))
+            payments.mapMasternodeBlocks[nBlockHeight] = CMasternodeBlockPayees(nBlockHeight);
+        payments.mapMasternodeBlocks[nBlockHeight].AddPayee(payee, nVotes);
+    }
+
+    uint256 AddWinner(CMasternodePayments& payments, int nBlockHeight, const CScript& payee, uint32_t n)
+    {
+        CMasternodePaymentWinner winner(CTxIn(COutPoint(uint256(), n)));
+        winner.nBlockHeight = nBlockHeight;
+        winner.AddPayee(payee);
+        payments.mapMasternodePayeeVotes[winner.GetHash()] = winner;
+        AddVotes(payments, nBlockHeight, payee, 1);
+        return winner.GetHash();
+    }
+
+    struct LastPaidFixture
+    {
+        CMasternodePayments payments;
+        const CScript payee1;
+        const CScript payee2;
+
+        LastPaidFixture()
+            : payee1(CreatePayee(1))
+            , payee2(CreatePayee(2))
+        {
+            AddVotes(payments, 10, payee1, 2);
+            AddVotes(payments, 12, payee2, 3);
+            AddVotes(payments, 12, payee1, 1);
+            AddVotes(payments, 15, payee1, 2);
+        }
+
+        void ConnectBlocks(int nFrom, int nTo)
+        {
+            for (int h = nFrom; h <= nTo; ++h)
+                payments.BlockConnected(h);
+        }
+    };
+}
+
+BOOST_FIXTURE_TEST_SUITE(LastPaidIndex, LastPaidFixture)
+
+    BOOST_AUTO_TEST_CASE(UnknownPayee)
+    {
+        ConnectBlocks(1, 20);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(CreatePayee(3)), -1);
+    }
+
+    BOOST_AUTO_TEST_CASE(IgnoresBlocksAboveTip)
+    {
+        ConnectBlocks(1, 14);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee1), 10);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee2), 12);
+
+        payments.BlockConnected(15);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee1), 15);
+    }
+
+    BOOST_AUTO_TEST_CASE(Disconnect)
+    {
+        ConnectBlocks(1, 15);
+
+        payments.BlockDisconnected(15);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee1), 10);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee2), 12);
+
+        payments.BlockDisconnected(14);
+        payments.BlockDisconnected(13);
+        payments.BlockDisconnected(12);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee2), -1);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee1), 10);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(PaymentVotes)
+
+    BOOST_AUTO_TEST_CASE(RemoveVotesBelow)
+    {
+        CMasternodePayments stored;
+        const uint256 hash10 = AddWinner(stored, 10, CreatePayee(1), 0);
+        const uint256 hash12a = AddWinner(stored, 12, CreatePayee(1), 1);
+        const uint256 hash12b = AddWinner(stored, 12, CreatePayee(2), 2);
+        const uint256 hash15 = AddWinner(stored, 15, CreatePayee(3), 3);
+
+        // the height index is rebuilt when the votes are read back
+        CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+        ss << stored;
+        CMasternodePayments payments;
+        ss >> payments;
+        BOOST_CHECK_EQUAL(payments.GetOldestBlock(), 10);
+        BOOST_CHECK_EQUAL(payments.GetNewestBlock(), 15);
+
+        payments.RemoveVotesBelow(12);
+        BOOST_CHECK(!payments.mapMasternodePayeeVotes.count(hash10));
+        BOOST_CHECK(payments.mapMasternodePayeeVotes.count(hash12a));
+        BOOST_CHECK(payments.mapMasternodePayeeVotes.count(hash12b));
+        BOOST_CHECK(payments.mapMasternodePayeeVotes.count(hash15));
+        BOOST_CHECK_EQUAL(payments.GetOldestBlock(), 12);
+
+        payments.RemoveVotesBelow(16);
+        BOOST_CHECK(payments.mapMasternodePayeeVotes.empty());
+        BOOST_CHECK(payments.mapMasternodeBlocks.empty());
+        BOOST_CHECK_EQUAL(payments.GetNewestBlock(), 0);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+#include "streams.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    uint256 Element(int n)
+    {
+        uint256 ret;
+        *ret.begin() = n;
+        return ret;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(muhash_tests)
+
+BOOST_AUTO_TEST_CASE(muhash_set)
+{
+    // independent of the order of insertion
+    MuHash3072 ab;
+    ab.Insert(Element(1));
+    ab.Insert(Element(2));
+    MuHash3072 ba;
+    ba.Insert(Element(2));
+    ba.Insert(Element(1));
+    BOOST_CHECK(ab.Finalize() == ba.Finalize());
+    BOOST_CHECK_EQUAL(ab.Finalize().GetHex(), "a197466218e655b725ad48034112ba82c8e07d2e927e07b1ec677314a0bb6609");
+
+    // removal undoes insertion
+    MuHash3072 abc;
+    abc.Insert(Element(3));
+    abc.Insert(Element(1));
+    abc.Insert(Element(2));
+    BOOST_CHECK(abc.Finalize() != ab.Finalize());
+    abc.Remove(Element(3));
+    BOOST_CHECK(abc.Finalize() == ab.Finalize());
+    BOOST_CHECK(!abc.IsEmpty());
+
+    MuHash3072 empty;
+    BOOST_CHECK(empty.IsEmpty());
+    MuHash3072 removed;
+    removed.Insert(Element(4));
+    removed.Remove(Element(4));
+    BOOST_CHECK(removed.Finalize() == empty.Finalize());
+    BOOST_CHECK_EQUAL(empty.Finalize().GetHex(), "dd5ad2a105c2d29495f577245c357409002329b9f4d6182c0af3dc2f462555c8");
+
+    // changes accumulated apart combine
+    MuHash3072 delta;
+    delta.Insert(Element(2));
+    MuHash3072 total;
+    total.Insert(Element(1));
+    total *= delta;
+    BOOST_CHECK(total.Finalize() == ab.Finalize());
+
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << abc;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 read;
+    ss >> read;
+    BOOST_CHECK(read.Finalize() == ab.Finalize());
+}
+
+BOOST_AUTO_TEST_CASE(num3072_reduce)
+{
+    // p + 5 reduces to 5
+    unsigned char data[Num3072::BYTE_SIZE];
+    memset(data, 0xff, sizeof(data));
+    uint32_t low = (uint32_t)0 - 1103717 + 5;
+    for (int i = 0; i < 4; i++)
+        data[i] = low >> (8 * i);
+    Num3072 num(data);
+    num.ToBytes(data);
+    BOOST_CHECK_EQUAL(data[0], 5);
+    for (unsigned int i = 1; i < Num3072::BYTE_SIZE; i++)
+        BOOST_CHECK_EQUAL(data[i], 0);
+
+    // a number times its inverse is one
+    Num3072 x(data);
+    x.Multiply(x);
+    Num3072 inverse = x.GetInverse();
+    inverse.Multiply(x);
+    inverse.ToBytes(data);
+    BOOST_CHECK_EQUAL(data[0], 1);
+    for (unsigned int i = 1; i < Num3072::BYTE_SIZE; i++)
+        BOOST_CHECK_EQUAL(data[i], 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
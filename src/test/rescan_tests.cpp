@@ -0,0 +1,208 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "main.h"
+#include "pow.h"
+#include "util.h"
+#include "wallet.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    const int CHAIN_LENGTH = 120;
+    // block file far away from the ones of the test chain
+    const int BLOCK_FILE = 1000;
+
+    CWallet* pwalletAbort = NULL;
+
+    void AbortOnStart(const std::string& title, int nProgress)
+    {
+        if (nProgress == 0)
+            pwalletAbort->AbortRescan();
+    }
+
+    /**
+     * A chain written to disk, the coinbase of every third block pays to the
+     * wallet keys and the block after it spends that coin.
+     */
+    struct RescanFixture
+    {
+        const CBaseChainParams::Network prevParams;
+        CBlockIndex* pindexPrevTip;
+        std::vector<CKey> vKeys;
+        std::vector<CBlockIndex*> vIndexes;
+        //! hashes of the wallet transactions in block order
+        std::vector<uint256> vExpected;
+
+        RescanFixture()
+            : prevParams(Params().NetworkID())
+            , pindexPrevTip(chainActive.Tip())
+        {
+            // regtest blocks are cheap to mine
+            SelectParams(CBaseChainParams::REGTEST);
+
+            for (int i = 0; i < 3; i++) {
+                CKey key;
+                key.MakeNewKey(true);
+                vKeys.push_back(key);
+            }
+            CKey keyOther;
+            keyOther.MakeNewKey(true);
+
+            LOCK(cs_main);
+            CDiskBlockPos pos(BLOCK_FILE, 0);
+            uint256 hashPrev;
+            uint256 hashPaid;
+            for (int nHeight = 0; nHeight < CHAIN_LENGTH; nHeight++) {
+                CBlock block;
+                block.nVersion.SetBaseVersion(CBlockHeader::CURRENT_VERSION, Params().AuxpowChainId());
+                block.hashPrevBlock = hashPrev;
+                block.nTime = GetTime() + nHeight;
+                block.nBits = Params().ProofOfWorkLimit().GetCompact();
+
+                CMutableTransaction coinbase;
+                coinbase.vin.resize(1);
+                coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+                coinbase.vout.resize(1);
+                coinbase.vout[0].nValue = 10 * COIN;
+                bool fPaysToWallet = nHeight % 3 == 0;
+                const CKey& keyPayee = fPaysToWallet ? vKeys[nHeight % vKeys.size()] : keyOther;
+                coinbase.vout[0].scriptPubKey = GetScriptForDestination(keyPayee.GetPubKey().GetID());
+                block.vtx.push_back(MakeTransactionRef(coinbase));
+                if (fPaysToWallet)
+                    vExpected.push_back(coinbase.GetHash());
+
+                if (!hashPaid.IsNull()) {
+                    CMutableTransaction spend;
+                    spend.vin.resize(1);
+                    spend.vin[0].prevout = COutPoint(hashPaid, 0);
+                    spend.vout.resize(1);
+                    spend.vout[0].nValue = 9 * COIN;
+                    spend.vout[0].scriptPubKey = GetScriptForDestination(keyOther.GetPubKey().GetID());
+                    block.vtx.push_back(MakeTransactionRef(spend));
+                    vExpected.push_back(spend.GetHash());
+                }
+                hashPaid = fPaysToWallet ? coinbase.GetHash() : uint256();
+
+                block.hashMerkleRoot = block.BuildMerkleTree();
+                while (!CheckProofOfWork(block.GetHash(), block.nBits))
+                    block.nNonce++;
+
+                unsigned int nSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+                BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+
+                CBlockIndex* pindex = new CBlockIndex(block);
+                pindex->phashBlock = &mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex)).first->first;
+                pindex->pprev = vIndexes.empty() ? NULL : vIndexes.back();
+                pindex->nHeight = nHeight;
+                pindex->nFile = pos.nFile;
+                pindex->nDataPos = pos.nPos;
+                pindex->nStatus |= BLOCK_HAVE_DATA;
+                pindex->nTx = block.vtx.size();
+                pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+                pindex->BuildSkip();
+                vIndexes.push_back(pindex);
+
+                hashPrev = block.GetHash();
+                pos.nPos += nSize;
+            }
+            chainActive.SetTip(vIndexes.back());
+        }
+
+        ~RescanFixture()
+        {
+            mapArgs.erase("-rescanthreads");
+            {
+                LOCK(cs_main);
+                chainActive.SetTip(pindexPrevTip);
+                BOOST_FOREACH(CBlockIndex* pindex, vIndexes) {
+                    mapBlockIndex.erase(pindex->GetBlockHash());
+                    delete pindex;
+                }
+            }
+            boost::filesystem::remove(GetBlockPosFilename(CDiskBlockPos(BLOCK_FILE, 0), "blk"));
+            SelectParams(prevParams);
+        }
+
+        void AddKeys(CWallet& wallet)
+        {
+            LOCK(wallet.cs_wallet);
+            BOOST_FOREACH(const CKey& key, vKeys)
+                BOOST_REQUIRE(wallet.AddKey(key));
+        }
+
+        int Rescan(CWallet& wallet, int nThreads)
+        {
+            mapArgs["-rescanthreads"] = strprintf("%d", nThreads);
+            return wallet.ScanForWalletTransactions(vIndexes.front(), true);
+        }
+    };
+
+    /** Hashes of the wallet transactions in the order they were added */
+    std::vector<uint256> GetWalletTxs(CWallet& wallet)
+    {
+        LOCK(wallet.cs_wallet);
+        std::map<int64_t, uint256> mapOrdered;
+        BOOST_FOREACH(const PAIRTYPE(const uint256, CWalletTx)& item, wallet.mapWallet)
+            mapOrdered[item.second.nOrderPos] = item.first;
+
+        std::vector<uint256> vHashes;
+        BOOST_FOREACH(const PAIRTYPE(const int64_t, uint256)& item, mapOrdered)
+            vHashes.push_back(item.second);
+        return vHashes;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(rescan_tests, RescanFixture)
+
+BOOST_AUTO_TEST_CASE(rescan_threads_find_same_txs)
+{
+    CWallet walletSingle("wallet_rescan_single.dat");
+    AddKeys(walletSingle);
+    BOOST_CHECK_EQUAL(Rescan(walletSingle, 1), (int)vExpected.size());
+    std::vector<uint256> vSingle = GetWalletTxs(walletSingle);
+    BOOST_CHECK(vSingle == vExpected);
+
+    CWallet walletMulti("wallet_rescan_multi.dat");
+    AddKeys(walletMulti);
+    BOOST_CHECK_EQUAL(Rescan(walletMulti, 4), (int)vExpected.size());
+    std::vector<uint256> vMulti = GetWalletTxs(walletMulti);
+    BOOST_CHECK(vMulti == vSingle);
+
+    // every transaction points at the block it was found in
+    LOCK2(cs_main, walletMulti.cs_wallet);
+    BOOST_FOREACH(const uint256& hash, vMulti) {
+        const CWalletTx& wtx = walletMulti.mapWallet[hash];
+        BOOST_REQUIRE(mapBlockIndex.count(wtx.hashBlock));
+        const CBlockIndex* pindex = mapBlockIndex[wtx.hashBlock];
+        BOOST_CHECK(chainActive.Contains(pindex));
+        BOOST_CHECK_EQUAL(wtx.GetDepthInMainChain(), chainActive.Height() - pindex->nHeight + 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rescan_abort)
+{
+    CWallet wallet("wallet_rescan_abort.dat");
+    AddKeys(wallet);
+    BOOST_CHECK(!wallet.AbortRescan());
+
+    // abort as soon as the rescan starts, before any block is added
+    pwalletAbort = &wallet;
+    wallet.ShowProgress.connect(&AbortOnStart);
+    BOOST_CHECK_EQUAL(Rescan(wallet, 4), 0);
+    wallet.ShowProgress.disconnect(&AbortOnStart);
+    pwalletAbort = NULL;
+    BOOST_CHECK(GetWalletTxs(wallet).empty());
+
+    // the abort doesn't stick to the next rescan
+    BOOST_CHECK(!wallet.AbortRescan());
+    BOOST_CHECK_EQUAL(Rescan(wallet, 4), (int)vExpected.size());
+    BOOST_CHECK(GetWalletTxs(wallet) == vExpected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
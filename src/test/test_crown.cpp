@@ -4,6 +4,7 @@
 
 #define BOOST_TEST_MODULE Crown Test Suite
 
+#include "crypto/sha256.h"
 #include "key.h"
 #include "main.h"
 #include "random.h"
@@ -31,6 +32,7 @@ struct TestingSetup {
     boost::thread_group threadGroup;
 
     TestingSetup() {
+        SHA256AutoDetect();
         ECC_Start();
         SetupEnvironment();
         fPrintToDebugLog = false; // don't want to write to debug.log file
@@ -244,6 +244,36 @@ BOOST_AUTO_TEST_CASE(basic_transaction_tests)
     BOOST_CHECK_MESSAGE(!CheckTransaction(tx, state) || !state.IsValid(), "Transaction with duplicate txins should be invalid.");
 }
 
+BOOST_AUTO_TEST_CASE(shared_transaction_serialization)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 1);
+    mtx.vout.resize(2);
+    mtx.vout[0].nValue = 11*CENT;
+    mtx.vout[1].nValue = 22*CENT;
+    CTransaction tx(mtx);
+
+    // a shared transaction is serialized as the transaction itself
+    CTransactionRef ptx = MakeTransactionRef(tx);
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION), ssRef(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << tx;
+    ssRef << ptx;
+    BOOST_CHECK(ssTx.str() == ssRef.str());
+    BOOST_CHECK_EQUAL(GetSerializeSize(ptx, SER_NETWORK, PROTOCOL_VERSION), ssTx.size());
+
+    CTransactionRef ptxRead;
+    ssRef >> ptxRead;
+    BOOST_CHECK(ptxRead && ptxRead != ptx);
+    BOOST_CHECK(ptxRead->GetHash() == tx.GetHash());
+
+    // copies of a block hold the same transactions
+    CBlock block;
+    block.vtx.push_back(ptx);
+    CBlock blockCopy(block);
+    BOOST_CHECK(blockCopy.vtx[0] == ptx);
+}
+
 //
 // Helper: create two dummy transactions, each with
 // two outputs.  The first has 11 and 50 CENT outputs
@@ -270,14 +300,14 @@ SetupDummyInputs(CBasicKeyStore& keystoreRet, CCoinsViewCache& coinsRet)
     dummyTransactions[0].vout[0].scriptPubKey << ToByteVector(key[0].GetPubKey()) << OP_CHECKSIG;
     dummyTransactions[0].vout[1].nValue = 50*CENT;
     dummyTransactions[0].vout[1].scriptPubKey << ToByteVector(key[1].GetPubKey()) << OP_CHECKSIG;
-    coinsRet.ModifyCoins(dummyTransactions[0].GetHash())->FromTx(dummyTransactions[0], 0);
+    AddCoins(coinsRet, dummyTransactions[0], 0);
 
     dummyTransactions[1].vout.resize(2);
     dummyTransactions[1].vout[0].nValue = 21*CENT;
     dummyTransactions[1].vout[0].scriptPubKey = GetScriptForDestination(key[2].GetPubKey().GetID());
     dummyTransactions[1].vout[1].nValue = 22*CENT;
     dummyTransactions[1].vout[1].scriptPubKey = GetScriptForDestination(key[3].GetPubKey().GetID());
-    coinsRet.ModifyCoins(dummyTransactions[1].GetHash())->FromTx(dummyTransactions[1], 0);
+    AddCoins(coinsRet, dummyTransactions[1], 0);
 
     return dummyTransactions;
 }
@@ -5,6 +5,7 @@
 
 #include "txdb.h"
 
+#include "init.h"
 #include "pow.h"
 #include "uint256.h"
 
@@ -14,42 +15,150 @@
 
 using namespace std;
 
-void static BatchWriteCoins(CLevelDBBatch &batch, const uint256 &hash, const CCoins &coins) {
-    if (coins.IsPruned())
-        batch.Erase(make_pair('c', hash));
-    else
-        batch.Write(make_pair('c', hash), coins);
-}
+static const char DB_COIN = 'C';
+static const char DB_COINS = 'c';
+static const char DB_COIN_STATS = 's';
+static const char DB_COINS_STATS = 'S';
+static const char DB_BEST_BLOCK = 'B';
+
+namespace {
+
+/** Key of one unspent output: DB_COIN, txid, VARINT(output index) */
+struct CoinEntry {
+    COutPoint* outpoint;
+    char key;
+    CoinEntry(const COutPoint* ptr) : outpoint(const_cast<COutPoint*>(ptr)), key(DB_COIN) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s, int nType, int nVersion) const {
+        ::Serialize(s, key, nType, nVersion);
+        ::Serialize(s, outpoint->hash, nType, nVersion);
+        ::Serialize(s, VARINT(outpoint->n), nType, nVersion);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        ::Unserialize(s, key, nType, nVersion);
+        ::Unserialize(s, outpoint->hash, nType, nVersion);
+        ::Unserialize(s, VARINT(outpoint->n), nType, nVersion);
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 1 + 32 + ::GetSerializeSize(VARINT(outpoint->n), nType, nVersion);
+    }
+};
+
+/**
+ * A whole transaction's unspent outputs in the database layout before one
+ * record per output, only read by CCoinsViewDB::Upgrade().
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nCode), bit 1: coinbase, bits 2 and 4: vout[0] and vout[1] unspent,
+ *   the higher bits the number of non-zero bytes in the following bitvector
+ *   (minus one when neither vout[0] nor vout[1] is unspent)
+ * - unspentness bitvector, for vout[2] and further; least significant byte first
+ * - the non-spent CTxOuts (via CTxOutCompressor)
+ * - VARINT(nHeight)
+ */
+class CCoins
+{
+public:
+    bool fCoinBase;
+    std::vector<CTxOut> vout;
+    int nHeight;
+
+    CCoins() : fCoinBase(false), nHeight(0) {}
+
+    template<typename Stream>
+    void Unserialize(Stream &s, int nType, int nVersion) {
+        unsigned int nCode = 0;
+        int nTxVersion = 0;
+        ::Unserialize(s, VARINT(nTxVersion), nType, nVersion);
+        ::Unserialize(s, VARINT(nCode), nType, nVersion);
+        fCoinBase = nCode & 1;
+        std::vector<bool> vAvail(2, false);
+        vAvail[0] = (nCode & 2) != 0;
+        vAvail[1] = (nCode & 4) != 0;
+        unsigned int nMaskCode = (nCode / 8) + ((nCode & 6) != 0 ? 0 : 1);
+        // spentness bitmask
+        while (nMaskCode > 0) {
+            unsigned char chAvail = 0;
+            ::Unserialize(s, chAvail, nType, nVersion);
+            for (unsigned int p = 0; p < 8; p++) {
+                bool f = (chAvail & (1 << p)) != 0;
+                vAvail.push_back(f);
+            }
+            if (chAvail != 0)
+                nMaskCode--;
+        }
+        // txouts themself
+        vout.assign(vAvail.size(), CTxOut());
+        for (unsigned int i = 0; i < vAvail.size(); i++) {
+            if (vAvail[i])
+                ::Unserialize(s, REF(CTxOutCompressor(vout[i])), nType, nVersion);
+        }
+        // coinbase height
+        ::Unserialize(s, VARINT(nHeight), nType, nVersion);
+    }
+};
 
-void static BatchWriteHashBestChain(CLevelDBBatch &batch, const uint256 &hash) {
-    batch.Write('B', hash);
 }
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe) {
+    // The statistics of an empty set are known without a scan
+    if (!db.Exists(DB_BEST_BLOCK) && !db.Exists(DB_COIN_STATS))
+        db.Write(DB_COIN_STATS, CCoinsStats());
+}
+
+bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    return db.Read(CoinEntry(&outpoint), coin);
 }
 
-bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(make_pair('c', txid), coins);
+bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    return db.Exists(CoinEntry(&outpoint));
 }
 
-bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(make_pair('c', txid));
+bool CCoinsViewDB::SeekCoin(const COutPoint &from, COutPoint &outpoint, Coin &coin) const {
+    // The outputs of a transaction are stored next to each other, ordered by
+    // index, so one seek finds the first one left
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << CoinEntry(&from);
+    pcursor->Seek(leveldb::Slice(&ssKeySet[0], ssKeySet.size()));
+    if (!pcursor->Valid() || pcursor->key()[0] != DB_COIN)
+        return false;
+
+    leveldb::Slice slKey = pcursor->key();
+    CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+    CoinEntry entry(&outpoint);
+    ssKey >> entry;
+    if (outpoint.hash != from.hash)
+        return false;
+    leveldb::Slice slValue = pcursor->value();
+    CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+    ssValue >> coin;
+    return true;
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
     uint256 hashBestChain;
-    if (!db.Read('B', hashBestChain))
+    if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
     return hashBestChain;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CCoinsStats &statsDelta) {
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            CoinEntry entry(&it->first);
+            if (it->second.coin.IsSpent())
+                batch.Erase(entry);
+            else
+                batch.Write(entry, it->second.coin);
             changed++;
         }
         count++;
@@ -57,12 +166,122 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         mapCoins.erase(itOld);
     }
     if (!hashBlock.IsNull())
-        BatchWriteHashBestChain(batch, hashBlock);
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+
+    // The statistics are written in the same batch as the coins and the best
+    // block, so they always describe the stored set
+    CCoinsStats stats;
+    if (!statsDelta.IsEmpty() && db.Read(DB_COIN_STATS, stats)) {
+        stats += statsDelta;
+        batch.Write(DB_COIN_STATS, stats);
+    }
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return db.WriteBatch(batch);
 }
 
+bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
+    return db.Read(DB_COIN_STATS, stats);
+}
+
+bool CCoinsViewDB::HaveStats() const {
+    return db.Exists(DB_COIN_STATS);
+}
+
+bool CCoinsViewDB::RebuildStats() {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << DB_COIN;
+    pcursor->Seek(leveldb::Slice(&ssKeySet[0], ssKeySet.size()));
+
+    CCoinsStats stats;
+    COutPoint outpoint;
+    CoinEntry entry(&outpoint);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            ssKey >> entry;
+            if (entry.key != DB_COIN)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            Coin coin;
+            ssValue >> coin;
+            stats.AddCoin(outpoint, coin);
+            pcursor->Next();
+        } catch (std::exception &e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return db.Write(DB_COIN_STATS, stats);
+}
+
+bool CCoinsViewDB::Upgrade() {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << DB_COINS;
+    pcursor->Seek(leveldb::Slice(&ssKeySet[0], ssKeySet.size()));
+    if (!pcursor->Valid() || pcursor->key()[0] != DB_COINS)
+        return true;
+
+    LogPrintf("Upgrading UTXO database to one record per output...\n");
+    int64_t nStart = GetTimeMillis();
+    size_t nTransactions = 0, nOutputs = 0;
+    uint256 lastHash;
+    // Every batch erases the transaction records whose outputs it writes, so
+    // an interrupted upgrade resumes where it stopped. The statistics of the
+    // old layout are recomputed once it is done.
+    CLevelDBBatch batch;
+    batch.Erase(DB_COINS_STATS);
+    size_t nBatchRecords = 0;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            break;
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            uint256 txhash;
+            ssKey >> chType;
+            if (chType != DB_COINS)
+                break;
+            ssKey >> txhash;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins old;
+            ssValue >> old;
+            for (unsigned int i = 0; i < old.vout.size(); i++) {
+                if (!old.vout[i].IsNull() && !old.vout[i].scriptPubKey.IsUnspendable()) {
+                    COutPoint outpoint(txhash, i);
+                    batch.Write(CoinEntry(&outpoint), Coin(old.vout[i], old.nHeight, old.fCoinBase));
+                    nOutputs++;
+                    nBatchRecords++;
+                }
+            }
+            batch.Erase(make_pair(DB_COINS, txhash));
+            nBatchRecords++;
+            nTransactions++;
+            lastHash = txhash;
+        } catch (std::exception &e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+        if (nBatchRecords >= 100000) {
+            db.WriteBatch(batch);
+            batch.Clear();
+            nBatchRecords = 0;
+        }
+        pcursor->Next();
+    }
+    db.WriteBatch(batch);
+    db.CompactRange(make_pair(DB_COINS, uint256()), make_pair(DB_COINS, lastHash));
+    LogPrintf("Upgraded %u transactions to %u outputs in %dms%s\n", (unsigned int)nTransactions, (unsigned int)nOutputs,
+              GetTimeMillis() - nStart, ShutdownRequested() ? ", interrupted" : "");
+    return !ShutdownRequested();
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
 }
 
@@ -99,59 +318,6 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read('l', nFile);
 }
 
-bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
-    ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
-            }
-            pcursor->Next();
-        } catch (std::exception &e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        }
-    }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
-    return true;
-}
-
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(make_pair('t', txid), pos);
 }
@@ -175,6 +341,30 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+bool CBlockTreeDB::ReadAuxPow(const uint256 &hash, CAuxPow &auxpow) {
+    return Read(make_pair('a', hash), auxpow);
+}
+
+bool CBlockTreeDB::WriteAuxPow(const uint256 &hash, const CAuxPow &auxpow) {
+    return Write(make_pair('a', hash), auxpow);
+}
+
+bool CBlockTreeDB::HaveAuxPow(const uint256 &hash) {
+    return Exists(make_pair('a', hash));
+}
+
+bool CBlockTreeDB::ReadAuxPowBestBlock(uint256 &hash) {
+    return Read('A', hash);
+}
+
+bool CBlockTreeDB::WriteAuxPowBestBlock(const uint256 &hash) {
+    return Write('A', hash);
+}
+
+bool CBlockTreeDB::EraseAuxPowBestBlock() {
+    return Erase('A');
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
@@ -228,3 +418,34 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
 
     return true;
 }
+
+CBlockFilterDB::CBlockFilterDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blockfilter", nCacheSize, fMemory, fWipe) {
+}
+
+bool CBlockFilterDB::ReadFilter(const uint256 &hash, CBlockFilter &filter) {
+    std::vector<unsigned char> vchEncoded;
+    if (!Read(make_pair('f', hash), vchEncoded))
+        return false;
+    try {
+        filter = CBlockFilter(hash, vchEncoded);
+    } catch (const std::exception &e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool CBlockFilterDB::WriteFilter(const CBlockFilter &filter) {
+    return Write(make_pair('f', filter.GetBlockHash()), filter.GetEncoded());
+}
+
+bool CBlockFilterDB::HaveFilter(const uint256 &hash) {
+    return Exists(make_pair('f', hash));
+}
+
+bool CBlockFilterDB::ReadBestBlock(uint256 &hash) {
+    return Read('B', hash);
+}
+
+bool CBlockFilterDB::WriteBestBlock(const uint256 &hash) {
+    return Write('B', hash);
+}
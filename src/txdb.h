@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "blockfilter.h"
 #include "leveldbwrapper.h"
 #include "main.h"
 
@@ -14,7 +15,6 @@
 #include <utility>
 #include <vector>
 
-class CCoins;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -31,6 +31,8 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max memory allocated to block filter DB specific cache, if -blockfilterindex (MiB)
+static const int64_t nMaxBlockFilterDBCache = 16;
 
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
@@ -40,11 +42,20 @@ protected:
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
+    bool SeekCoin(const COutPoint &from, COutPoint &outpoint, Coin &coin) const;
     uint256 GetBestBlock() const;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CCoinsStats &statsDelta);
     bool GetStats(CCoinsStats &stats) const;
+
+    //! Whether the statistics are stored, they are missing in databases from older versions
+    bool HaveStats() const;
+    //! Compute the statistics with a full scan of the database and store them
+    bool RebuildStats();
+
+    //! Convert the per-transaction records of older versions to one record per output
+    bool Upgrade();
 };
 
 /** Access to the block database (blocks/index/) */
@@ -67,7 +78,31 @@ public:
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    bool ReadAuxPow(const uint256 &hash, CAuxPow &auxpow);
+    bool WriteAuxPow(const uint256 &hash, const CAuxPow &auxpow);
+    bool HaveAuxPow(const uint256 &hash);
+    //! last block of the active chain up to which every merge-mined block has an auxpow record
+    bool ReadAuxPowBestBlock(uint256 &hash);
+    bool WriteAuxPowBestBlock(const uint256 &hash);
+    bool EraseAuxPowBestBlock();
     bool LoadBlockIndexGuts();
 };
 
+/** Access to the compact block filter database (blockfilter/) */
+class CBlockFilterDB : public CLevelDBWrapper
+{
+public:
+    CBlockFilterDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CBlockFilterDB(const CBlockFilterDB&);
+    void operator=(const CBlockFilterDB&);
+public:
+    bool ReadFilter(const uint256 &hash, CBlockFilter &filter);
+    bool WriteFilter(const CBlockFilter &filter);
+    bool HaveFilter(const uint256 &hash);
+    //! last block of the active chain up to which every block has a filter
+    bool ReadBestBlock(uint256 &hash);
+    bool WriteBestBlock(const uint256 &hash);
+};
+
 #endif // BITCOIN_TXDB_H
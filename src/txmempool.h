@@ -13,6 +13,9 @@
 #include "primitives/transaction.h"
 #include "sync.h"
 
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+
 class CAutoFile;
 
 inline double AllowFreeThreshold()
@@ -28,7 +31,7 @@ inline bool AllowFree(double dPriority)
 }
 
 
-/** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
+/** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
 /**
@@ -37,7 +40,7 @@ static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 class CTxMemPoolEntry
 {
 private:
-    CTransaction tx;
+    CTransactionRef tx;
     CAmount nFee; //! Cached to avoid expensive parent-transaction lookups
     size_t nTxSize; //! ... and avoid recomputing tx size
     size_t nModSize; //! ... and modified size for priority
@@ -45,22 +48,146 @@ private:
     int64_t nTime; //! Local time when entering the mempool
     double dPriority; //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    CAmount nFeeDelta; //! Fee delta set by prioritisetransaction
+
+    // Information about the descendants of this transaction that are in the
+    // mempool, which are removed together with it when it's evicted
+    uint64_t nCountWithDescendants; //! number of descendant transactions, including this one
+    uint64_t nSizeWithDescendants; //! ... and their size
+    CAmount nModFeesWithDescendants; //! ... and their modified fees
+
+    void Init();
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
                     int64_t _nTime, double _dPriority, unsigned int _nHeight);
+    CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
+                    int64_t _nTime, double _dPriority, unsigned int _nHeight);
     CTxMemPoolEntry();
     CTxMemPoolEntry(const CTxMemPoolEntry& other);
 
-    const CTransaction& GetTx() const { return this->tx; }
+    const CTransaction& GetTx() const { return *this->tx; }
+    CTransactionRef GetSharedTx() const { return this->tx; }
     double GetPriority(unsigned int currentHeight) const;
     CAmount GetFee() const { return nFee; }
+    CAmount GetModifiedFee() const { return nFee + nFeeDelta; }
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
+
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
+
+    void UpdateFeeDelta(CAmount nNewFeeDelta);
+    /** Adjust the descendant state, when a descendant is added or removed */
+    void UpdateDescendantState(int64_t nModifySize, CAmount nModifyFee, int64_t nModifyCount);
 };
 
+struct update_descendant_state
+{
+    update_descendant_state(int64_t _nModifySize, CAmount _nModifyFee, int64_t _nModifyCount) :
+        nModifySize(_nModifySize), nModifyFee(_nModifyFee), nModifyCount(_nModifyCount)
+    { }
+
+    void operator() (CTxMemPoolEntry &e) { e.UpdateDescendantState(nModifySize, nModifyFee, nModifyCount); }
+
+private:
+    int64_t nModifySize;
+    CAmount nModifyFee;
+    int64_t nModifyCount;
+};
+
+struct update_fee_delta
+{
+    update_fee_delta(CAmount _nFeeDelta) : nFeeDelta(_nFeeDelta) { }
+
+    void operator() (CTxMemPoolEntry &e) { e.UpdateFeeDelta(nFeeDelta); }
+
+private:
+    CAmount nFeeDelta;
+};
+
+// extracts a CTxMemPoolEntry's transaction hash
+struct mempoolentry_txid
+{
+    typedef uint256 result_type;
+    result_type operator() (const CTxMemPoolEntry &entry) const
+    {
+        return entry.GetTx().GetHash();
+    }
+};
+
+/** Sort by modified fee rate, highest first, ties broken by hash */
+class CompareTxMemPoolEntryByFeeRate
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        double f1 = (double)a.GetModifiedFee() * b.GetTxSize();
+        double f2 = (double)b.GetModifiedFee() * a.GetTxSize();
+        if (f1 == f2)
+            return a.GetTx().GetHash() < b.GetTx().GetHash();
+        return f1 > f2;
+    }
+};
+
+/**
+ * Sort by the higher of the transaction's own fee rate and the fee rate of
+ * it and its descendants, lowest first. Evicting from the front removes the
+ * cheapest packages first, without evicting a transaction that a descendant
+ * pays for.
+ */
+class CompareTxMemPoolEntryByDescendantScore
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        double f1 = GetScore(a) * GetSize(b);
+        double f2 = GetScore(b) * GetSize(a);
+        if (f1 == f2) {
+            // evict the newer transaction first
+            if (a.GetTime() == b.GetTime())
+                return a.GetTx().GetHash() < b.GetTx().GetHash();
+            return a.GetTime() > b.GetTime();
+        }
+        return f1 < f2;
+    }
+
+private:
+    // use the descendant fee rate when it's higher than the transaction's own
+    static bool UseDescendantScore(const CTxMemPoolEntry& e)
+    {
+        double f1 = (double)e.GetModifiedFee() * e.GetSizeWithDescendants();
+        double f2 = (double)e.GetModFeesWithDescendants() * e.GetTxSize();
+        return f2 > f1;
+    }
+    static double GetScore(const CTxMemPoolEntry& e)
+    {
+        return UseDescendantScore(e) ? e.GetModFeesWithDescendants() : e.GetModifiedFee();
+    }
+    static double GetSize(const CTxMemPoolEntry& e)
+    {
+        return UseDescendantScore(e) ? e.GetSizeWithDescendants() : e.GetTxSize();
+    }
+};
+
+/** Sort by the time the transactions entered the mempool, oldest first */
+class CompareTxMemPoolEntryByEntryTime
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        return a.GetTime() < b.GetTime();
+    }
+};
+
+// multi_index tags
+struct fee_rate {};
+struct entry_time {};
+struct descendant_score {};
+
 class CMinerPolicyEstimator;
 
 /** An inpoint - a combination of a transaction and an index n into its vin */
@@ -86,6 +213,22 @@ public:
  * are added to the pool: if a new transaction double-spends
  * an input of a transaction in the pool, it is dropped,
  * as are non-standard transactions.
+ *
+ * mapTx is a boost::multi_index that sorts the entries by txid, by modified
+ * fee rate (fee_rate tag), by entry time (entry_time tag) and by the fee rate
+ * of the entry and its descendants (descendant_score tag). The indexes and
+ * the in-mempool parents and children of every entry (mapLinks) are kept up
+ * to date by addUnchecked() and remove(), so block assembly and eviction can
+ * walk the pool in order without looking up coins or sorting.
+ *
+ * The pool is limited in size by TrimToSize(), which evicts the packages with
+ * the lowest descendant score. Each eviction raises the minimum fee rate to
+ * get into the pool (GetMinFee()) above the fee rate of the evicted package,
+ * and that minimum decays again once blocks come in.
+ *
+ * Priority isn't indexed: it grows with the chain height at a different rate
+ * for every transaction, so it's computed from the cached entry values when
+ * it is needed.
  */
 class CTxMemPool
 {
@@ -98,9 +241,69 @@ private:
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
     uint64_t cachedInnerUsage; //! sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate; //! minimum fee to get into the pool, decreases exponentially
+
+    void trackPackageRemoved(const CFeeRate& rate);
+
+public:
+    typedef boost::multi_index_container<
+        CTxMemPoolEntry,
+        boost::multi_index::indexed_by<
+            // sorted by txid
+            boost::multi_index::ordered_unique<mempoolentry_txid>,
+            // sorted by modified fee rate
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<fee_rate>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByFeeRate
+            >,
+            // sorted by entry time
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<entry_time>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByEntryTime
+            >,
+            // sorted by the fee rate with descendants, lowest first
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<descendant_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByDescendantScore
+            >
+        >
+    > indexed_transaction_set;
+
+    typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
+    struct CompareIteratorByHash {
+        bool operator()(const txiter &a, const txiter &b) const {
+            return a->GetTx().GetHash() < b->GetTx().GetHash();
+        }
+    };
+    typedef std::set<txiter, CompareIteratorByHash> setEntries;
+
+private:
+    struct TxLinks {
+        setEntries parents;
+        setEntries children;
+    };
+
+    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
+    txlinksMap mapLinks;
+
+    void UpdateParent(txiter entry, txiter parent, bool add);
+    void UpdateChild(txiter entry, txiter child, bool add);
+    /** Set the descendant state of entry from its current descendants */
+    void UpdateDescendantsOf(txiter entry);
+    /** Remove a set of transactions, which must include all their descendants */
+    void RemoveStaged(const setEntries& stage, std::list<CTransaction>& removed);
+    void removeUnchecked(txiter entry, std::list<CTransaction>& removed);
+
 public:
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
+
     mutable CCriticalSection cs;
-    std::map<uint256, CTxMemPoolEntry> mapTx;
+    indexed_transaction_set mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
@@ -120,11 +323,12 @@ public:
     void remove(const CTransaction &tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeCoinbaseSpends(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight);
     void removeConflicts(const CTransaction &tx, std::list<CTransaction>& removed);
-    void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
+    void removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight,
                         std::list<CTransaction>& conflicts);
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
-    void pruneSpent(const uint256& hash, CCoins &coins);
+    //! Whether a transaction in the pool spends outpoint
+    bool isSpent(const COutPoint& outpoint);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
 
@@ -133,6 +337,38 @@ public:
     void ApplyDeltas(const uint256 hash, double &dPriorityDelta, CAmount &nFeeDelta);
     void ClearPrioritisation(const uint256 hash);
 
+    /** Transactions in the mempool that entry spends from, mempool.cs must be held */
+    const setEntries& GetMemPoolParents(txiter entry) const;
+    /** Transactions in the mempool that spend from entry, mempool.cs must be held */
+    const setEntries& GetMemPoolChildren(txiter entry) const;
+    /** All in-mempool ancestors of entry, not including entry itself */
+    void CalculateMemPoolAncestors(txiter entry, setEntries& setAncestors) const;
+    /**
+     * In-mempool ancestors of entry, which is not in the pool yet. Fails with
+     * errString as soon as entry would have more than limitAncestorCount
+     * ancestors or limitAncestorSize bytes with them, or would push one of
+     * them over limitDescendantCount descendants or limitDescendantSize
+     * bytes, so the walk is bounded by the limits. mempool.cs must be held.
+     */
+    bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors,
+                                   uint64_t limitAncestorCount, uint64_t limitAncestorSize,
+                                   uint64_t limitDescendantCount, uint64_t limitDescendantSize,
+                                   std::string& errString) const;
+    /** Add entry and all its in-mempool descendants to setDescendants */
+    void CalculateDescendants(txiter entry, setEntries& setDescendants) const;
+
+    /**
+     * The minimum fee rate to get into the mempool, which may itself not be
+     * enough to get into the mempool when it is at sizelimit
+     */
+    CFeeRate GetMinFee(size_t sizelimit) const;
+
+    /** Evict the lowest descendant score packages until the pool is at most sizelimit bytes */
+    void TrimToSize(size_t sizelimit);
+
+    /** Remove transactions that entered the mempool before time and their descendants, returns the number removed */
+    int Expire(int64_t time);
+
     unsigned long size()
     {
         LOCK(cs);
@@ -152,6 +388,8 @@ public:
     }
 
     bool lookup(uint256 hash, CTransaction& result) const;
+    /** The transaction itself instead of a copy, NULL if it is not in the mempool */
+    CTransactionRef get(const uint256& hash) const;
 
     /** Estimate fee rate needed to get into the next nBlocks */
     CFeeRate estimateFee(int nBlocks) const;
@@ -177,8 +415,7 @@ protected:
 
 public:
     CCoinsViewMemPool(CCoinsView *baseIn, CTxMemPool &mempoolIn);
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
 };
 
 #endif // BITCOIN_TXMEMPOOL_H
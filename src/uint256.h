@@ -133,6 +133,8 @@ public:
      * @note This hash is not stable between little and big endian.
      */
     uint64_t GetHash(const uint256& salt) const;
+    //! The same with one more word mixed in, e.g. an output index
+    uint64_t GetHash(const uint256& salt, uint32_t extra) const;
 };
 
 /* uint256 from const char *.
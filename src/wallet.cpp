@@ -9,6 +9,8 @@
 #include "base58.h"
 #include "checkpoints.h"
 #include "coincontrol.h"
+#include "init.h"
+#include "txdb.h"
 #include "net.h"
 #include "masternode-budget.h"
 #include "instantx.h"
@@ -942,46 +944,368 @@ bool CWalletTx::WriteToDisk()
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  */
+namespace
+{
+    //! Blocks pinned from the active chain at a time
+    const int RESCAN_BATCH_SIZE = 500;
+    //! Blocks each scanning thread may read ahead of the wallet update
+    const int RESCAN_BLOCKS_AHEAD = 16;
+
+    /**
+     * A block read by a rescan thread. Its outputs are already matched against
+     * the wallet keys, transactions spending wallet coins are found when the
+     * block is added to the wallet, because the coins they spend may come from
+     * a block that is not added yet.
+     */
+    struct CRescanBlock
+    {
+        CBlockIndex* pindex;
+        CBlock block;
+        std::vector<bool> vPaysToWallet;
+    };
+
+    /**
+     * Blocks pinned for a rescan. Scanning threads read and match them in any
+     * order, the rescan takes the results back in chain order.
+     */
+    class CRescanQueue
+    {
+    private:
+        const CWallet& wallet;
+        const int nMaxAhead;
+
+        boost::mutex mutex;
+        boost::condition_variable condWorker;
+        boost::condition_variable condResult;
+
+        //! pinned blocks that no thread has taken yet
+        std::deque<CBlockIndex*> queueBlocks;
+        //! scanned blocks by sequence number
+        std::map<int, boost::shared_ptr<CRescanBlock> > mapResults;
+        //! sequence number of the next block a thread takes
+        int nTaken;
+        //! sequence number of the next block to hand back
+        int nReturned;
+        bool fQuit;
+
+    public:
+        CRescanQueue(const CWallet& walletIn, int nMaxAheadIn)
+            : wallet(walletIn)
+            , nMaxAhead(nMaxAheadIn)
+            , nTaken(0)
+            , nReturned(0)
+            , fQuit(false)
+        {
+        }
+
+        void Push(CBlockIndex* pindex)
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            queueBlocks.push_back(pindex);
+            condWorker.notify_one();
+        }
+
+        //! pinned blocks no thread has started on
+        size_t Waiting()
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            return queueBlocks.size();
+        }
+
+        //! no block is waiting, being scanned or waiting to be handed back
+        bool IsEmpty()
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            return queueBlocks.empty() && nReturned == nTaken;
+        }
+
+        /** Wait for the next block in chain order, then return it with the blocks right after it that are ready */
+        void Pop(std::vector<boost::shared_ptr<CRescanBlock> >& vBlocks, size_t nMax)
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!mapResults.count(nReturned))
+                condResult.wait(lock);
+
+            std::map<int, boost::shared_ptr<CRescanBlock> >::iterator it;
+            while (vBlocks.size() < nMax && (it = mapResults.find(nReturned)) != mapResults.end()) {
+                vBlocks.push_back(it->second);
+                mapResults.erase(it);
+                ++nReturned;
+            }
+            condWorker.notify_all();
+        }
+
+        void Quit()
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fQuit = true;
+            condWorker.notify_all();
+        }
+
+        void Thread()
+        {
+            while (true) {
+                boost::shared_ptr<CRescanBlock> pblock(new CRescanBlock());
+                int nSequence;
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    while (!fQuit && (queueBlocks.empty() || nTaken - nReturned >= nMaxAhead))
+                        condWorker.wait(lock);
+                    if (fQuit)
+                        return;
+                    pblock->pindex = queueBlocks.front();
+                    queueBlocks.pop_front();
+                    nSequence = nTaken++;
+                }
+
+                if (!ReadBlockFromDisk(pblock->block, pblock->pindex))
+                    LogPrintf("CWallet::ScanForWalletTransactions : cannot read block %s\n", pblock->pindex->GetBlockHash().ToString());
+
+                pblock->vPaysToWallet.resize(pblock->block.vtx.size());
+                for (size_t i = 0; i < pblock->block.vtx.size(); i++)
+                    pblock->vPaysToWallet[i] = wallet.IsMine(*pblock->block.vtx[i]);
+
+                boost::unique_lock<boost::mutex> lock(mutex);
+                mapResults[nSequence] = pblock;
+                condResult.notify_one();
+            }
+        }
+    };
+
+    bool SpendsFromWallet(const CTransaction& tx, const std::map<uint256, CWalletTx>& mapWallet)
+    {
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            if (mapWallet.count(txin.prevout.hash))
+                return true;
+        return false;
+    }
+
+    /** Whether the block filter matches any of the elements, also true for a block without filter */
+    bool FilterMayMatch(const CBlockIndex* pindex, const CGolombCodedSet::ElementSet& elements)
+    {
+        CBlockFilter filter;
+        if (!pblockfilterdb->ReadFilter(pindex->GetBlockHash(), filter))
+            return true;
+        try {
+            return filter.MatchAny(elements);
+        } catch (const std::ios_base::failure&) {
+            return true;
+        }
+    }
+}
+
+void CWallet::GetFilterElements(CGolombCodedSet::ElementSet& elements) const
+{
+    AssertLockHeld(cs_wallet);
+
+    std::set<CKeyID> setKeyIds;
+    GetKeys(setKeyIds);
+    BOOST_FOREACH(const CKeyID& keyid, setKeyIds)
+    {
+        elements.insert(CBlockFilter::ScriptElement(GetScriptForDestination(keyid)));
+        CPubKey pubkey;
+        if (GetPubKey(keyid, pubkey))
+            elements.insert(CBlockFilter::ScriptElement(CScript() << ToByteVector(pubkey) << OP_CHECKSIG));
+    }
+
+    {
+        LOCK(cs_KeyStore);
+        BOOST_FOREACH(const PAIRTYPE(CScriptID, CScript)& item, mapScripts)
+            elements.insert(CBlockFilter::ScriptElement(GetScriptForDestination(item.first)));
+        BOOST_FOREACH(const CScript& script, setWatchOnly)
+            elements.insert(CBlockFilter::ScriptElement(script));
+    }
+
+    // spends of wallet coins only show up as the outpoints they spend
+    BOOST_FOREACH(const PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
+    {
+        const CWalletTx& wtx = item.second;
+        for (unsigned int i = 0; i < wtx.vout.size(); i++)
+            if (IsMine(wtx.vout[i]) != ISMINE_NO)
+                elements.insert(CBlockFilter::OutPointElement(COutPoint(item.first, i)));
+    }
+}
+
+/**
+ * Scan the active chain from pindexStart for wallet transactions. Blocks are
+ * read and matched against the wallet keys by several threads, while the
+ * wallet is updated in chain order. cs_main is only held to pin the next batch
+ * of blocks and, together with cs_wallet, to add a batch of scanned blocks.
+ * With -blockfilterindex only the blocks whose filter matches the wallet are
+ * read.
+ */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
+    LOCK(cs_scan);
+
     int ret = 0;
     int64_t nNow = GetTime();
 
     CBlockIndex* pindex = pindexStart;
+    double dProgressStart;
+    double dProgressTip;
     {
-        LOCK2(cs_main, cs_wallet);
+        LOCK(cs_main);
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        while (pindex)
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+    }
+
+    {
+        LOCK(cs_scanstate);
+        fScanningWallet = true;
+        fAbortRescan = false;
+        nScanStartTime = GetTime();
+        dScanProgress = 0;
+    }
+
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0)
+        nThreads = boost::thread::hardware_concurrency();
+    nThreads = std::max(1, std::min(MAX_RESCAN_THREADS, nThreads));
+    CRescanQueue queue(*this, nThreads * RESCAN_BLOCKS_AHEAD);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&CRescanQueue::Thread, &queue));
+
+    // A block whose filter matches may pay to the wallet, it has to be added
+    // before the filters of the blocks after it are tested for the spends
+    bool fUseFilters = pblockfilterdb != NULL;
+    CGolombCodedSet::ElementSet setFilterElements;
+    int nFilterElementsRet = -1;
+
+    CBlockIndex* pindexLastPinned = NULL;
+    int nLastProgressHeight = -1;
+    while (true)
+    {
+        // Pin the next batch while the threads are still busy with the current one
+        std::vector<CBlockIndex*> vPinned;
+        if (fUseFilters ? queue.IsEmpty() : queue.Waiting() < RESCAN_BATCH_SIZE / 2) {
+            {
+                LOCK(cs_main);
+                if (pindexLastPinned) {
+                    // continue on the active chain, also after a reorg
+                    pindex = chainActive.Next(chainActive.Contains(pindexLastPinned) ? pindexLastPinned : chainActive.FindFork(pindexLastPinned));
+                }
+                for (int i = 0; i < RESCAN_BATCH_SIZE && pindex; i++) {
+                    vPinned.push_back(pindex);
+                    pindex = chainActive.Next(pindex);
+                }
+            }
+
+            if (fUseFilters && nFilterElementsRet != ret) {
+                LOCK(cs_wallet);
+                setFilterElements.clear();
+                GetFilterElements(setFilterElements);
+                nFilterElementsRet = ret;
+            }
+
+            BOOST_FOREACH(CBlockIndex* pindexPinned, vPinned)
+            {
+                pindexLastPinned = pindexPinned;
+                if (!fUseFilters) {
+                    queue.Push(pindexPinned);
+                } else if (FilterMayMatch(pindexPinned, setFilterElements)) {
+                    queue.Push(pindexPinned);
+                    break;
+                }
+            }
+        }
+
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+            LOCK(cs_scanstate);
+            if (fAbortRescan) {
+                LogPrintf("Rescan aborted at block %d\n", pindexLastPinned ? pindexLastPinned->nHeight : 0);
+                break;
+            }
+        }
+        if (ShutdownRequested())
+            break;
+
+        if (queue.IsEmpty()) {
+            if (vPinned.empty())
+                break;
+            // none of the filters of the batch matched
+            pindex = pindexLastPinned;
+        } else {
+            std::vector<boost::shared_ptr<CRescanBlock> > vBlocks;
+            queue.Pop(vBlocks, RESCAN_BATCH_SIZE);
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+            LOCK2(cs_main, cs_wallet);
+            BOOST_FOREACH(const boost::shared_ptr<CRescanBlock>& pblock, vBlocks)
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
+                for (size_t i = 0; i < pblock->block.vtx.size(); i++)
+                {
+                    const CTransaction& tx = *pblock->block.vtx[i];
+                    if (!pblock->vPaysToWallet[i] && !mapWallet.count(tx.GetHash()) && !SpendsFromWallet(tx, mapWallet))
+                        continue;
+                    if (AddToWalletIfInvolvingMe(tx, &pblock->block, fUpdate))
+                        ret++;
+                }
             }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+            pindex = vBlocks.back()->pindex;
+        }
+
+        double dProgress;
+        {
+            LOCK(cs_main);
+            dProgress = Checkpoints::GuessVerificationProgress(pindex, false);
+        }
+
+        if (dProgressTip - dProgressStart > 0.0) {
+            dProgress = std::max(0.0, std::min(1.0, (dProgress - dProgressStart) / (dProgressTip - dProgressStart)));
+            if (pindex->nHeight / 100 != nLastProgressHeight / 100) {
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)(dProgress * 100))));
+                nLastProgressHeight = pindex->nHeight;
             }
+            LOCK(cs_scanstate);
+            dScanProgress = dProgress;
+        }
+        if (GetTime() >= nNow + 60) {
+            nNow = GetTime();
+            LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, dProgress);
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+        pindex = NULL;
+    }
+
+    queue.Quit();
+    threadGroup.join_all();
+
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+    {
+        LOCK(cs_scanstate);
+        fScanningWallet = false;
+        fAbortRescan = false;
     }
     return ret;
 }
 
+bool CWallet::AbortRescan()
+{
+    LOCK(cs_scanstate);
+    if (!fScanningWallet)
+        return false;
+    fAbortRescan = true;
+    return true;
+}
+
+bool CWallet::GetRescanProgress(double& dProgress, int64_t& nDuration) const
+{
+    LOCK(cs_scanstate);
+    if (!fScanningWallet)
+        return false;
+    dProgress = dScanProgress;
+    nDuration = GetTime() - nScanStartTime;
+    return true;
+}
+
 void CWallet::ReacceptWalletTransactions()
 {
     LOCK2(cs_main, cs_wallet);
@@ -1018,7 +1342,7 @@ void CWalletTx::RelayWalletTransaction(std::string strCommand)
                     ExtractDestination(this->vout[0].scriptPubKey, dest);
                     IXLogPrintf("CWalletTx::RelayWalletTransaction() - Instant send to address: %s\n", CBitcoinAddress(dest).ToString());
                 }
-                g_instantSend->CreateNewLock(((CTransaction)*this));
+                g_instantSend->CreateNewLock(MakeTransactionRef((CTransaction)*this));
                 RelayTransactionLockReq((CTransaction)*this, true);
             }
             else
@@ -9,6 +9,7 @@
 
 #include "amount.h"
 #include "auxpow.h"
+#include "blockfilter.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "crypter.h"
@@ -49,6 +50,10 @@ static const CAmount DEFAULT_TRANSACTION_MAXFEE = 0.2 * COIN; // "smallest denom
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
+//! -rescanthreads default, 0 = one thread per core
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Maximum number of rescan threads
+static const int MAX_RESCAN_THREADS = 8;
 
 static const int MASTERNODE_COLLATERAL = 10000;
 static const int SYSTEMNODE_COLLATERAL = 500;
@@ -154,6 +159,18 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    //! serializes rescans, which only take cs_main and cs_wallet per batch of blocks
+    CCriticalSection cs_scan;
+    //! state of the running rescan, guarded by cs_scanstate
+    mutable CCriticalSection cs_scanstate;
+    bool fScanningWallet;
+    bool fAbortRescan;
+    int64_t nScanStartTime;
+    double dScanProgress;
+
+    //! filter elements of the wallet scripts and of the outpoints of its transactions
+    void GetFilterElements(CGolombCodedSet::ElementSet& elements) const;
+
 public:
 //    bool SelectCoins(int64_t nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet, const CCoinControl *coinControl = NULL, AvailableCoinsType coin_type=ALL_COINS, bool useIX = true) const;
 
@@ -213,6 +230,10 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         m_useInstantSend = true;
+        fScanningWallet = false;
+        fAbortRescan = false;
+        nScanStartTime = 0;
+        dScanProgress = 0;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -310,6 +331,10 @@ public:
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256 &hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    /** Ask the running rescan to stop, returns false if there is none */
+    bool AbortRescan();
+    /** Progress (0 to 1) and duration in seconds of the running rescan, returns false if there is none */
+    bool GetRescanProgress(double& dProgress, int64_t& nDuration) const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
     CAmount GetBalance() const;